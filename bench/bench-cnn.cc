@@ -0,0 +1,318 @@
+// microbenchmarks of the cnn library at the sizes the parser uses, written
+// as JSON (see usage below). every benchmark runs its body for at least
+// --min_time seconds, --repetitions times, and reports the median time
+// per call as its value (and the fastest repetition as min).
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "cnn/cnn.h"
+#include "cnn/expr.h"
+#include "cnn/frozen-dict.h"
+#include "cnn/lstm.h"
+#include "cnn/model.h"
+#include "cnn/nodes.h"
+#include "cnn/param-nodes.h"
+#include "cnn/training.h"
+
+using namespace std;
+using namespace cnn;
+using namespace cnn::expr;
+
+// the parser's defaults: --hidden_dim 64, --input_dim 32, and an action
+// set of a treebank with ~40 labels
+const unsigned kHidden = 64;
+const unsigned kInput = 32;
+const unsigned kActions = 80;
+const unsigned kVocab = 20000;
+const unsigned kBatch = 32;  // rows per batched lookup
+const unsigned kSteps = 20;  // LSTM steps per graph
+const unsigned kChain = 1000;  // nodes in the engine overhead graph
+
+struct Result {
+  string name;
+  string unit;
+  double value;
+  double min;
+  unsigned long iterations;
+};
+
+double min_time = 0.2;
+unsigned repetitions = 5;
+string filter;
+vector<Result> results;
+
+template <class F>
+double seconds(F& f, unsigned long n) {
+  auto start = chrono::steady_clock::now();
+  for (unsigned long i = 0; i < n; ++i) f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// times f() in ns per call, divided by per_call (e.g., the number of nodes
+// or steps a call evaluates)
+template <class F>
+void bench(const string& name, F f, double per_call = 1) {
+  if (name.find(filter) == string::npos) return;
+  f();  // warm up
+  unsigned long n = 1;
+  double t = seconds(f, n);
+  while (t < min_time) {
+    n = max<unsigned long>(n * 2, n * min_time * 1.2 / max(t, 1e-9));
+    t = seconds(f, n);
+  }
+  vector<double> times(repetitions);
+  for (auto& rt : times) rt = seconds(f, n) * 1e9 / (n * per_call);
+  sort(times.begin(), times.end());
+  results.push_back({name, "ns", times[times.size() / 2], times[0], n});
+  cerr << name << '\t' << times[times.size() / 2] << " ns" << endl;
+}
+
+// a node on its own, on values computed by a graph: times its forward and
+// the backward wrt every argument
+struct NodeBench {
+  NodeBench(ComputationGraph& cg, Expression e) : node(cg.nodes[e.i]) {
+    fx_mem.resize(node->dim.size());
+    dEdf_mem.assign(node->dim.size(), 1.f);
+    fx = Tensor(node->dim, fx_mem.data());
+    dEdf = Tensor(node->dim, dEdf_mem.data());
+    for (VariableIndex a : node->args) {
+      const Tensor& x = cg.get_value(a);
+      xs.push_back(&x);
+      dEdx_mem.emplace_back(x.d.size());
+      dEdx.push_back(Tensor(x.d, dEdx_mem.back().data()));
+    }
+    node->forward(xs, fx);
+  }
+  void forward() { node->forward(xs, fx); }
+  void backward() {
+    for (unsigned i = 0; i < xs.size(); ++i)
+      node->backward(xs, fx, dEdf, i, dEdx[i]);
+  }
+
+  Node* node;
+  vector<const Tensor*> xs;
+  vector<float> fx_mem, dEdf_mem;
+  vector<vector<float>> dEdx_mem;
+  Tensor fx, dEdf;
+  vector<Tensor> dEdx;
+};
+
+vector<float> random_vector(unsigned n) {
+  vector<float> v(n);
+  for (auto& x : v) x = rand01() - 0.5f;
+  return v;
+}
+
+// the composition and hidden layers of the parser: bias + 3 matrix-vector
+// products
+void bench_affine_transform() {
+  Model m;
+  vector<Expression> args;
+  ComputationGraph cg;
+  args.push_back(parameter(cg, m.add_parameters({kHidden})));
+  for (unsigned i = 0; i < 3; ++i) {
+    args.push_back(parameter(cg, m.add_parameters({kHidden, kHidden})));
+    args.push_back(input(cg, {kHidden}, random_vector(kHidden)));
+  }
+  NodeBench b(cg, affine_transform(args));
+  bench("affine_transform/forward", [&]() { b.forward(); });
+  bench("affine_transform/backward", [&]() { b.backward(); });
+}
+
+// the parser's action distribution, restricted to the valid actions
+void bench_restricted_log_softmax() {
+  ComputationGraph cg;
+  vector<unsigned> valid;
+  for (unsigned i = 0; i < kActions; i += 2) valid.push_back(i);
+  Expression x = input(cg, {kActions}, random_vector(kActions));
+  NodeBench b(cg, log_softmax(x, valid));
+  bench("restricted_log_softmax/forward", [&]() { b.forward(); });
+  bench("restricted_log_softmax/backward", [&]() { b.backward(); });
+}
+
+// a batch of kBatch word embeddings: the gather of the rows and the scatter
+// of their gradients
+void bench_lookup() {
+  Model m;
+  LookupParameters* p = m.add_lookup_parameters(kVocab, {kInput});
+  vector<unsigned> rows(kBatch);
+  for (auto& r : rows) r = rand01() * kVocab;
+  ComputationGraph cg;
+  Expression e = lookup(cg, p, rows);
+  LookupNode* node = static_cast<LookupNode*>(cg.nodes[e.i]);
+  vector<float> v(node->dim.size()), g(node->dim.size(), 1e-6f);
+  Tensor fx(node->dim, v.data()), dEdf(node->dim, g.data());
+  bench("lookup/gather", [&]() { node->forward({}, fx); });
+  bench("lookup/scatter_add_grads", [&]() { node->accumulate_grad(dEdf); });
+}
+
+// building, and evaluating, kSteps steps of a 2 layer LSTM; per step
+void bench_lstm() {
+  Model m;
+  LSTMBuilder lstm(2, kInput, kHidden, &m);
+  vector<vector<float>> xs(kSteps);
+  for (auto& x : xs) x = random_vector(kInput);
+  bench("lstm/add_input", [&]() {
+    ComputationGraph cg;
+    lstm.new_graph(cg);
+    lstm.start_new_sequence();
+    for (auto& x : xs) lstm.add_input(input(cg, {kInput}, x));
+    cg.incremental_forward();
+  }, kSteps);
+  bench("lstm/forward_backward", [&]() {
+    ComputationGraph cg;
+    lstm.new_graph(cg);
+    lstm.start_new_sequence();
+    for (auto& x : xs) lstm.add_input(input(cg, {kInput}, x));
+    squared_norm(lstm.back());
+    cg.forward();
+    cg.backward();
+  }, kSteps);
+  m.reset_gradient();
+}
+
+// what SimpleExecutionEngine costs per node, with nodes that do next to
+// nothing: a chain of kChain sums of scalars
+void bench_engine() {
+  ComputationGraph cg;
+  Expression y = input(cg, 1.f);
+  Expression x = input(cg, 0.f);
+  for (unsigned i = 0; i < kChain; ++i) x = x + y;
+  cg.forward();
+  bench("engine/forward_per_node", [&]() { cg.forward(); }, kChain);
+  bench("engine/backward_per_node", [&]() { cg.backward(); }, kChain);
+}
+
+// one update of a model the size of the parser's LSTMs and hidden layers,
+// after a sentence of kBatch words
+template <class T>
+void bench_trainer(const string& name) {
+  Model m;
+  for (unsigned i = 0; i < 24; ++i)
+    m.add_parameters({kHidden, i % 2 ? kHidden : kInput});
+  LookupParameters* p = m.add_lookup_parameters(kVocab, {kInput});
+  vector<float> g(kInput, 1e-3f);
+  Tensor grad({kInput}, g.data());
+  T trainer(&m);
+  bench("trainer/" + name, [&]() {
+    for (unsigned i = 0; i < kBatch; ++i) p->accumulate_grad(i * 131 % kVocab, grad);
+    trainer.update(1.0);
+  });
+}
+
+// looking up kBatch words of a kVocab word vocabulary: in the std::map of
+// the parser's corpus, in the unordered_map of an unfrozen cnn::Dict, and in
+// a FrozenDict; per word
+void bench_vocab() {
+  vector<string> words(kVocab);
+  map<string, unsigned> m;
+  unordered_map<string, int> um;
+  for (unsigned i = 0; i < kVocab; ++i) {
+    words[i] = "word" + to_string(i);
+    m[words[i]] = um[words[i]] = i;
+  }
+  FrozenDict fd(words);
+  vector<string> queries(kBatch);
+  for (auto& q : queries) q = words[rand01() * kVocab];
+  unsigned sum = 0;
+  bench("vocab/map", [&]() { for (auto& q : queries) sum += m.find(q)->second; }, kBatch);
+  bench("vocab/unordered_map", [&]() { for (auto& q : queries) sum += um.find(q)->second; }, kBatch);
+  bench("vocab/frozen", [&]() { for (auto& q : queries) sum += fd.find(q); }, kBatch);
+  if (sum == 1) cerr << sum;  // keeps the lookups
+}
+
+void read_extra(const string& fname) {
+  ifstream in(fname);
+  if (!in) {
+    cerr << "Unable to open " << fname << endl;
+    abort();
+  }
+  string line;
+  while (getline(in, line)) {
+    istringstream ss(line);
+    Result r;
+    if (!(ss >> r.name >> r.unit >> r.value)) continue;
+    r.min = r.value;
+    r.iterations = 1;
+    results.push_back(r);
+  }
+}
+
+void write_json(ostream& out) {
+  out << "{\n  \"version\": 1,\n  \"results\": [";
+  for (unsigned i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit
+        << "\", \"value\": " << r.value << ", \"min\": " << r.min
+        << ", \"iterations\": " << r.iterations << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+// peak resident memory so far, in MB
+double peak_memory() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;  // ru_maxrss is in KB
+}
+
+int main(int argc, char** argv) {
+  cnn::Initialize(argc, argv);
+  // cnn zeroes its memory pools (--cnn-mem MB each) when it allocates them,
+  // so they are all resident from here on: peak_memory reports the memory
+  // the benchmarks use beyond them
+  const double pools_memory = peak_memory();
+  string out_fname;
+  vector<string> extras;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (i + 1 < argc && arg == "--min_time") min_time = atof(argv[++i]);
+    else if (i + 1 < argc && arg == "--repetitions") repetitions = max(1, atoi(argv[++i]));
+    else if (i + 1 < argc && arg == "--filter") filter = argv[++i];
+    else if (i + 1 < argc && arg == "--extra") extras.push_back(argv[++i]);
+    else if (i + 1 < argc && arg == "--out") out_fname = argv[++i];
+    else {
+      cerr << "Usage: " << argv[0] << " [--min_time seconds] [--repetitions n] [--filter name]\n"
+           << "         [--extra results.txt]... [--out results.json]\n"
+           << "results.txt has one \"name unit value\" result per line" << endl;
+      return 1;
+    }
+  }
+
+  bench_affine_transform();
+  bench_restricted_log_softmax();
+  bench_lookup();
+  bench_lstm();
+  bench_engine();
+  bench_vocab();
+  bench_trainer<SimpleSGDTrainer>("sgd");
+  bench_trainer<MomentumSGDTrainer>("momentum");
+  bench_trainer<AdagradTrainer>("adagrad");
+  bench_trainer<AdadeltaTrainer>("adadelta");
+  bench_trainer<RmsPropTrainer>("rmsprop");
+  bench_trainer<AdamTrainer>("adam");
+  if (string("bench-cnn/peak_memory").find(filter) != string::npos) {
+    const double mb = peak_memory() - pools_memory;
+    results.push_back({"bench-cnn/peak_memory", "MB", mb, mb, 1});
+  }
+  for (auto& fname : extras) read_extra(fname);
+
+  if (out_fname.empty()) {
+    write_json(cout);
+  } else {
+    ofstream out(out_fname);
+    write_json(out);
+  }
+}
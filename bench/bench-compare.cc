@@ -0,0 +1,155 @@
+// compares benchmark results (the JSON written by bench-cnn) against a
+// baseline:
+//   bench-compare [--threshold percent] [--memory_threshold percent]
+//                 [--out medians.json] baseline.json run.json...
+// the value of every benchmark is the median over the runs; a benchmark
+// regresses if its median is worse than the baseline by more than the
+// threshold (memory_threshold for peak memory), so that neither one noisy
+// nor one lucky run decides it. the change of the best run is printed
+// alongside, to tell a shifted distribution from a wider one. prints a
+// table of all of them and exits with 1 if any regressed. --out writes the medians in the
+// same format, e.g., to become the new baseline.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Result {
+  string unit;
+  vector<double> values;  // one per run
+  double median() const {
+    vector<double> v = values;
+    sort(v.begin(), v.end());
+    const unsigned n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+  }
+  double best(bool higher_is_better) const {
+    return higher_is_better ? *max_element(values.begin(), values.end())
+                            : *min_element(values.begin(), values.end());
+  }
+  // (max - min) / median, in percent
+  double spread() const {
+    auto mm = minmax_element(values.begin(), values.end());
+    return 100 * (*mm.second - *mm.first) / median();
+  }
+};
+
+// results by name, in the order they appear in
+typedef vector<pair<string, Result>> Results;
+
+Result& find(Results& results, const string& name) {
+  for (auto& r : results)
+    if (r.first == name) return r.second;
+  results.push_back({name, Result()});
+  return results.back().second;
+}
+
+// bench-cnn writes one result per line
+void read_results(const string& fname, Results& results) {
+  ifstream in(fname);
+  if (!in) {
+    cerr << "Unable to open " << fname << endl;
+    exit(2);
+  }
+  static const regex re("\"name\": \"([^\"]*)\", \"unit\": \"([^\"]*)\", \"value\": ([^,}]*)");
+  string line;
+  smatch m;
+  unsigned n = 0;
+  while (getline(in, line)) {
+    if (!regex_search(line, m, re)) continue;
+    Result& r = find(results, m[1]);
+    r.unit = m[2];
+    r.values.push_back(atof(m[3].str().c_str()));
+    ++n;
+  }
+  if (n == 0) {
+    cerr << "No results in " << fname << endl;
+    exit(2);
+  }
+}
+
+// times and memory are better lower, throughputs (units per second) higher
+bool higher_is_better(const string& unit) {
+  return unit.size() > 2 && unit.compare(unit.size() - 2, 2, "/s") == 0;
+}
+
+bool is_memory(const string& unit) { return unit == "MB"; }
+
+void write_results(const string& fname, const Results& results) {
+  ofstream out(fname);
+  out << "{\n  \"version\": 1,\n  \"results\": [";
+  for (unsigned i = 0; i < results.size(); ++i) {
+    const Result& r = results[i].second;
+    auto mm = minmax_element(r.values.begin(), r.values.end());
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << results[i].first << "\", \"unit\": \"" << r.unit
+        << "\", \"value\": " << r.median() << ", \"min\": " << *mm.first
+        << ", \"max\": " << *mm.second << ", \"runs\": " << r.values.size() << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+  double threshold = 10, memory_threshold = 5;
+  string out_fname;
+  vector<string> fnames;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (i + 1 < argc && arg == "--threshold") threshold = atof(argv[++i]);
+    else if (i + 1 < argc && arg == "--memory_threshold") memory_threshold = atof(argv[++i]);
+    else if (i + 1 < argc && arg == "--out") out_fname = argv[++i];
+    else if (arg.compare(0, 2, "--") != 0) fnames.push_back(arg);
+    else fnames.clear(), i = argc;  // unknown option
+  }
+  if (fnames.size() < 2) {
+    cerr << "Usage: " << argv[0] << " [--threshold percent] [--memory_threshold percent]\n"
+         << "         [--out medians.json] baseline.json run.json..." << endl;
+    return 2;
+  }
+  Results baseline, current;
+  read_results(fnames[0], baseline);
+  for (unsigned i = 1; i < fnames.size(); ++i) read_results(fnames[i], current);
+  if (!out_fname.empty()) write_results(out_fname, current);
+
+  printf("%-32s %18s %18s %8s %8s %8s\n", "benchmark", "baseline", "median", "spread", "change", "best");
+  unsigned regressions = 0;
+  for (auto& c : current) {
+    const Result& r = c.second;
+    const double median = r.median();
+    Result* b = nullptr;
+    for (auto& br : baseline)
+      if (br.first == c.first && br.second.unit == r.unit) b = &br.second;
+    if (!b) {
+      printf("%-32s %18s %10.5g %-7s %7.1f%% %8s %8s\n", c.first.c_str(), "-", median, r.unit.c_str(),
+             r.spread(), "new", "");
+      continue;
+    }
+    const double base = b->median();
+    const bool higher = higher_is_better(r.unit);
+    const double change = 100 * (median - base) / base;
+    const double best_change = 100 * (r.best(higher) - base) / base;
+    const double limit = is_memory(r.unit) ? memory_threshold : threshold;
+    const bool regressed = (higher ? -change : change) > limit;
+    if (regressed) ++regressions;
+    printf("%-32s %10.5g %-7s %10.5g %-7s %7.1f%% %+7.1f%% %+7.1f%%%s\n", c.first.c_str(), base,
+           b->unit.c_str(), median, r.unit.c_str(), r.spread(), change, best_change,
+           regressed ? "  REGRESSION" : "");
+  }
+  for (auto& b : baseline) {
+    bool found = false;
+    for (auto& c : current) found = found || c.first == b.first;
+    if (!found) printf("%-32s %10.5g %-7s %18s %8s %8s\n", b.first.c_str(), b.second.median(),
+                       b.second.unit.c_str(), "-", "", "missing");
+  }
+  if (regressions > 0) {
+    printf("\n%u regression(s): median more than %g%% worse (%g%% for memory) than the baseline\n",
+           regressions, threshold, memory_threshold);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+// writes a corpus of random projective dependency trees as the
+// arc-standard oracle that lstm-parse reads (-T/-d), for benchmarking:
+//   make-corpus sentences seed [max length] > oracle.txt
+// the same arguments always give the same corpus.
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const unsigned kWords = 5000;
+const unsigned kTags = 45;
+const char* kLabels[] = {"nsubj", "dobj", "det", "amod", "prep", "pobj",
+                         "punct", "advmod", "cc", "conj", "aux", "nn"};
+
+mt19937 rng;
+
+unsigned uniform(unsigned lo, unsigned hi) {  // in [lo, hi]
+  return uniform_int_distribution<unsigned>(lo, hi)(rng);
+}
+
+// heads of the words in [lo, hi] of a tree hanging from head
+void build(int lo, int hi, int head, vector<int>& heads) {
+  if (lo > hi) return;
+  const int m = uniform(lo, hi);
+  heads[m] = head;
+  build(lo, m - 1, m, heads);
+  build(m + 1, hi, m, heads);
+}
+
+// ROOT is the last token (n), as in the parser's input
+vector<string> oracle(const vector<int>& heads, const vector<string>& labels) {
+  const int n = heads.size();
+  vector<int> children(n + 1), attached(n + 1);
+  for (int d = 0; d < n; ++d) ++children[heads[d]];
+  vector<int> stack;
+  int next = 0;
+  vector<string> actions;
+  while (!(stack.size() == 1 && next > n)) {
+    if (stack.size() >= 2) {
+      const int s0 = stack.back(), s1 = stack[stack.size() - 2];
+      if (s1 != n && heads[s1] == s0 && attached[s1] == children[s1]) {
+        actions.push_back("LEFT-ARC(" + labels[s1] + ")");
+        stack.erase(stack.end() - 2);
+        ++attached[s0];
+        continue;
+      }
+      if (s0 != n && heads[s0] == s1 && attached[s0] == children[s0]) {
+        actions.push_back("RIGHT-ARC(" + labels[s0] + ")");
+        stack.pop_back();
+        ++attached[s1];
+        continue;
+      }
+    }
+    actions.push_back("SHIFT");
+    stack.push_back(next++);
+  }
+  return actions;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " sentences seed [max length]" << endl;
+    return 1;
+  }
+  const unsigned sentences = atoi(argv[1]);
+  rng.seed(atoi(argv[2]));
+  const unsigned max_length = argc > 3 ? atoi(argv[3]) : 40;
+  const unsigned num_labels = sizeof(kLabels) / sizeof(kLabels[0]);
+  for (unsigned s = 0; s < sentences; ++s) {
+    const int n = uniform(3, max_length);
+    vector<int> heads(n);
+    build(0, n - 1, n, heads);
+    vector<string> labels(n);
+    cout << "\n[][";
+    for (int i = 0; i < n; ++i) {
+      labels[i] = heads[i] == n ? "ROOT" : kLabels[uniform(0, num_labels - 1)];
+      // a Zipf-like vocabulary: most tokens are frequent words
+      const unsigned w = uniform(0, 1) ? uniform(0, 99) : uniform(0, kWords - 1);
+      cout << 'w' << w << "-T" << uniform(0, kTags - 1) << ", ";
+    }
+    cout << "ROOT-ROOT]\n";
+    for (auto& a : oracle(heads, labels)) cout << a << "\n[]\n";
+  }
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Runs the benchmarks (run-bench.sh) several times and compares the median
+# of every result against a baseline (bench-compare), failing with a table
+# of the differences if time, throughput or peak memory got worse by more
+# than a threshold. This is what "make bench-regress" runs. The medians are
+# written to bench-medians.json in the build directory; copy them over the
+# baseline to accept the current numbers.
+#
+# usage: regress.sh build-dir baseline.json [runs] [threshold %]
+#          [memory threshold %]
+# build-dir is the top-level build directory.
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 build-dir baseline.json [runs] [threshold %] [memory threshold %]" >&2
+  exit 2
+fi
+BUILD=$(readlink -f "$1")
+BASELINE=$(readlink -f "$2")
+RUNS=${3:-3}
+THRESHOLD=${4:-10}
+MEMORY_THRESHOLD=${5:-5}
+HERE=$(dirname $(readlink -f "$0"))
+
+WORK=$(mktemp -d)
+for run in $(seq "$RUNS"); do
+  echo "run $run of $RUNS" >&2
+  "$HERE/run-bench.sh" "$BUILD/bench/bench-cnn" "$BUILD/bench/make-corpus" \
+      "$BUILD/parser/lstm-parse" "$WORK/run-$run.json" 2> "$WORK/run-$run.log" ||
+    { cat "$WORK/run-$run.log" >&2; exit 2; }
+done
+"$BUILD/bench/bench-compare" --threshold "$THRESHOLD" --memory_threshold "$MEMORY_THRESHOLD" \
+    --out "$BUILD/bench-medians.json" "$BASELINE" "$WORK"/run-*.json
+STATUS=$?
+rm -rf "$WORK"
+exit $STATUS
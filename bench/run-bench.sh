@@ -0,0 +1,54 @@
+#!/bin/bash
+# Runs the microbenchmarks of the cnn library (bench-cnn) and measures the
+# training and decoding throughput of lstm-parse on a generated corpus, and
+# writes all the results as JSON. This is what "make bench" runs.
+#
+# usage: run-bench.sh path/to/bench-cnn path/to/make-corpus path/to/lstm-parse
+#          results.json [bench-cnn options]
+
+if [ $# -lt 4 ]; then
+  echo "usage: $0 bench-cnn make-corpus lstm-parse results.json [options]" >&2
+  exit 1
+fi
+BENCH=$(readlink -f "$1")
+MAKE_CORPUS=$(readlink -f "$2")
+PARSER=$(readlink -f "$3")
+OUT=$(readlink -m "$4")
+shift 4
+# training sentences are read in updates of 100
+TRAIN_SENTS=2000
+DEV_SENTS=300
+UPDATES=10
+# small explicit memory pools: cnn zeroes its three pools of --cnn-mem MB,
+# so they are resident, and the peak memory reported is what is used beyond
+# them (bench-cnn subtracts its own)
+CNN_MEM=32
+BENCH_CNN_MEM=64
+
+WORK=$(mktemp -d)
+cd "$WORK"
+"$MAKE_CORPUS" $TRAIN_SENTS 1 > train.txt
+"$MAKE_CORPUS" $DEV_SENTS 2 > dev.txt
+
+# [epoch=0 ...] update #0 (epoch 0 |time=...)	llh: 1 ppl: 1 err: 0.1	[100 sents in X ms]
+# TEST llh=0 ppl: 1 err: 0.1 uas: 0.9	[N sents in X ms]
+"$PARSER" --cnn-mem $CNN_MEM --cnn-seed 1 -T train.txt -d dev.txt -P -t --max_updates $UPDATES \
+    > /dev/null 2> parser.log
+# PEAK MEMORY: X MB
+grep -e 'update #' -e '^TEST' -e '^PEAK MEMORY' parser.log |
+  sed -e 's/.*\(update\|TEST\).*\[\([0-9]*\) sents in \([0-9.]*\) ms\].*/\1 \2 \3/' \
+      -e 's/^PEAK MEMORY: \([0-9.]*\) MB/peak \1/' |
+  awk -v pools=$((3 * CNN_MEM)) '$1 == "update" { n += $2; ms += $3 }
+       $1 == "TEST" { dn = $2; dms = $3 }
+       $1 == "peak" { mb = $2 }
+       END { if (ms > 0) printf "parser/train sents/s %.2f\n", n * 1000 / ms;
+             if (dms > 0) printf "parser/decode sents/s %.2f\n", dn * 1000 / dms;
+             if (mb > 0) printf "parser/peak_memory MB %.1f\n", mb - pools }' > parser.txt
+if [ $(wc -l < parser.txt) -ne 3 ]; then
+  echo "lstm-parse failed, see $WORK/parser.log" >&2
+  exit 1
+fi
+
+"$BENCH" --cnn-mem $BENCH_CNN_MEM --extra parser.txt --out "$OUT" "$@" || exit 1
+echo "Wrote $OUT" >&2
+rm -rf "$WORK"
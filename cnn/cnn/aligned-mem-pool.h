@@ -12,6 +12,9 @@ class AlignedMemoryPool {
     sys_alloc(cap);
     zero_all();
   }
+  AlignedMemoryPool(const AlignedMemoryPool&) = delete;
+  AlignedMemoryPool& operator=(const AlignedMemoryPool&) = delete;
+  ~AlignedMemoryPool() { a->free(mem); }
 
   void* allocate(size_t n) {
     auto rounded_n = a->round_up_align(n);
@@ -0,0 +1,168 @@
+#include "cnn/bilstm-encoder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "cnn/nodes.h"
+
+using namespace std;
+using namespace cnn::expr;
+
+namespace cnn {
+
+// same layout as LSTMBuilder::params
+enum { X2I, H2I, C2I, BI, X2O, H2O, C2O, BO, X2C, H2C, BC };
+
+// ConcatenateColumns takes a bounded number of arguments, so the input
+// projections are hoisted over blocks of at most this many positions
+static const unsigned kMaxHoistedSteps = 256;
+
+BiLSTMEncoder::BiLSTMEncoder(unsigned layers,
+                             unsigned input_dim,
+                             unsigned hidden_dim,
+                             Model* model) :
+    fwd(layers, input_dim, hidden_dim, model),
+    bwd(layers, input_dim, hidden_dim, model),
+    pcg(nullptr), layers(layers), input_dim(input_dim), hidden_dim(hidden_dim),
+    batch(1), dropout_rate(0.f) {}
+
+void BiLSTMEncoder::new_graph(ComputationGraph& cg) {
+  pcg = &cg;
+  fwd.new_graph(cg);
+  bwd.new_graph(cg);
+}
+
+vector<Expression> BiLSTMEncoder::transduce(const vector<Expression>& xs) {
+  encode(xs);
+  vector<Expression> res(fh.size());
+  for (unsigned t = 0; t < res.size(); ++t)
+    res[t] = concatenate({fh[t], bh[t]});
+  return res;
+}
+
+vector<Expression> BiLSTMEncoder::transduce(const vector<vector<Expression>>& sents) {
+  encode(sents);
+  vector<Expression> res(fh.size());
+  for (unsigned t = 0; t < res.size(); ++t)
+    res[t] = concatenate({fh[t], bh[t]});
+  return res;
+}
+
+void BiLSTMEncoder::encode(const vector<Expression>& xs) {
+  assert(pcg);
+  assert(xs.size() > 0);
+  batch = 1;
+  vector<Expression> rxs(xs.rbegin(), xs.rend());
+  fh = run(fwd, xs, vector<Expression>());
+  bh = run(bwd, rxs, vector<Expression>());
+  reverse(bh.begin(), bh.end());
+}
+
+void BiLSTMEncoder::encode(const vector<vector<Expression>>& sents) {
+  assert(pcg);
+  assert(sents.size() > 0);
+  if (sents.size() == 1) {
+    encode(sents[0]);
+    return;
+  }
+  batch = sents.size();
+  unsigned slen = 0;
+  for (auto& s : sents) slen = max<unsigned>(slen, s.size());
+  assert(slen > 0);
+
+  // steps[t] has the t'th input of every sentence as its columns. the
+  // backward LSTM reads the padding first, so its states are reset to zero
+  // (the state of an empty prefix) until each sentence really begins
+  Expression pad = zeroes(*pcg, {input_dim});
+  vector<Expression> steps(slen), masks(slen);
+  vector<Expression> cols(batch);
+  for (unsigned t = 0; t < slen; ++t) {
+    bool padded = false;
+    for (unsigned b = 0; b < batch; ++b) {
+      if (t < sents[b].size()) {
+        cols[b] = sents[b][t];
+      } else {
+        cols[b] = pad;
+        padded = true;
+      }
+    }
+    steps[t] = concatenate_many_cols(cols);
+    if (padded) {
+      vector<float> m(hidden_dim * batch, 0.f);
+      for (unsigned b = 0; b < batch; ++b)
+        if (t < sents[b].size())
+          fill(m.begin() + b * hidden_dim, m.begin() + (b + 1) * hidden_dim, 1.f);
+      masks[t] = input(*pcg, {hidden_dim, batch}, m);
+    }
+  }
+  vector<Expression> rsteps(steps.rbegin(), steps.rend());
+  vector<Expression> rmasks(masks.rbegin(), masks.rend());
+  fh = run(fwd, steps, vector<Expression>());
+  bh = run(bwd, rsteps, rmasks);
+  reverse(bh.begin(), bh.end());
+}
+
+vector<Expression> BiLSTMEncoder::run(LSTMBuilder& b,
+                                      const vector<Expression>& steps,
+                                      const vector<Expression>& masks) {
+  assert(b.param_vars.size() == layers);
+  vector<Expression> in = steps;
+  for (unsigned i = 0; i < layers; ++i)
+    in = run_layer(b.param_vars[i], in, masks, i + 1 == layers);
+  return in;
+}
+
+// the same recurrence as LSTMBuilder::add_input_impl
+vector<Expression> BiLSTMEncoder::run_layer(const vector<Expression>& vars,
+                                            const vector<Expression>& steps,
+                                            const vector<Expression>& masks,
+                                            bool top) {
+  const unsigned slen = steps.size();
+  vector<Expression> ait(slen), awt(slen), aot(slen);
+  // input projections of all positions: one product per gate and block
+  vector<unsigned> cols(batch);
+  for (unsigned start = 0; start < slen; start += kMaxHoistedSteps) {
+    const unsigned end = min(slen, start + kMaxHoistedSteps);
+    Expression x = concatenate_cols(vector<Expression>(steps.begin() + start, steps.begin() + end));
+    // apply dropout according to http://arxiv.org/pdf/1409.2329v5.pdf
+    if (dropout_rate) x = dropout(x, dropout_rate);
+    Expression ai = colwise_add(vars[X2I] * x, vars[BI]);
+    Expression aw = colwise_add(vars[X2C] * x, vars[BC]);
+    Expression ao = colwise_add(vars[X2O] * x, vars[BO]);
+    for (unsigned t = start; t < end; ++t) {
+      for (unsigned b = 0; b < batch; ++b) cols[b] = (t - start) * batch + b;
+      ait[t] = select_cols(ai, cols);
+      awt[t] = select_cols(aw, cols);
+      aot[t] = select_cols(ao, cols);
+    }
+  }
+
+  vector<Expression> h(slen);
+  Expression h_tm1, c_tm1;
+  for (unsigned t = 0; t < slen; ++t) {
+    Expression ct;
+    if (t == 0) {
+      ct = cwise_multiply(logistic(ait[t]), tanh(awt[t]));
+      aot[t] = affine_transform({aot[t], vars[C2O], ct});
+    } else {
+      Expression it = logistic(affine_transform({ait[t], vars[H2I], h_tm1, vars[C2I], c_tm1}));
+      Expression ft = 1.f - it;
+      Expression wt = tanh(affine_transform({awt[t], vars[H2C], h_tm1}));
+      ct = cwise_multiply(ft, c_tm1) + cwise_multiply(it, wt);
+      aot[t] = affine_transform({aot[t], vars[H2O], h_tm1, vars[C2O], ct});
+    }
+    Expression ht = cwise_multiply(logistic(aot[t]), tanh(ct));
+    if (!masks.empty() && masks[t].pg) {
+      ht = cwise_multiply(ht, masks[t]);
+      ct = cwise_multiply(ct, masks[t]);
+    }
+    h[t] = h_tm1 = ht;
+    c_tm1 = ct;
+  }
+  if (top && dropout_rate)
+    for (auto& ht : h) ht = dropout(ht, dropout_rate);
+  return h;
+}
+
+} // namespace cnn
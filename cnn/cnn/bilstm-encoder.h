@@ -0,0 +1,83 @@
+#ifndef CNN_BILSTM_ENCODER_H_
+#define CNN_BILSTM_ENCODER_H_
+
+#include <vector>
+
+#include "cnn/cnn.h"
+#include "cnn/expr.h"
+#include "cnn/lstm.h"
+
+using namespace cnn::expr;
+
+namespace cnn {
+
+class Model;
+
+// reads a whole sentence (or a padded minibatch of sentences) with a forward
+// and a backward LSTM and returns the concatenated states of each position.
+//
+// the parameters are those of two LSTMBuilders (forward first), so models
+// built with a hand-rolled pair of builders can be read back. the
+// recurrence is the same as LSTMBuilder's, but it is computed one layer at a
+// time: the input projections of a layer are done for all positions at once
+// with a single matrix product, and the sentences of a minibatch share every
+// recurrent step (their states are the columns of one matrix).
+struct BiLSTMEncoder {
+  BiLSTMEncoder() = default;
+  explicit BiLSTMEncoder(unsigned layers,
+                         unsigned input_dim,
+                         unsigned hidden_dim,
+                         Model* model);
+
+  // call this when working with a newly created ComputationGraph
+  void new_graph(ComputationGraph& cg);
+
+  // returns [forward; backward] for each position of xs
+  std::vector<Expression> transduce(const std::vector<Expression>& xs);
+  // sents[b][t] is the t'th input of the b'th sentence. returns one
+  // {2 * hidden_dim, sents.size()} matrix per position of the longest
+  // sentence; column b holds the states of sentence b (columns of the
+  // sentences that have ended are padding)
+  std::vector<Expression> transduce(const std::vector<std::vector<Expression>>& sents);
+
+  // runs both directions without concatenating the states. the states are
+  // available from forward_states() and backward_states()
+  void encode(const std::vector<Expression>& xs);
+  void encode(const std::vector<std::vector<Expression>>& sents);
+
+  // output of the last layer at each position, from the last call to
+  // encode/transduce
+  const std::vector<Expression>& forward_states() const { return fh; }
+  const std::vector<Expression>& backward_states() const { return bh; }
+  // summaries of the whole sentence (single sentence only)
+  Expression final_forward() const { return fh.back(); }
+  Expression final_backward() const { return bh.front(); }
+
+  void set_dropout(float d) { dropout_rate = d; }
+  // in general, you should disable dropout at test time
+  void disable_dropout() { dropout_rate = 0; }
+
+  LSTMBuilder fwd;
+  LSTMBuilder bwd;
+
+ private:
+  std::vector<Expression> run(LSTMBuilder& b,
+                              const std::vector<Expression>& steps,
+                              const std::vector<Expression>& masks);
+  std::vector<Expression> run_layer(const std::vector<Expression>& vars,
+                                    const std::vector<Expression>& steps,
+                                    const std::vector<Expression>& masks,
+                                    bool top);
+
+  ComputationGraph* pcg = nullptr;
+  std::vector<Expression> fh, bh;
+  unsigned layers = 0;
+  unsigned input_dim = 0;
+  unsigned hidden_dim = 0;
+  unsigned batch = 1;
+  float dropout_rate = 0.f;
+};
+
+} // namespace cnn
+
+#endif
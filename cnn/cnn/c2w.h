@@ -1,59 +1,144 @@
 #ifndef CNN_C2W_H_
 #define CNN_C2W_H_
 
+#include <cassert>
+#include <list>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include "cnn/cnn.h"
 #include "cnn/model.h"
-#include "cnn/lstm.h"
+#include "cnn/expr.h"
+#include "cnn/bilstm-encoder.h"
 
 namespace cnn {
 
 // computes a representation of a word by reading characters
 // one at a time
+//
+// representations are shared by all occurrences of a word type in a graph.
+// in graphs built for inference they are also cached across graphs (up to
+// max_cached_words word types, least recently used ones are dropped), since
+// they only change when the parameters do. the cache is dropped when a graph
+// that is not for inference is built and whenever the model's version()
+// changes (a trainer update, a load); call clear_cache() if the parameters
+// are changed some other way.
 struct C2WBuilder {
-  LSTMBuilder fc2w;
-  LSTMBuilder rc2w;
+  BiLSTMEncoder c2w;
   LookupParameters* p_lookup;
-  std::vector<VariableIndex> words;
-  std::map<int, VariableIndex> wordid2vi;
   explicit C2WBuilder(int vocab_size,
                       unsigned layers,
                       unsigned input_dim,
                       unsigned hidden_dim,
-                      Model* m) :
-      fc2w(layers, input_dim, hidden_dim, m),
-      rc2w(layers, input_dim, hidden_dim, m),
-      p_lookup(m->add_lookup_parameters(vocab_size, {input_dim})) {
+                      Model* m,
+                      unsigned max_cached_words = 100000) :
+      c2w(layers, input_dim, hidden_dim, m),
+      p_lookup(m->add_lookup_parameters(vocab_size, {input_dim})),
+      model(m), pcg(nullptr), inference(false), rep_dim(hidden_dim * 2),
+      max_cached_words(max_cached_words), cache_version(m->version()) {
   }
-  void new_graph(ComputationGraph* cg) {
-    words.clear();
-    fc2w.new_graph(cg);
-    rc2w.new_graph(cg);
+  void new_graph(ComputationGraph& cg, bool inference = false) {
+    pcg = &cg;
+    this->inference = inference;
+    if (!inference || model->version() != cache_version) clear_cache();
+    wordid2vi.clear();
+    c2w.new_graph(cg);
   }
   // compute a composed representation of a word out of characters
-  // wordid should be a unique index for each word *type* in the graph being built
-  VariableIndex add_word(int word_id, const std::vector<int>& chars, ComputationGraph* cg) {
-    auto it = wordid2vi.find(word_id);
-    if (it == wordid2vi.end()) {
-      fc2w.start_new_sequence(cg);
-      rc2w.start_new_sequence(cg);
-      std::vector<VariableIndex> ins(chars.size());
-      std::map<int, VariableIndex> c2i;
-      for (unsigned i = 0; i < ins.size(); ++i) {
-        VariableIndex& v = c2i[chars[i]];
-        if (!v) v = cg->add_lookup(p_lookup, chars[i]);
-        ins[i] = v;
-        fc2w.add_input(v, cg);
+  // wordid should be a unique index for each word *type*
+  expr::Expression add_word(int word_id, const std::vector<int>& chars) {
+    return add_words({word_id}, {chars})[0];
+  }
+  // the same for several words. the words that are neither in the graph nor
+  // in the cache are read by the character LSTMs as one minibatch
+  std::vector<expr::Expression> add_words(const std::vector<int>& word_ids,
+                                          const std::vector<std::vector<int>>& chars) {
+    assert(word_ids.size() == chars.size());
+    std::vector<unsigned> unseen;  // positions in word_ids
+    for (unsigned i = 0; i < word_ids.size(); ++i) {
+      const int word_id = word_ids[i];
+      if (wordid2vi.count(word_id)) continue;
+      auto it = cache.find(word_id);
+      if (inference && it != cache.end()) {
+        lru.splice(lru.begin(), lru, it->second.pos);
+        wordid2vi[word_id] = expr::input(*pcg, {rep_dim}, it->second.rep);
+        continue;
       }
-      for (int i = ins.size() - 1; i >= 0; --i)
-        rc2w.add_input(ins[i], cg);
-      VariableIndex i_concat = cg->add_function<Concatenate>({fc2w.back(), rc2w.back()});
-      it = wordid2vi.insert(std::make_pair(word_id, i_concat)).first;
+      // placeholder so repeated words are only read once
+      wordid2vi[word_id] = expr::Expression();
+      unseen.push_back(i);
     }
-    return it->second;
+    if (unseen.size() > 0) read_words(word_ids, chars, unseen);
+    std::vector<expr::Expression> res(word_ids.size());
+    for (unsigned i = 0; i < word_ids.size(); ++i)
+      res[i] = wordid2vi[word_ids[i]];
+    return res;
+  }
+  void clear_cache() {
+    cache.clear();
+    lru.clear();
+    cache_version = model->version();
   }
+  unsigned cache_size() const { return cache.size(); }
+
+ private:
+  void read_words(const std::vector<int>& word_ids,
+                  const std::vector<std::vector<int>>& chars,
+                  const std::vector<unsigned>& unseen) {
+    std::vector<std::vector<expr::Expression>> ins(unseen.size());
+    std::map<int, expr::Expression> c2i;
+    for (unsigned k = 0; k < unseen.size(); ++k) {
+      const std::vector<int>& cs = chars[unseen[k]];
+      assert(cs.size() > 0);
+      for (int c : cs) {
+        expr::Expression& v = c2i[c];
+        if (!v.pg) v = expr::lookup(*pcg, p_lookup, c);
+        ins[k].push_back(v);
+      }
+    }
+    c2w.encode(ins);
+    const std::vector<expr::Expression>& fh = c2w.forward_states();
+    const std::vector<expr::Expression>& bh = c2w.backward_states();
+    for (unsigned k = 0; k < unseen.size(); ++k) {
+      expr::Expression rep;
+      if (unseen.size() == 1) {
+        rep = expr::concatenate({c2w.final_forward(), c2w.final_backward()});
+      } else {
+        // column k holds the states of the k'th word
+        const std::vector<unsigned> col = {k};
+        rep = expr::concatenate({expr::select_cols(fh[ins[k].size() - 1], col),
+                                 expr::select_cols(bh[0], col)});
+      }
+      const int word_id = word_ids[unseen[k]];
+      wordid2vi[word_id] = rep;
+      if (inference && max_cached_words > 0) cache_word(word_id, as_vector(rep.value()));
+    }
+  }
+  void cache_word(int word_id, const std::vector<float>& rep) {
+    if (cache.size() >= max_cached_words) {
+      cache.erase(lru.back());
+      lru.pop_back();
+    }
+    lru.push_front(word_id);
+    CachedWord& w = cache[word_id];
+    w.rep = rep;
+    w.pos = lru.begin();
+  }
+
+  struct CachedWord {
+    std::vector<float> rep;
+    std::list<int>::iterator pos;  // position in lru
+  };
+  const Model* model;
+  ComputationGraph* pcg;
+  bool inference;
+  unsigned rep_dim;
+  unsigned max_cached_words;
+  unsigned cache_version;  // model->version() the cache was computed with
+  std::unordered_map<int, expr::Expression> wordid2vi;  // this graph
+  std::unordered_map<int, CachedWord> cache;  // across graphs
+  std::list<int> lru;  // most recently used first
 };
 
 } // namespace cnn
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
 
 using namespace std;
 
@@ -12,6 +13,18 @@ using namespace expr;
 inline bool is_ws(char x) { return (x == ' ' || x == '\t'); }
 inline bool not_ws(char x) { return (x != ' ' && x != '\t'); }
 
+Expression FactoredSoftmaxBuilder::as_columns(const Expression& reps) {
+  const Dim& d = reps.pg->nodes[reps.i]->dim;
+  if (d.bd == 1) return reps;
+  assert(d.ndims() == 1);
+  return reshape(reps, Dim({d.rows(), d.bd}));
+}
+
+Expression FactoredSoftmaxBuilder::as_batch(const Expression& cols) {
+  const Dim& d = cols.pg->nodes[cols.i]->dim;
+  return reshape(cols, Dim({d.rows()}, d.cols()));
+}
+
 NonFactoredSoftmaxBuilder::NonFactoredSoftmaxBuilder(unsigned rep_dim, unsigned vocab_size, Model* model) {
   p_w = model->add_parameters({vocab_size, rep_dim});
   p_b = model->add_parameters({vocab_size});
@@ -27,6 +40,11 @@ Expression NonFactoredSoftmaxBuilder::neg_log_softmax(const Expression& rep, uns
   return pickneglogsoftmax(affine_transform({b, w, rep}), wordidx);
 }
 
+Expression NonFactoredSoftmaxBuilder::neg_log_softmax(const Expression& reps, const vector<unsigned>& wordidxs) {
+  Expression scores = affine_transform({b, w, as_batch(as_columns(reps))});
+  return sum_batches(pickneglogsoftmax(scores, wordidxs));
+}
+
 unsigned NonFactoredSoftmaxBuilder::sample(const expr::Expression& rep) {
   softmax(affine_transform({b, w, rep}));
   vector<float> dist = as_vector(pcg->incremental_forward());
@@ -92,6 +110,34 @@ Expression ClassFactoredSoftmaxBuilder::neg_log_softmax(const Expression& rep, u
   return cnlp + wnlp;
 }
 
+Expression ClassFactoredSoftmaxBuilder::neg_log_softmax(const Expression& reps, const vector<unsigned>& wordidxs) {
+  Expression cols = as_columns(reps);
+  Expression batch = as_batch(cols);
+  vector<unsigned> clusters(wordidxs.size());
+  // the columns of the words in each (non-singleton) cluster, and their rows
+  // in it
+  map<unsigned, pair<vector<unsigned>, vector<unsigned>>> members;
+  for (unsigned i = 0; i < wordidxs.size(); ++i) {
+    int clusteridx = widx2cidx[wordidxs[i]];
+    assert(clusteridx >= 0);  // if this fails, wordid is missing from clusters
+    clusters[i] = clusteridx;
+    if (singleton_cluster[clusteridx]) continue;
+    auto& m = members[clusteridx];
+    m.first.push_back(i);
+    m.second.push_back(widx2cwidx[wordidxs[i]]);
+  }
+  Expression cscores = affine_transform({cbias, r2c, batch});
+  vector<Expression> nlps = {sum_batches(pickneglogsoftmax(cscores, clusters))};
+  // gather the reps of each cluster's words, to score them all at once
+  for (auto& m : members) {
+    const vector<unsigned>& which = m.second.first;
+    Expression x = which.size() == wordidxs.size() ? batch : as_batch(select_cols(cols, which));
+    Expression wscores = affine_transform({get_rc2wbias(m.first), get_rc2w(m.first), x});
+    nlps.push_back(sum_batches(pickneglogsoftmax(wscores, m.second.second)));
+  }
+  return sum(nlps);
+}
+
 unsigned ClassFactoredSoftmaxBuilder::sample(const expr::Expression& rep) {
   // TODO assert that new_graph has been called
   Expression cscores = affine_transform({cbias, r2c, rep});
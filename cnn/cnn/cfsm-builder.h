@@ -19,8 +19,22 @@ public:
   // -log(p(c | rep) * p(w | c, rep))
   virtual expr::Expression neg_log_softmax(const expr::Expression& rep, unsigned wordidx) = 0;
 
+  // the sum of -log p(w | rep) over a batch: reps is a {rep_dim, B} matrix,
+  // one rep per column (reshape a mini-batch into one), and wordidxs the B
+  // words. computes the same losses as calling the above B times, but with
+  // one matrix product per class
+  virtual expr::Expression neg_log_softmax(const expr::Expression& reps,
+                                           const std::vector<unsigned>& wordidxs) = 0;
+
   // samples a word from p(w,c | rep)
   virtual unsigned sample(const expr::Expression& rep) = 0;
+
+ protected:
+  // reps as a {rep_dim, B} matrix, whether it is one or a mini-batch of B
+  // vectors
+  static expr::Expression as_columns(const expr::Expression& reps);
+  // the columns of a {rep_dim, B} matrix as a mini-batch of B vectors
+  static expr::Expression as_batch(const expr::Expression& cols);
 };
 
 class NonFactoredSoftmaxBuilder : public FactoredSoftmaxBuilder {
@@ -28,6 +42,7 @@ public:
   NonFactoredSoftmaxBuilder(unsigned rep_dim, unsigned vocab_size, Model* model);
   void new_graph(ComputationGraph& cg);
   expr::Expression neg_log_softmax(const expr::Expression& rep, unsigned wordidx);
+  expr::Expression neg_log_softmax(const expr::Expression& reps, const std::vector<unsigned>& wordidxs);
   unsigned sample(const expr::Expression& rep);
 private:
   Parameters* p_w;
@@ -49,6 +64,7 @@ class ClassFactoredSoftmaxBuilder : public FactoredSoftmaxBuilder {
 
   void new_graph(ComputationGraph& cg);
   expr::Expression neg_log_softmax(const expr::Expression& rep, unsigned wordidx);
+  expr::Expression neg_log_softmax(const expr::Expression& reps, const std::vector<unsigned>& wordidxs);
   unsigned sample(const expr::Expression& rep);
 
  private:
@@ -1,4 +1,5 @@
 #include "cnn/cnn.h"
+#include "cnn/context.h"
 #include "cnn/exec.h"
 #include "cnn/nodes.h"
 #include "cnn/param-nodes.h"
@@ -13,7 +14,6 @@ namespace cnn {
 float* kSCALAR_MINUSONE;
 float* kSCALAR_ONE;
 float* kSCALAR_ZERO;
-int n_hgs = 0;
 
 Node::~Node() {}
 size_t Node::aux_storage_size() const { return 0; }
@@ -57,18 +57,22 @@ void Node::backward(const std::vector<const Tensor*>& xs,
 }
 
 ComputationGraph::ComputationGraph() :
-  ee(new SimpleExecutionEngine(*this)) {
-  ++n_hgs;
-  if (n_hgs > 1) {
-    cerr << "Memory allocator assumes only a single ComputationGraph at a time.\n";
-    throw std::runtime_error("Attempted to create >1 CG");
+  ComputationGraph(thread_context()) {}
+
+ComputationGraph::ComputationGraph(ExecutionContext& context) :
+  context(&context), ee(nullptr) {
+  if (context.graphs > 0) {
+    cerr << "Memory allocator assumes only a single ComputationGraph per ExecutionContext at a time.\n";
+    throw std::runtime_error("Attempted to create >1 CG in an ExecutionContext");
   }
+  ++context.graphs;
+  ee = new SimpleExecutionEngine(*this);
 }
 
 ComputationGraph::~ComputationGraph() {
   this->clear();
   delete ee;
-  --n_hgs;
+  --context->graphs;
 }
 
 void ComputationGraph::clear() {
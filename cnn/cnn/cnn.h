@@ -41,6 +41,7 @@ extern float* kSCALAR_ZERO;
 extern Device* default_device; // where parameters go by default
 
 class ExecutionEngine;
+struct ExecutionContext;
 struct ParameterNodeBase;
 struct Node;
 namespace expr { struct Expression; }
@@ -53,7 +54,10 @@ inline void swap(VariableIndex& i1, VariableIndex& i2) {
 }
 
 struct ComputationGraph {
+  // the graph is evaluated in thread_context() (usually default_context)
   ComputationGraph();
+  // the graph is evaluated in context, which must outlive it
+  explicit ComputationGraph(ExecutionContext& context);
   ~ComputationGraph();
 
   // INPUTS
@@ -118,6 +122,7 @@ struct ComputationGraph {
   std::vector<Node*> nodes;       // **stored in topological order**
   std::vector<VariableIndex> parameter_nodes; // nodes that contain parameters that can be updated (subset of nodes)
 
+  ExecutionContext* context;  // memory and random numbers of the evaluation
   ExecutionEngine* ee;  // handles the execution
  private:
   void set_dim_for_new_node(const VariableIndex& i);
@@ -0,0 +1,49 @@
+#include "cnn/context.h"
+
+using namespace std;
+
+namespace cnn {
+
+ExecutionContext* default_context = nullptr;
+
+static thread_local ExecutionContext* current_context = nullptr;
+
+ExecutionContext& thread_context() {
+  return current_context ? *current_context : *default_context;
+}
+
+void set_thread_context(ExecutionContext* context) {
+  current_context = context;
+}
+
+ExecutionContext::ExecutionContext(unsigned long mb, Device* device) :
+    device(device),
+    kSCALAR_MINUSONE(device->kSCALAR_MINUSONE),
+    kSCALAR_ONE(device->kSCALAR_ONE),
+    kSCALAR_ZERO(device->kSCALAR_ZERO),
+    graphs(0), owns_pools(true) {
+  const size_t byte_count = (size_t)mb << 20;
+  fxs = new AlignedMemoryPool(byte_count, device->mem);
+  dEdfs = new AlignedMemoryPool(byte_count, device->mem);
+}
+
+ExecutionContext::ExecutionContext(Device* device, AlignedMemoryPool* fxs, AlignedMemoryPool* dEdfs) :
+    device(device), fxs(fxs), dEdfs(dEdfs),
+    kSCALAR_MINUSONE(device->kSCALAR_MINUSONE),
+    kSCALAR_ONE(device->kSCALAR_ONE),
+    kSCALAR_ZERO(device->kSCALAR_ZERO),
+    graphs(0), owns_pools(false) {}
+
+ExecutionContext::~ExecutionContext() {
+  assert(graphs == 0);
+  if (owns_pools) {
+    delete fxs;
+    delete dEdfs;
+  }
+}
+
+void ExecutionContext::set_random_engine(uint64_t seed, uint64_t stream) {
+  rng.reset(new RandomEngine(seed, stream));
+}
+
+} // namespace cnn
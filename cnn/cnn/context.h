@@ -0,0 +1,57 @@
+#ifndef CNN_CONTEXT_H_
+#define CNN_CONTEXT_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "cnn/cnn.h"
+#include "cnn/random.h"
+
+namespace cnn {
+
+// what a ComputationGraph is evaluated with: the pools for the values of its
+// nodes (and their auxiliary memory) and for their gradients, the scalar
+// constants of the device, and optionally a random number engine of its own
+// for the nodes that draw (e.g., dropout).
+//
+// a context is used by one graph at a time, but graphs in different
+// contexts can exist, and be evaluated by different threads, at once.
+// default_context uses the pools of the default device (the globals fxs
+// and dEdfs), and is what graphs use unless they are given another one or
+// their thread was (see set_thread_context).
+struct ExecutionContext {
+  // a context with pools of its own of mb megabytes each, on device
+  explicit ExecutionContext(unsigned long mb, Device* device = default_device);
+  // a context using pools owned by someone else
+  ExecutionContext(Device* device, AlignedMemoryPool* fxs, AlignedMemoryPool* dEdfs);
+  ExecutionContext(const ExecutionContext&) = delete;
+  ExecutionContext& operator=(const ExecutionContext&) = delete;
+  ~ExecutionContext();
+
+  // nodes evaluated in this context draw from an engine seeded with seed
+  // and stream, rather than from thread_rng() of the evaluating thread
+  void set_random_engine(uint64_t seed, uint64_t stream = 0);
+
+  Device* device;
+  AlignedMemoryPool* fxs;  // node values and auxiliary memory
+  AlignedMemoryPool* dEdfs;  // node gradients
+  float* kSCALAR_MINUSONE;
+  float* kSCALAR_ONE;
+  float* kSCALAR_ZERO;
+  std::unique_ptr<RandomEngine> rng;  // null: thread_rng()
+  unsigned graphs;  // graphs using this context
+
+ private:
+  bool owns_pools;
+};
+
+extern ExecutionContext* default_context;  // set by Initialize
+
+// the context of the graphs created with ComputationGraph() on the calling
+// thread: default_context unless set_thread_context gave it another
+ExecutionContext& thread_context();
+void set_thread_context(ExecutionContext* context);  // null: default_context
+
+} // namespace cnn
+
+#endif
@@ -16,6 +16,8 @@
 #include <boost/serialization/unordered_map.hpp>
 #endif
 
+#include "cnn/frozen-dict.h"
+
 namespace cnn {
 
 class Dict {
@@ -27,25 +29,34 @@ public:
   inline unsigned size() const { return words_.size(); }
 
   inline bool Contains(const std::string& words) {
+    if (frozen) return index_.find(words) >= 0;
     return !(d_.find(words) == d_.end());
   }
 
-  void Freeze() { frozen = true; }
+  // once frozen, words are looked up in a perfect hash of words_ instead of
+  // d_, which is freed
+  void Freeze() {
+    frozen = true;
+    index_ = FrozenDict(words_);
+    Map().swap(d_);
+  }
   bool is_frozen() { return frozen; }
 
   inline int Convert(const std::string& word) {
+    if (frozen) {
+      int id = index_.find(word);
+      if (id >= 0) return id;
+      if (map_unk) {
+        return unk_id;
+      }
+      else {
+        std::cerr << map_unk << std::endl;
+        std::cerr << "Unknown word encountered: " << word << std::endl;
+        throw std::runtime_error("Unknown word encountered in frozen dictionary: " + word);
+      }
+    }
     auto i = d_.find(word);
     if (i == d_.end()) {
-      if (frozen) {
-        if (map_unk) {
-          return unk_id;
-        }
-        else {
-         std::cerr << map_unk << std::endl;
-          std::cerr << "Unknown word encountered: " << word << std::endl;
-          throw std::runtime_error("Unknown word encountered in frozen dictionary: " + word);
-        }
-      }
       words_.push_back(word);
       return d_[word] = words_.size() - 1;
     } else {
@@ -64,32 +75,44 @@ public:
     if (map_unk)
       throw std::runtime_error("Set UNK more than one time");
   
-    // temporarily unfrozen the dictionary to allow the add of the UNK
-    frozen = false;
-    unk_id = Convert(word);
-    frozen = true;
+    unk_id = index_.find(word);
+    if (unk_id < 0) {
+      words_.push_back(word);
+      unk_id = words_.size() - 1;
+      index_ = FrozenDict(words_);
+    }
   
     map_unk = true;
   }
   
-  void clear() { words_.clear(); d_.clear(); }
+  void clear() { words_.clear(); d_.clear(); index_ = FrozenDict(); }
 
 private:
   bool frozen;
   bool map_unk; // if true, map unknown word to unk_id
   int unk_id; 
   std::vector<std::string> words_;
-  Map d_;
+  Map d_;  // empty once frozen
+  FrozenDict index_;  // only when frozen
 
   friend class boost::serialization::access;
 #if BOOST_VERSION >= 105600
-  template<class Archive> void serialize(Archive& ar, const unsigned int) {
+  template<class Archive> void save(Archive& ar, const unsigned int) const {
+    ar & frozen;
+    ar & map_unk;
+    ar & unk_id;
+    ar & words_;
+    ar & d_;
+  }
+  template<class Archive> void load(Archive& ar, const unsigned int) {
     ar & frozen;
     ar & map_unk;
     ar & unk_id;
     ar & words_;
     ar & d_;
+    if (frozen) Freeze();
   }
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
 #else
   template<class Archive> void serialize(Archive& ar, const unsigned int) {
     throw std::invalid_argument("Serializing dictionaries is only supported on versions of boost 1.56 or higher");
@@ -1,5 +1,6 @@
 #include "cnn/exec.h"
 
+#include "cnn/context.h"
 #include "cnn/param-nodes.h"
 
 using namespace std;
@@ -39,10 +40,11 @@ const Tensor& SimpleExecutionEngine::incremental_forward(VariableIndex i) {
   assert(i < cg.nodes.size());
 
   // free any old memory if this is a new CG
-  if (num_nodes_evaluated == 0) fxs->free();
+  if (num_nodes_evaluated == 0) ctx.fxs->free();
 
   if (i >= num_nodes_evaluated) {
     nfxs.resize(i + 1);
+    ScopedThreadRng rng(ctx.rng.get());
 
     //vector<string> dummy(5, "x");
     vector<const Tensor*> xs(16);
@@ -55,7 +57,7 @@ const Tensor& SimpleExecutionEngine::incremental_forward(VariableIndex i) {
         ++ai;
       }
       nfxs[num_nodes_evaluated].d = node->dim;
-      nfxs[num_nodes_evaluated].v = static_cast<float*>(fxs->allocate(node->dim.size() * sizeof(float)));
+      nfxs[num_nodes_evaluated].v = static_cast<float*>(ctx.fxs->allocate(node->dim.size() * sizeof(float)));
       if (nfxs[num_nodes_evaluated].v == nullptr) {
         cerr << "out of memory\n";
         abort();
@@ -63,7 +65,7 @@ const Tensor& SimpleExecutionEngine::incremental_forward(VariableIndex i) {
       void* aux_mem = nullptr;
       size_t aux_size = node->aux_storage_size();
       if (aux_size) {
-        aux_mem = fxs->allocate(aux_size);
+        aux_mem = ctx.fxs->allocate(aux_size);
         if (!aux_mem) {
           cerr << "aux out of memory\n";
           abort();
@@ -92,19 +94,19 @@ void SimpleExecutionEngine::backward(VariableIndex from_where) {
 
   const unsigned num_nodes = from_where+1;
   ndEdfs.resize(num_nodes);
-  dEdfs->free();
+  ctx.dEdfs->free();
   for (unsigned i = 0; i < num_nodes; ++i) {
     const auto dim = nfxs[i].d;
     ndEdfs[i].d = dim;
-    ndEdfs[i].v = static_cast<float*>(dEdfs->allocate(dim.size() * sizeof(float)));
+    ndEdfs[i].v = static_cast<float*>(ctx.dEdfs->allocate(dim.size() * sizeof(float)));
     if (!ndEdfs[i].v) {
       cerr << "out of memory while attempting to allocate space for derivatives\n";
       abort();
     }
   }
-  dEdfs->zero_allocated_memory();
+  ctx.dEdfs->zero_allocated_memory();
   // initialize dE/dE = 1
-  ndEdfs.back().v = kSCALAR_ONE;
+  ndEdfs.back().v = ctx.kSCALAR_ONE;
 
   // here we find constant paths to avoid doing extra work
   // by default, a node is constant unless
@@ -151,6 +153,8 @@ void SimpleExecutionEngine::backward(VariableIndex from_where) {
   // this is simpler than you might find in some other frameworks
   // since we assume parameters come into the graph as a "function"
   // that returns the current value of the parameters
+  // (while other threads may do the same, see GradientLocks)
+  SharedGradientLock lock(gradient_locks);
   for (VariableIndex i : cg.parameter_nodes)
     static_cast<ParameterNodeBase*>(cg.nodes[i])->accumulate_grad(ndEdfs[i]);
 }
@@ -17,8 +17,9 @@ class ExecutionEngine {
   virtual void backward() = 0;
   virtual void backward(VariableIndex i) = 0;
  protected:
-  explicit ExecutionEngine(const ComputationGraph& cg) : cg(cg) {}
+  explicit ExecutionEngine(const ComputationGraph& cg) : cg(cg), ctx(*cg.context) {}
   const ComputationGraph& cg;
+  ExecutionContext& ctx;
 };
 
 class SimpleExecutionEngine : public ExecutionEngine {
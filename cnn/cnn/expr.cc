@@ -1,5 +1,6 @@
 #include "cnn/expr.h"
 
+#include <algorithm>
 #include <initializer_list>
 
 #include "cnn/nodes.h"
@@ -77,6 +78,17 @@ Expression select_rows(const Expression& x, const vector<unsigned>& rows) { retu
 Expression select_rows(const Expression& x, const vector<unsigned>* prows) { return Expression(x.pg, x.pg->add_function<SelectRows>({x.i}, prows)); }
 Expression select_cols(const Expression& x, const vector<unsigned>& cols) { return Expression(x.pg, x.pg->add_function<SelectCols>({x.i}, cols)); }
 Expression select_cols(const Expression& x, const vector<unsigned>* pcols) { return Expression(x.pg, x.pg->add_function<SelectCols>({x.i}, pcols)); }
+
+Expression concatenate_many_cols(const vector<Expression>& xs) {
+  const unsigned max_cols = MAX_CONCAT_COLS_ARGS - 1;
+  if (xs.size() <= max_cols) return concatenate_cols(xs);
+  vector<Expression> blocks;
+  for (unsigned i = 0; i < xs.size(); i += max_cols) {
+    const unsigned end = std::min<unsigned>(xs.size(), i + max_cols);
+    blocks.push_back(concatenate_cols(vector<Expression>(xs.begin() + i, xs.begin() + end)));
+  }
+  return concatenate_many_cols(blocks);
+}
 Expression inverse(const Expression& x) { return Expression(x.pg, x.pg->add_function<MatrixInverse>({x.i})); }
 Expression logdet(const Expression& x) { return Expression(x.pg, x.pg->add_function<LogDet>({x.i})); }
 
@@ -165,6 +165,9 @@ inline Expression average(const std::initializer_list<Expression>& xs) { return
 template <typename T>
 inline Expression concatenate_cols(const T& xs) { return detail::f<ConcatenateColumns>(xs); }
 inline Expression concatenate_cols(const std::initializer_list<Expression>& xs) { return detail::f<ConcatenateColumns>(xs); }
+// concatenate_cols of any number of columns, in blocks that
+// ConcatenateColumns can take
+Expression concatenate_many_cols(const std::vector<Expression>& xs);
 
 template <typename T>
 inline Expression concatenate(const T& xs) { return detail::f<Concatenate>(xs); }
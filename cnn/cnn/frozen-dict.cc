@@ -0,0 +1,263 @@
+#include "cnn/frozen-dict.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace cnn {
+
+// the block starts with a header of kHEADER words:
+// magic, version, n, nkeys, nbuckets, salt, arena words
+// followed by seeds[nbuckets], slots[nkeys], offsets[n] and the arena. the
+// arena holds an entry per id: its length, the id, and the word, NUL
+// terminated and padded to a whole number of words. slots and offsets hold
+// the positions of entries in the arena, so that a lookup reads its word and
+// id together
+static const uint32_t kMAGIC = 0x63494446;  // "FDIc"
+static const uint32_t kVERSION = 1;
+static const unsigned kHEADER = 7;
+static const unsigned kENTRY = 2;  // words before the string of an entry
+static const unsigned kBUCKET_SIZE = 4;  // average words per bucket
+static const uint32_t kMAX_SALT = 8;
+
+inline unsigned entry_words(unsigned len) { return kENTRY + (len + 4) / 4; }
+
+// the final mix of MurmurHash3
+inline uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// 8 bytes at a time, as in MurmurHash3
+inline uint64_t hash_string(const char* s, unsigned len, uint32_t salt) {
+  uint64_t h = (0x9e3779b97f4a7c15ULL + salt) ^ len;
+  uint64_t w;
+  for (; len >= 8; s += 8, len -= 8) {
+    memcpy(&w, s, 8);
+    h ^= w * 0x87c37b91114253d5ULL;
+    h = ((h << 27) | (h >> 37)) * 0x4cf5ad432745937fULL + 0x52dce729;
+  }
+  // the last 0-7 bytes, read into a register without a byte loop
+  if (len >= 4) {
+    uint32_t a, b;
+    memcpy(&a, s, 4);
+    memcpy(&b, s + len - 4, 4);
+    w = (uint64_t(a) << 32) | b;
+  } else if (len > 0) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(s);
+    w = (u[0] << 16) | (u[len / 2] << 8) | u[len - 1];
+  } else {
+    w = 0;
+  }
+  return mix(h ^ (w * 0x87c37b91114253d5ULL));
+}
+
+// the high 32 bits of h scaled to [0, n), which is much faster than h % n
+inline unsigned reduce(uint64_t h, unsigned n) { return ((h >> 32) * n) >> 32; }
+
+inline unsigned bucket_of(uint64_t h, unsigned nbuckets) { return reduce(h, nbuckets); }
+
+inline unsigned slot_of(uint64_t h, uint32_t seed, unsigned nkeys) {
+  return reduce(mix(h ^ (seed * 0x9e3779b97f4a7c15ULL)), nkeys);
+}
+
+// finds a seed for each bucket with which its words land in slots no other
+// word takes, placing the words of the biggest buckets first, while most
+// slots are free. false if some bucket has no such seed
+static bool place_words(const vector<uint64_t>& hashes, const vector<vector<unsigned>>& buckets,
+                        const uint32_t* offsets, uint32_t* seeds, uint32_t* slots, unsigned nkeys) {
+  // the last buckets take about nkeys tries
+  const uint32_t max_seed = min<uint64_t>(0xffffffff, max<uint64_t>(1 << 20, 16ULL * nkeys));
+  vector<unsigned> order(buckets.size());
+  for (unsigned b = 0; b < buckets.size(); ++b) order[b] = b;
+  stable_sort(order.begin(), order.end(),
+              [&](unsigned a, unsigned b) { return buckets[a].size() > buckets[b].size(); });
+  vector<bool> taken(nkeys);
+  vector<unsigned> placed;
+  for (unsigned b : order) {
+    const vector<unsigned>& bucket = buckets[b];
+    if (bucket.empty()) break;
+    for (unsigned i = 0; i < bucket.size(); ++i)
+      for (unsigned j = 0; j < i; ++j)
+        if (hashes[bucket[i]] == hashes[bucket[j]]) return false;
+    uint32_t seed = 0;
+    for (; seed < max_seed; ++seed) {
+      placed.clear();
+      for (unsigned id : bucket) {
+        const unsigned s = slot_of(hashes[id], seed, nkeys);
+        if (taken[s] || find(placed.begin(), placed.end(), s) != placed.end()) break;
+        placed.push_back(s);
+      }
+      if (placed.size() == bucket.size()) break;
+    }
+    if (seed == max_seed) return false;
+    seeds[b] = seed;
+    for (unsigned i = 0; i < bucket.size(); ++i) {
+      taken[placed[i]] = true;
+      slots[placed[i]] = offsets[bucket[i]];
+    }
+  }
+  return true;
+}
+
+FrozenDict::FrozenDict() : mapped(), mapped_bytes(), data(), data_words(), n(), nkeys(), nbuckets(),
+    salt(), seeds(), slots(), offsets(), arena() {}
+
+FrozenDict::FrozenDict(const vector<string>& words) : FrozenDict() {
+  vector<unsigned> ids;
+  size_t arena_words = 0;
+  for (unsigned i = 0; i < words.size(); ++i) {
+    if (!words[i].empty()) ids.push_back(i);
+    arena_words += entry_words(words[i].size());
+  }
+  const unsigned nk = ids.size();
+  const unsigned nb = max(1u, (nk + kBUCKET_SIZE - 1) / kBUCKET_SIZE);
+  block.assign(kHEADER + nb + nk + words.size() + arena_words, 0);
+  uint32_t* header = block.data();
+  header[0] = kMAGIC;
+  header[1] = kVERSION;
+  header[2] = words.size();
+  header[3] = nk;
+  header[4] = nb;
+  header[6] = arena_words;
+  uint32_t* bseeds = header + kHEADER;
+  uint32_t* bslots = bseeds + nb;
+  uint32_t* boffsets = bslots + nk;
+  uint32_t* barena = boffsets + words.size();
+  uint32_t offset = 0;
+  for (unsigned i = 0; i < words.size(); ++i) {
+    boffsets[i] = offset;
+    barena[offset] = words[i].size();
+    barena[offset + 1] = i;
+    memcpy(barena + offset + kENTRY, words[i].c_str(), words[i].size() + 1);
+    offset += entry_words(words[i].size());
+  }
+
+  vector<uint64_t> hashes(words.size());
+  vector<vector<unsigned>> buckets(nb);
+  for (uint32_t salt = 0; ; ++salt) {
+    // two words with the same hash can never be placed, and a different salt
+    // changes all the hashes
+    if (salt == kMAX_SALT) throw runtime_error("Unable to build a perfect hash for FrozenDict");
+    for (auto& bucket : buckets) bucket.clear();
+    for (unsigned id : ids) {
+      hashes[id] = hash_string(words[id].data(), words[id].size(), salt);
+      buckets[bucket_of(hashes[id], nb)].push_back(id);
+    }
+    if (salt == 0) {
+      for (auto& bucket : buckets)
+        for (unsigned i = 0; i < bucket.size(); ++i)
+          for (unsigned j = 0; j < i; ++j)
+            if (words[bucket[i]] == words[bucket[j]])
+              throw invalid_argument("Word appears twice in FrozenDict: " + words[bucket[i]]);
+    }
+    header[5] = salt;
+    if (place_words(hashes, buckets, boffsets, bseeds, bslots, nk)) break;
+  }
+  attach(block.data(), block.size());
+}
+
+FrozenDict::FrozenDict(const FrozenDict& other) : FrozenDict() {
+  if (!other.data) return;
+  block.assign(other.data, other.data + other.data_words);
+  attach(block.data(), block.size());
+}
+
+FrozenDict::FrozenDict(FrozenDict&& other) : FrozenDict() { swap(other); }
+
+FrozenDict& FrozenDict::operator=(FrozenDict other) {
+  swap(other);
+  return *this;
+}
+
+FrozenDict::~FrozenDict() { unmap(); }
+
+void FrozenDict::swap(FrozenDict& other) {
+  // the views stay valid: swapping vectors keeps their buffers
+  std::swap(block, other.block);
+  std::swap(mapped, other.mapped);
+  std::swap(mapped_bytes, other.mapped_bytes);
+  std::swap(data, other.data);
+  std::swap(data_words, other.data_words);
+  std::swap(n, other.n);
+  std::swap(nkeys, other.nkeys);
+  std::swap(nbuckets, other.nbuckets);
+  std::swap(salt, other.salt);
+  std::swap(seeds, other.seeds);
+  std::swap(slots, other.slots);
+  std::swap(offsets, other.offsets);
+  std::swap(arena, other.arena);
+}
+
+int FrozenDict::find(const char* word, unsigned len) const {
+  if (nkeys == 0 || len == 0) return -1;
+  const uint64_t h = hash_string(word, len, salt);
+  const uint32_t* entry = arena + slots[slot_of(h, seeds[bucket_of(h, nbuckets)], nkeys)];
+  if (entry[0] != len || memcmp(entry + kENTRY, word, len) != 0) return -1;
+  return entry[1];
+}
+
+const char* FrozenDict::c_str(unsigned id) const {
+  return reinterpret_cast<const char*>(arena + offsets[id] + kENTRY);
+}
+
+unsigned FrozenDict::length(unsigned id) const { return arena[offsets[id]]; }
+
+void FrozenDict::attach(const uint32_t* d, size_t words) {
+  if (words < kHEADER || d[0] != kMAGIC || d[1] != kVERSION)
+    throw runtime_error("Bad FrozenDict data");
+  const unsigned dn = d[2], dkeys = d[3], dbuckets = d[4];
+  if (words != kHEADER + dbuckets + dkeys + dn + d[6])
+    throw runtime_error("Bad FrozenDict data: wrong size");
+  data = d;
+  data_words = words;
+  n = dn;
+  nkeys = dkeys;
+  nbuckets = dbuckets;
+  salt = d[5];
+  seeds = d + kHEADER;
+  slots = seeds + nbuckets;
+  offsets = slots + nkeys;
+  arena = offsets + n;
+}
+
+void FrozenDict::save(const string& fname) const {
+  ofstream out(fname, ios::binary);
+  out.write(reinterpret_cast<const char*>(data), data_words * sizeof(uint32_t));
+  if (!out) throw runtime_error("Unable to write " + fname);
+}
+
+void FrozenDict::map(const string& fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) throw runtime_error("Unable to open " + fname);
+  struct stat st;
+  void* ptr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) throw runtime_error("Unable to map " + fname);
+  FrozenDict d;
+  d.mapped = ptr;
+  d.mapped_bytes = st.st_size;
+  d.attach(static_cast<const uint32_t*>(ptr), st.st_size / sizeof(uint32_t));  // unmaps if it throws
+  swap(d);
+}
+
+void FrozenDict::unmap() {
+  if (mapped) munmap(mapped, mapped_bytes);
+  mapped = nullptr;
+}
+
+} // namespace cnn
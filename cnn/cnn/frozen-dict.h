@@ -0,0 +1,82 @@
+#ifndef CNN_FROZEN_DICT_H_
+#define CNN_FROZEN_DICT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+
+namespace cnn {
+
+// a read-only table of strings and their ids. the strings are stored one
+// after another in a single arena, and found with a minimal perfect hash, so
+// a lookup costs one hash of the string and one comparison. the whole table
+// is one block of 32 bit words, which save() writes as is and map() maps
+// back into memory without reading it.
+class FrozenDict {
+ public:
+  FrozenDict();
+  // the id of each word is its position; empty strings are left out, as
+  // holes in the ids. throws if a word appears twice
+  explicit FrozenDict(const std::vector<std::string>& words);
+  FrozenDict(const FrozenDict& other);
+  FrozenDict(FrozenDict&& other);
+  FrozenDict& operator=(FrozenDict other);
+  ~FrozenDict();
+  void swap(FrozenDict& other);
+
+  // the number of ids
+  unsigned size() const { return n; }
+
+  // the id of the word, or -1 if it is not in the table
+  int find(const char* word, unsigned len) const;
+  int find(const std::string& word) const { return find(word.data(), word.size()); }
+
+  // the word of an id, NUL terminated, and its length
+  const char* c_str(unsigned id) const;
+  unsigned length(unsigned id) const;
+
+  // writes the table to a file that map() can read
+  void save(const std::string& fname) const;
+  // replaces the table with one in a file written by save(), mapped read only
+  void map(const std::string& fname);
+
+ private:
+  void attach(const uint32_t* data, size_t words);
+  void unmap();
+
+  std::vector<uint32_t> block;  // the table, unless it is mapped
+  void* mapped;
+  size_t mapped_bytes;
+
+  // views of the table, wherever it is
+  const uint32_t* data;
+  size_t data_words;
+  unsigned n;  // ids
+  unsigned nkeys;  // non-empty words
+  unsigned nbuckets;
+  uint32_t salt;  // of the hash of the words
+  const uint32_t* seeds;  // per bucket, the seed that places its words
+  const uint32_t* slots;  // the entry of the word in each slot
+  const uint32_t* offsets;  // the entry of each id
+  const uint32_t* arena;
+
+  friend class boost::serialization::access;
+  template<class Archive> void save(Archive& ar, const unsigned int) const {
+    std::vector<uint32_t> b(data, data + data_words);
+    ar & b;
+  }
+  template<class Archive> void load(Archive& ar, const unsigned int) {
+    FrozenDict d;
+    ar & d.block;
+    if (!d.block.empty()) d.attach(d.block.data(), d.block.size());
+    swap(d);
+  }
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+} // namespace cnn
+
+#endif
@@ -39,6 +39,8 @@ GRUBuilder::GRUBuilder(unsigned layers,
     vector<Parameters*> ps = {p_x2z, p_h2z, p_bz, p_x2r, p_h2r, p_br, p_x2h, p_h2h, p_bh};
     params.push_back(ps);
   }  // layers
+  dropout_rate = 0.0f;
+  variational_dropout = false;
 }
 
 void GRUBuilder::new_graph_impl(ComputationGraph& cg) {
@@ -72,6 +74,17 @@ void GRUBuilder::start_new_sequence_impl(const std::vector<Expression>& h_0) {
   if (!h0.empty()) {
     assert (h0.size() == layers);
   }
+  x_masks.clear();
+  h_masks.clear();
+  if (dropout_rate && variational_dropout) {
+    ComputationGraph& cg = *param_vars[0][0].pg;
+    for (unsigned i = 0; i < layers; ++i) {
+      const unsigned input_dim = params[i][X2Z]->dim.cols();
+      x_masks.push_back(input(cg, {input_dim}, sample_dropout_mask(input_dim, dropout_rate)));
+      h_masks.push_back(input(cg, {hidden_dim}, sample_dropout_mask(hidden_dim, dropout_rate)));
+    }
+    output_mask = input(cg, {hidden_dim}, sample_dropout_mask(hidden_dim, dropout_rate));
+  }
 }
 
 Expression GRUBuilder::add_input_impl(int prev, const Expression& x) {
@@ -79,20 +92,29 @@ Expression GRUBuilder::add_input_impl(int prev, const Expression& x) {
   h.push_back(vector<Expression>(layers));
   vector<Expression>& ht = h.back();
   Expression in = x;
+  const bool variational = !x_masks.empty();
   for (unsigned i = 0; i < layers; ++i) {
     const vector<Expression>& vars = param_vars[i];
+    if (dropout_rate && !variational) in = dropout(in, dropout_rate);
     Expression h_tprev;
     // prev_zero means that h_tprev should be treated as 0
     bool prev_zero = false;
     if (prev >= 0 || has_initial_state) {
       h_tprev = (prev < 0) ? h0[i] : h[prev][i];
     } else { prev_zero = true; }
+    // what the gates read of h_tprev: the gates share the masks, so a step
+    // masks the input and h_tprev once
+    Expression h_in = h_tprev;
+    if (variational) {
+      in = cwise_multiply(in, x_masks[i]);
+      if (!prev_zero) h_in = cwise_multiply(h_tprev, h_masks[i]);
+    }
     // update gate
     Expression zt;
     if (prev_zero)
       zt = affine_transform({vars[BZ], vars[X2Z], in});
     else
-      zt = affine_transform({vars[BZ], vars[X2Z], in, vars[H2Z], h_tprev});
+      zt = affine_transform({vars[BZ], vars[X2Z], in, vars[H2Z], h_in});
     zt = logistic(zt);
     // forget
     Expression ft = 1.f - zt;
@@ -101,7 +123,7 @@ Expression GRUBuilder::add_input_impl(int prev, const Expression& x) {
     if (prev_zero)
       rt = affine_transform({vars[BR], vars[X2R], in});
     else
-      rt = affine_transform({vars[BR], vars[X2R], in, vars[H2R], h_tprev});
+      rt = affine_transform({vars[BR], vars[X2R], in, vars[H2R], h_in});
     rt = logistic(rt);
 
     // candidate activation
@@ -112,7 +134,7 @@ Expression GRUBuilder::add_input_impl(int prev, const Expression& x) {
       Expression nwt = cwise_multiply(zt, ct);
       in = ht[i] = nwt;
     } else {
-      Expression ght = cwise_multiply(rt, h_tprev);
+      Expression ght = cwise_multiply(rt, h_in);
       ct = affine_transform({vars[BH], vars[X2H], in, vars[H2H], ght});
       ct = tanh(ct);
       Expression nwt = cwise_multiply(zt, ct);
@@ -120,6 +142,8 @@ Expression GRUBuilder::add_input_impl(int prev, const Expression& x) {
       in = ht[i] = crt + nwt;
     }
   }
+  if (variational) return cwise_multiply(ht.back(), output_mask);
+  if (dropout_rate) return dropout(ht.back(), dropout_rate);
   return ht.back();
 }
 
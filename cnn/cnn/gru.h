@@ -1,6 +1,8 @@
 #ifndef CNN_GRU_H_
 #define CNN_GRU_H_
 
+#include <stdexcept>
+
 #include "cnn/cnn.h"
 #include "cnn/rnn.h"
 
@@ -22,11 +24,21 @@ struct GRUBuilder : public RNNBuilder {
   unsigned num_h0_components() const override { return layers; }
   void copy(const RNNBuilder & params) override;
 
+  // dropout of the input of each layer and of the output, as in LSTMBuilder
+  void set_dropout(float d) { dropout_rate = d; variational_dropout = false; }
+  void set_variational_dropout(float d) {
+    if (d < 0 || d >= 1) throw std::invalid_argument("variational dropout rate must be in [0, 1)");
+    dropout_rate = d;
+    variational_dropout = true;
+  }
+  void disable_dropout() { dropout_rate = 0; }
+
  protected:
   void new_graph_impl(ComputationGraph& cg) override;
   void start_new_sequence_impl(const std::vector<Expression>& h0) override;
   Expression add_input_impl(int prev, const Expression& x) override;
 
+ public:
   // first index is layer, then ...
   std::vector<std::vector<Parameters*>> params;
 
@@ -42,6 +54,13 @@ struct GRUBuilder : public RNNBuilder {
 
   unsigned hidden_dim;
   unsigned layers;
+  float dropout_rate;
+  bool variational_dropout;
+
+  // with variational dropout, this sequence's masks of the input and of
+  // h_{t-1} by layer, shared by the gates (z, r, h), and the mask of the output
+  std::vector<Expression> x_masks, h_masks;
+  Expression output_mask;
 };
 
 } // namespace cnn
@@ -116,6 +116,29 @@ Expression Cluster::neg_log_softmax(Expression h, unsigned r, ComputationGraph&
   }
 }
 
+Expression Cluster::neg_log_softmax(Expression h, const vector<unsigned>& rs, ComputationGraph& cg) const {
+  if (output_size == 1) {
+    return input(cg, 0.0f);
+  }
+  else if (output_size == 2) {
+    // p for the reps that take child 0, 1 - p for the others
+    const Dim d({1}, rs.size());
+    vector<float> offsets(rs.size()), signs(rs.size());
+    for (unsigned i = 0; i < rs.size(); ++i) {
+      assert (rs[i] == 0 || rs[i] == 1);
+      offsets[i] = rs[i] == 1 ? 1.f : 0.f;
+      signs[i] = rs[i] == 1 ? -1.f : 1.f;
+    }
+    Expression p = logistic(predict(h, cg));
+    p = input(cg, d, offsets) + cwise_multiply(input(cg, d, signs), p);
+    return sum_batches(-log(p));
+  }
+  else {
+    Expression dist = predict(h, cg);
+    return sum_batches(pickneglogsoftmax(dist, rs));
+  }
+}
+
 unsigned Cluster::sample(expr::Expression h, ComputationGraph& cg) const {
   if (output_size == 1) {
     return 0;
@@ -214,6 +237,46 @@ Expression HierarchicalSoftmaxBuilder::neg_log_softmax(const Expression& rep, un
   return sum(log_probs);
 }
 
+Expression HierarchicalSoftmaxBuilder::neg_log_softmax(const Expression& reps, const vector<unsigned>& wordidxs) {
+  assert (pcg != NULL && "You must call new_graph before calling neg_log_softmax!");
+  Expression cols = as_columns(reps);
+  Expression batch = as_batch(cols);
+
+  // the nodes on the words' paths, in the order they are first reached, with
+  // the columns of the words that go through each and the index they take
+  vector<const Cluster*> nodes;
+  unordered_map<const Cluster*, unsigned> node_ids;
+  vector<pair<vector<unsigned>, vector<unsigned>>> members;
+  for (unsigned j = 0; j < wordidxs.size(); ++j) {
+    Cluster* path = widx2path[wordidxs[j]];
+    const Cluster* node = root;
+    unsigned i = 0;
+    while (true) {
+      const bool leaf = node->num_children() == 0;
+      unsigned r = leaf ? path->get_index(wordidxs[j]) : node->get_index(path->get_path()[i]);
+      auto it = node_ids.find(node);
+      if (it == node_ids.end()) {
+        it = node_ids.insert(make_pair(node, nodes.size())).first;
+        nodes.push_back(node);
+        members.emplace_back();
+      }
+      members[it->second].first.push_back(j);
+      members[it->second].second.push_back(r);
+      if (leaf) break;
+      node = node->get_child(r);
+      i += 1;
+    }
+  }
+
+  vector<Expression> log_probs;
+  for (unsigned k = 0; k < nodes.size(); ++k) {
+    const vector<unsigned>& which = members[k].first;
+    Expression x = which.size() == wordidxs.size() ? batch : as_batch(select_cols(cols, which));
+    log_probs.push_back(nodes[k]->neg_log_softmax(x, members[k].second, *pcg));
+  }
+  return sum(log_probs);
+}
+
 unsigned HierarchicalSoftmaxBuilder::sample(const expr::Expression& rep) {
   assert (pcg != NULL && "You must call new_graph before calling sample!");
 
@@ -37,6 +37,8 @@ public:
   void new_graph(ComputationGraph& cg);
   unsigned sample(expr::Expression h, ComputationGraph& cg) const;
   expr::Expression neg_log_softmax(expr::Expression h, unsigned r, ComputationGraph& cg) const;
+  // h is a mini-batch of rs.size() vectors
+  expr::Expression neg_log_softmax(expr::Expression h, const std::vector<unsigned>& rs, ComputationGraph& cg) const;
 
   unsigned get_index(unsigned word) const;
   unsigned get_word(unsigned index) const;
@@ -65,6 +67,10 @@ class HierarchicalSoftmaxBuilder : public FactoredSoftmaxBuilder {
   // -log(p(c | rep) * p(w | c, rep))
   expr::Expression neg_log_softmax(const expr::Expression& rep, unsigned wordidx);
 
+  // the same over a batch, scoring each node of the tree once for all the
+  // words whose paths go through it
+  expr::Expression neg_log_softmax(const expr::Expression& reps, const std::vector<unsigned>& wordidxs);
+
   // samples a word from p(w,c | rep)
   unsigned sample(const expr::Expression& rep);
 
@@ -1,6 +1,7 @@
 #include "cnn/init.h"
 #include "cnn/aligned-mem-pool.h"
 #include "cnn/cnn.h"
+#include "cnn/context.h"
 
 #include <iostream>
 #include <random>
@@ -69,6 +70,7 @@ void Initialize(int& argc, char**& argv, unsigned random_seed, bool shared_param
   }
   cerr << "[cnn] random seed: " << random_seed << endl;
   rndeng = new mt19937(random_seed);
+  set_random_seed(random_seed);
 
   cerr << "[cnn] allocating memory: " << num_mb << "MB\n";
   devices.push_back(new Device_CPU(num_mb, shared_parameters));
@@ -87,10 +89,12 @@ void Initialize(int& argc, char**& argv, unsigned random_seed, bool shared_param
   kSCALAR_MINUSONE = default_device->kSCALAR_MINUSONE;
   kSCALAR_ONE = default_device->kSCALAR_ONE;
   kSCALAR_ZERO = default_device->kSCALAR_ZERO;
+  default_context = new ExecutionContext(default_device, fxs, dEdfs);
   cerr << "[cnn] memory allocation done.\n";
 }
 
 void Cleanup() {
+  delete default_context;
   delete rndeng;
   delete fxs;
   delete dEdfs;
@@ -42,6 +42,7 @@ LSTMBuilder::LSTMBuilder(unsigned layers,
     params.push_back(ps);
   }  // layers
   dropout_rate = 0.0f;
+  variational_dropout = false;
 }
 
 void LSTMBuilder::new_graph_impl(ComputationGraph& cg){
@@ -87,6 +88,18 @@ void LSTMBuilder::start_new_sequence_impl(const vector<Expression>& hinit) {
   } else {
     has_initial_state = false;
   }
+  x_masks.clear();
+  h_masks.clear();
+  if (dropout_rate && variational_dropout) {
+    ComputationGraph& cg = *param_vars[0][0].pg;
+    const unsigned hidden_dim = params[0][H2I]->dim.rows();
+    for (unsigned i = 0; i < layers; ++i) {
+      const unsigned input_dim = params[i][X2I]->dim.cols();
+      x_masks.push_back(input(cg, {input_dim}, sample_dropout_mask(input_dim, dropout_rate)));
+      h_masks.push_back(input(cg, {hidden_dim}, sample_dropout_mask(hidden_dim, dropout_rate)));
+    }
+    output_mask = input(cg, {hidden_dim}, sample_dropout_mask(hidden_dim, dropout_rate));
+  }
 }
 
 Expression LSTMBuilder::add_input_impl(int prev, const Expression& x) {
@@ -95,6 +108,7 @@ Expression LSTMBuilder::add_input_impl(int prev, const Expression& x) {
   vector<Expression>& ht = h.back();
   vector<Expression>& ct = c.back();
   Expression in = x;
+  const bool variational = !x_masks.empty();
   for (unsigned i = 0; i < layers; ++i) {
     const vector<Expression>& vars = param_vars[i];
     Expression i_h_tm1, i_c_tm1;
@@ -111,7 +125,12 @@ Expression LSTMBuilder::add_input_impl(int prev, const Expression& x) {
       i_c_tm1 = c[prev][i];
     }
     // apply dropout according to http://arxiv.org/pdf/1409.2329v5.pdf
-    if (dropout_rate) in = dropout(in, dropout_rate);
+    if (dropout_rate && !variational) in = dropout(in, dropout_rate);
+    // the gates share the masks, so a step masks the input and h_{t-1} once
+    if (variational) {
+      in = cwise_multiply(in, x_masks[i]);
+      if (has_prev_state) i_h_tm1 = cwise_multiply(i_h_tm1, h_masks[i]);
+    }
     // input
     Expression i_ait;
     if (has_prev_state)
@@ -146,6 +165,7 @@ Expression LSTMBuilder::add_input_impl(int prev, const Expression& x) {
     Expression ph_t = tanh(ct[i]);
     in = ht[i] = cwise_multiply(i_ot,ph_t);
   }
+  if (variational) return cwise_multiply(ht.back(), output_mask);
   if (dropout_rate) return dropout(ht.back(), dropout_rate);
     else return ht.back();
 }
@@ -1,6 +1,8 @@
 #ifndef CNN_LSTM_H_
 #define CNN_LSTM_H_
 
+#include <stdexcept>
+
 #include "cnn/cnn.h"
 #include "cnn/rnn.h"
 #include "cnn/expr.h"
@@ -18,7 +20,17 @@ struct LSTMBuilder : public RNNBuilder {
                        unsigned hidden_dim,
                        Model* model);
 
-  void set_dropout(float d) { dropout_rate = d; }
+  // a new dropout mask for each step
+  void set_dropout(float d) { dropout_rate = d; variational_dropout = false; }
+  // variational dropout (Gal and Ghahramani, 2016): the masks of the input
+  // and of h_{t-1} of each layer, tied across the gates, and of the output
+  // are sampled when a sequence starts and used at every step of it, so
+  // steps draw no random numbers. d must be in [0, 1)
+  void set_variational_dropout(float d) {
+    if (d < 0 || d >= 1) throw std::invalid_argument("variational dropout rate must be in [0, 1)");
+    dropout_rate = d;
+    variational_dropout = true;
+  }
   // in general, you should disable dropout at test time
   void disable_dropout() { dropout_rate = 0; }
 
@@ -61,6 +73,12 @@ struct LSTMBuilder : public RNNBuilder {
   std::vector<Expression> c0;
   unsigned layers;
   float dropout_rate;
+  bool variational_dropout;
+
+  // with variational dropout, this sequence's masks of the input and of
+  // h_{t-1} by layer, shared by the gates (i, c, o), and the mask of the output
+  std::vector<Expression> x_masks, h_masks;
+  Expression output_mask;
 };
 
 } // namespace cnn
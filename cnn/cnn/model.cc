@@ -3,7 +3,8 @@
 #include "cnn/aligned-mem-pool.h"
 #include "cnn/cnn.h"
 
-#include <unordered_set>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include <fstream>
@@ -20,18 +21,42 @@ using namespace std;
 
 namespace cnn {
 
+GradientLocks* gradient_locks = nullptr;
+
+GradientLocks::GradientLocks(bool lock_dense, unsigned stripes) : lock_dense(lock_dense), locks(stripes) {
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&accumulating, &attr);
+  pthread_rwlockattr_destroy(&attr);
+}
+
+GradientLocks::~GradientLocks() {
+  pthread_rwlock_destroy(&accumulating);
+}
+
+void GradientLocks::lock_all() {
+  pthread_rwlock_wrlock(&accumulating);
+  for (auto& m : locks) m.lock();
+}
+
+void GradientLocks::unlock_all() {
+  for (auto& m : locks) m.unlock();
+  pthread_rwlock_unlock(&accumulating);
+}
+
 ParametersBase::~ParametersBase() {}
 
-Parameters::Parameters(const Dim& d, float scale) : dim(d) {
+Parameters::Parameters(const Dim& d, float scale, AlignedMemoryPool* mem) : dim(d) {
   values.d = g.d = d;
-  values.v = static_cast<float*>(ps->allocate(d.size() * sizeof(float)));
+  values.v = static_cast<float*>(mem->allocate(d.size() * sizeof(float)));
   if (scale) {
     TensorTools::Randomize(values, scale);
   }
   else {
     TensorTools::Randomize(values);
   }
-  g.v = static_cast<float*>(ps->allocate(d.size() * sizeof(float)));
+  g.v = static_cast<float*>(mem->allocate(d.size() * sizeof(float)));
   TensorTools::Zero(g);
 }
 
@@ -63,6 +88,9 @@ void Parameters::copy(const Parameters & param) {
 }
 
 void Parameters::accumulate_grad(const Tensor& d) {
+  unique_lock<mutex> lock;
+  if (gradient_locks && gradient_locks->lock_dense)
+    lock = unique_lock<mutex>(gradient_locks->of(this));
 #if HAVE_CUDA
   CUBLAS_CHECK(cublasSaxpy(cublas_handle, g.d.size(), kSCALAR_ONE, d.v, 1, g.v, 1));
 #else
@@ -74,23 +102,29 @@ void Parameters::clear() {
   TensorTools::Zero(g);
 }
 
-LookupParameters::LookupParameters(unsigned n, const Dim& d) : dim(d), values(n), grads(n) {
+LookupParameters::LookupParameters(unsigned n, const Dim& d, AlignedMemoryPool* mem) :
+    dim(d), values(n), grads(n), non_zero_grads(n) {
+  stride = d.size() < 8 ? d.size() : (d.size() + 7) / 8 * 8;
+  all_values.d = all_grads.d = Dim({stride, n});
+  all_values.v = static_cast<float*>(mem->allocate(stride * n * sizeof(float)));
+  all_grads.v = static_cast<float*>(mem->allocate(stride * n * sizeof(float)));
+  TensorTools::Zero(all_values);
+  TensorTools::Zero(all_grads);
   for (unsigned i = 0; i < n; ++i) {
     auto& v = values[i];
     v.d = d;
-    v.v = static_cast<float*>(ps->allocate(d.size() * sizeof(float)));
+    v.v = all_values.v + i * stride;
     TensorTools::Randomize(v);
 
     auto& g = grads[i];
     g.d = d;
-    g.v = static_cast<float*>(ps->allocate(d.size() * sizeof(float)));
-    TensorTools::Zero(g);
+    g.v = all_grads.v + i * stride;
   }
 }
 
 void LookupParameters::scale_parameters(float a) {
-  for (auto& p : values)
-    (*p) *= a;
+  // the padding stays 0
+  (*all_values) *= a;
 }
 
 void LookupParameters::Initialize(unsigned index, const vector<float>& val) {
@@ -103,6 +137,22 @@ void LookupParameters::Initialize(unsigned index, const vector<float>& val) {
 #endif
 }
 
+void LookupParameters::Initialize(const float* rows, unsigned n) {
+  assert(n <= values.size());
+  const unsigned d = dim.size();
+#if HAVE_CUDA
+  CUDA_CHECK(cudaMemcpy2D(all_values.v, stride * sizeof(float), rows, d * sizeof(float),
+                          d * sizeof(float), n, cudaMemcpyHostToDevice));
+#else
+  if (stride == d) {
+    memcpy(all_values.v, rows, size_t(n) * d * sizeof(float));
+  } else {
+    for (unsigned i = 0; i < n; ++i)
+      memcpy(values[i].v, rows + size_t(i) * d, d * sizeof(float));
+  }
+#endif
+}
+
 size_t LookupParameters::size() const {
   return values.size() * dim.size();
 }
@@ -124,26 +174,21 @@ void LookupParameters::g_squared_l2norm(float* sqnorm) const {
 
 void LookupParameters::squared_l2norm(float* sqnorm) const {
 #if HAVE_CUDA
-  bool acc = false;
-  for (unsigned i = 0; i < values.size(); ++i) {
-    gpu::l2_norm_reducer(values[i].d.size(), values[i].v, sqnorm, true, acc);
-    acc = true;
-  }
+  gpu::l2_norm_reducer(all_values.d.size(), all_values.v, sqnorm, true, false);
 #else
-  float a = 0;
-  for (unsigned i = 0; i < values.size(); ++i)
-    a += (*values[i]).squaredNorm();
-  *sqnorm = a;
+  *sqnorm = all_values.vec().squaredNorm();
 #endif
 }
 
 void LookupParameters::copy(const LookupParameters & param) {
   assert(dim == param.dim);
-  for(size_t i = 0; i < param.values.size(); ++i)
-    TensorTools::CopyElements(values[i], param.values[i]);
+  assert(values.size() == param.values.size());
+  TensorTools::CopyElements(all_values, param.all_values);
 }
 
 void LookupParameters::accumulate_grad(unsigned index, const Tensor& d) {
+  unique_lock<mutex> lock;
+  if (gradient_locks) lock = unique_lock<mutex>(gradient_locks->of(this));
   non_zero_grads.insert(index);
 #if HAVE_CUDA
   CUBLAS_CHECK(cublasSaxpy(cublas_handle, d.d.size(), kSCALAR_ONE, d.v, 1, grads[index].v, 1));
@@ -152,6 +197,68 @@ void LookupParameters::accumulate_grad(unsigned index, const Tensor& d) {
 #endif
 }
 
+// a memcpy per row: glibc picks the widest vector copy of the CPU at run
+// time, which an explicit packet loop in a build without -march=native
+// can't (about 2.5 times slower in bench-cnn's lookup/gather), and which
+// it barely beats with -march=native
+void LookupParameters::gather(const vector<unsigned>& rows, float* x) const {
+  const unsigned n = dim.size();
+  for (unsigned b = 0; b < rows.size(); ++b) {
+    assert(rows[b] < values.size());
+#if HAVE_CUDA
+    CUDA_CHECK(cudaMemcpyAsync(x + b * n, values[rows[b]].v, n * sizeof(float), cudaMemcpyDeviceToDevice));
+#else
+    memcpy(x + b * n, values[rows[b]].v, n * sizeof(float));
+#endif
+  }
+}
+
+void LookupParameters::scatter_add_grads(const vector<unsigned>& rows, const float* g) {
+  unique_lock<mutex> lock;
+  if (gradient_locks) lock = unique_lock<mutex>(gradient_locks->of(this));
+  const unsigned n = dim.size();
+  for (unsigned b = 0; b < rows.size(); ++b) {
+    const unsigned i = rows[b];
+    assert(i < values.size());
+    non_zero_grads.insert(i);
+#if HAVE_CUDA
+    CUBLAS_CHECK(cublasSaxpy(cublas_handle, n, kSCALAR_ONE, g + b * n, 1, grads[i].v, 1));
+#else
+    Eigen::Map<Eigen::VectorXf>(grads[i].v, n) += Eigen::Map<const Eigen::VectorXf>(g + b * n, n);
+#endif
+  }
+}
+
+vector<float> LookupParameters::packed_values() const {
+  const unsigned n = dim.size();
+  vector<float> block = as_vector(all_values);
+  if (stride == n) return block;
+  vector<float> rows(values.size() * n);
+  for (unsigned i = 0; i < values.size(); ++i)
+    copy_n(block.begin() + i * stride, n, rows.begin() + i * n);
+  return rows;
+}
+
+void LookupParameters::set_packed_values(const vector<float>& rows) {
+  const unsigned n = dim.size();
+  assert(rows.size() == values.size() * n);
+  vector<float> block(all_values.d.size(), 0.f);
+  for (unsigned i = 0; i < values.size(); ++i)
+    copy_n(rows.begin() + i * n, n, block.begin() + i * stride);
+  TensorTools::SetElements(all_values, block);
+}
+
+void LookupParameters::load_row(unsigned i, Tensor& t) {
+  assert(t.d.size() == dim.size());
+  TensorTools::CopyElements(values[i], t);
+#if HAVE_CUDA
+  CUDA_CHECK(cudaFree(t.v));
+#else
+  _mm_free(t.v);
+#endif
+  t.v = nullptr;
+}
+
 void LookupParameters::clear() {
   for (auto i : non_zero_grads)
     TensorTools::Zero(grads[i]);
@@ -199,14 +306,14 @@ float Model::gradient_l2_norm() const {
 }
 
 Parameters* Model::add_parameters(const Dim& d, float scale) {
-  Parameters* p = new Parameters(d, scale);
+  Parameters* p = new Parameters(d, scale, mem ? mem : ps);
   all_params.push_back(p);
   params.push_back(p);
   return p;
 }
 
 LookupParameters* Model::add_lookup_parameters(unsigned n, const Dim& d) {
-  LookupParameters* p = new LookupParameters(n,d);
+  LookupParameters* p = new LookupParameters(n, d, mem ? mem : ps);
   all_params.push_back(p);
   lookup_params.push_back(p);
   return p;
@@ -2,17 +2,61 @@
 #define CNN_PARAMS_H_
 
 #include <vector>
-#include <unordered_set>
 #include <string>
+#include <mutex>
+#include <pthread.h>
+#include <atomic>
+#include <functional>
 
 
 #include <boost/serialization/split_member.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 
+#include "cnn/sparse-rows.h"
 #include "cnn/tensor.h"
 
 namespace cnn {
 
+class AlignedMemoryPool;
+
+// lets several threads accumulate gradients into the same model at once
+// (see mp::RunMultiThread). lookup parameters always take the lock of their
+// stripe, since they also update non_zero_grads; dense parameters only do
+// if lock_dense is set, and otherwise add to their gradients without locks
+// (hogwild style). either way a backward pass holds the locks shared while
+// it adds its gradients, and lock_all holds them exclusively, so gradients
+// are not applied or cleared while a thread is adding to them
+struct GradientLocks {
+  explicit GradientLocks(bool lock_dense, unsigned stripes = 64);
+  ~GradientLocks();
+  GradientLocks(const GradientLocks&) = delete;
+  GradientLocks& operator=(const GradientLocks&) = delete;
+  std::mutex& of(const void* p) { return locks[(std::hash<const void*>()(p) >> 4) % locks.size()]; }
+  // by a backward pass, around adding its gradients
+  void lock_shared() { pthread_rwlock_rdlock(&accumulating); }
+  void unlock_shared() { pthread_rwlock_unlock(&accumulating); }
+  // e.g., while the gradients are applied and cleared
+  void lock_all();
+  void unlock_all();
+  bool lock_dense;
+  std::vector<std::mutex> locks;
+ private:
+  // prefers writers, so that lock_all is not starved by the passes
+  pthread_rwlock_t accumulating;
+};
+extern GradientLocks* gradient_locks;  // null while single-threaded
+
+// holds locks shared (if it is not null) while in scope
+struct SharedGradientLock {
+  explicit SharedGradientLock(GradientLocks* locks) : locks(locks) { if (locks) locks->lock_shared(); }
+  ~SharedGradientLock() { if (locks) locks->unlock_shared(); }
+  SharedGradientLock(const SharedGradientLock&) = delete;
+  SharedGradientLock& operator=(const SharedGradientLock&) = delete;
+ private:
+  GradientLocks* locks;
+};
+
 // to deal with sparse updates, there are two parameter classes:
 // * Parameters represents a vector, matrix, (eventually higher order tensors)
 //   of parameters. These are densely updated.
@@ -45,7 +89,7 @@ struct Parameters : public ParametersBase {
   Tensor g;
  private:
   Parameters() {}
-  explicit Parameters(const Dim& d, float minmax); // initialize with ~U(-minmax,+minmax)
+  explicit Parameters(const Dim& d, float minmax, AlignedMemoryPool* mem); // initialize with ~U(-minmax,+minmax)
                                  // or Glorot initialization if minmax = 0
   friend class boost::serialization::access;
   template<class Archive> void serialize(Archive& ar, const unsigned int) {
@@ -62,36 +106,65 @@ struct LookupParameters : public ParametersBase {
   void g_squared_l2norm(float* sqnorm) const override;
   size_t size() const override;
   void Initialize(unsigned index, const std::vector<float>& val);
+  // sets rows 0 to n - 1 from n vectors of dim.size() floats, one after the
+  // other (without the padding of the table)
+  void Initialize(const float* rows, unsigned n);
 
   void copy(const LookupParameters & val);
   void accumulate_grad(unsigned index, const Tensor& g);
+  // copies rows[b] to the b'th dim.size() floats of x
+  void gather(const std::vector<unsigned>& rows, float* x) const;
+  // adds the b'th dim.size() floats of g to the gradient of rows[b]
+  void scatter_add_grads(const std::vector<unsigned>& rows, const float* g);
   void clear();
 
   Dim dim;
+  // the table is one block in which row i (the vector of index i) starts
+  // stride floats after row i - 1. rows of 8 or more floats are padded
+  // (with zeros) to a multiple of 8, so each starts 32-byte aligned
+  unsigned stride;
+  Tensor all_values;  // {stride, rows}
+  Tensor all_grads;  // {stride, rows}
+  // views of the rows of all_values and all_grads
   std::vector<Tensor> values;
   std::vector<Tensor> grads;
   // gradients are sparse, so track which components are nonzero
-  std::unordered_set<unsigned> non_zero_grads;
+  SparseRowTracker non_zero_grads;
  private:
   LookupParameters() {}
-  LookupParameters(unsigned n, const Dim& d);
+  LookupParameters(unsigned n, const Dim& d, AlignedMemoryPool* mem);
   friend class boost::serialization::access;
+  // the rows without their padding, one after the other
+  std::vector<float> packed_values() const;
+  void set_packed_values(const std::vector<float>& rows);
+  // copies t to row i and frees the memory of t
+  void load_row(unsigned i, Tensor& t);
   template<class Archive>
   void save(Archive& ar, const unsigned int) const {
     ar & dim;
     int nv = values.size();
     ar & nv;
-    for (unsigned i = 0; i < values.size(); ++i)
-      ar & values[i];
+    std::vector<float> rows = packed_values();
+    ar & boost::serialization::make_array(rows.data(), rows.size());
   }
   template<class Archive>
-  void load(Archive& ar, const unsigned int) {
+  void load(Archive& ar, const unsigned int version) {
     ar & dim;
     int nv;
     ar & nv;
     assert(nv == (int)values.size());
-    for (unsigned i = 0; i < values.size(); ++i)
-      ar & values[i];
+    if (version == 0) {
+      // a Tensor per row
+      for (unsigned i = 0; i < values.size(); ++i) {
+        Tensor t;
+        ar & t;
+        load_row(i, t);
+      }
+    } else {
+      std::vector<float> rows(values.size() * dim.size());
+      ar & boost::serialization::make_array(rows.data(), rows.size());
+      set_packed_values(rows);
+    }
   }
   BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
@@ -102,7 +175,8 @@ struct LookupParameters : public ParametersBase {
 // parameters know how to track their gradients, but any extra information (like velocity) will live here
 class Model {
  public:
-  Model() : gradient_norm_scratch() {}
+  // parameters are allocated from mem, or from ps if it is null
+  explicit Model(AlignedMemoryPool* mem = nullptr) : gradient_norm_scratch(), mem(mem), values_version() {}
   ~Model();
   float gradient_l2_norm() const;
   void reset_gradient();
@@ -112,6 +186,12 @@ class Model {
   // project weights so their L2 norm = radius
   void project_weights(float radius = 1.0f);
 
+  // changes whenever the values of the parameters do as a whole (each
+  // trainer update, a load), so caches of what was computed
+  // from them can tell when they are stale
+  unsigned version() const { return values_version; }
+  void values_changed() { ++values_version; }
+
   const std::vector<ParametersBase*>& all_parameters_list() const { return all_params; }
   const std::vector<Parameters*>& parameters_list() const { return params; }
   const std::vector<LookupParameters*>& lookup_parameters_list() const { return lookup_params; }
@@ -143,6 +223,7 @@ class Model {
     all_params.clear();
     for (auto p : params) all_params.push_back(p);
     for (auto p : lookup_params) all_params.push_back(p);
+    values_changed();
   }
   BOOST_SERIALIZATION_SPLIT_MEMBER()
 
@@ -150,6 +231,8 @@ class Model {
   std::vector<Parameters*> params;
   std::vector<LookupParameters*> lookup_params;
   mutable float* gradient_norm_scratch;
+  AlignedMemoryPool* mem;
+  std::atomic<unsigned> values_version;
 };
 
 void save_cnn_model(std::string filename, Model* model);
@@ -157,4 +240,7 @@ void load_cnn_model(std::string filename, Model* model);
 
 } // namespace cnn
 
+// version 1 saves the table as one block
+BOOST_CLASS_VERSION(cnn::LookupParameters, 1)
+
 #endif
@@ -5,16 +5,99 @@ using namespace boost::interprocess;
 namespace cnn {
   namespace mp {
     // TODO: Pass these around instead of having them be global
-    std::string queue_name = "cnn_mp_work_queue";
     std::string shared_memory_name = "cnn_mp_shared_memory";
     timespec start_time;
-    bool stop_requested = false;
+    std::atomic<bool> stop_requested(false);
     SharedObject* shared_object = nullptr;
+    WorkQueue* work_queue = nullptr;
 
-    std::string GenerateQueueName() {
+    /// XXX: Like GetSharedMemory, this is never freed
+    WorkQueue* WorkQueue::Create(unsigned num_children, unsigned capacity) {
+      assert (num_children > 0);
+      const size_t size = sizeof(WorkQueue) + num_children * sizeof(Slice) + capacity * sizeof(unsigned);
+      auto region = new mapped_region(anonymous_shared_memory(size));
+      WorkQueue* q = new (region->get_address()) WorkQueue(num_children, capacity);
+      static_assert(ATOMIC_INT_LOCK_FREE == 2, "the slices need lock-free atomics to be shared by processes");
+      for (unsigned cid = 0; cid < num_children; ++cid)
+        new (q->slices() + cid) Slice();
+      return q;
+    }
+
+    void WorkQueue::Fill(vector<unsigned>::const_iterator begin, vector<unsigned>::const_iterator end) {
+      const unsigned n = distance(begin, end);
+      assert (n <= capacity);
+      copy(begin, end, indices());
+      for (unsigned cid = 0; cid < num_children; ++cid) {
+        slices()[cid].begin = (unsigned long)n * cid / num_children;
+        slices()[cid].end = (unsigned long)n * (cid + 1) / num_children;
+      }
+    }
+
+    bool WorkQueue::Next(unsigned cid, vector<unsigned>& chunk, bool& stolen) {
+      stolen = false;
+      Slice& own = slices()[cid];
+      while (true) {
+        own.mutex.wait();
+        const unsigned left = own.end - own.begin;
+        if (left > 0) {
+          // large chunks while there is a lot left, single datums at the end
+          const unsigned size = max(1U, left / 4);
+          chunk.assign(indices() + own.begin, indices() + own.begin + size);
+          own.begin += size;
+          own.mutex.post();
+          return true;
+        }
+        own.mutex.post();
+        if (!Steal(cid)) return false;
+        stolen = true;
+      }
+    }
+
+    // Moves the back half of the slice with the most work left to the
+    // (empty) slice of child cid. Returns false if there was none.
+    bool WorkQueue::Steal(unsigned cid) {
+      while (true) {
+        // a guess, without locking, which is checked below. a slice may
+        // change between the two loads, so left can be off (or wrap)
+        unsigned victim = cid, most = 0;
+        for (unsigned v = 0; v < num_children; ++v) {
+          const unsigned begin = slices()[v].begin.load(), end = slices()[v].end.load();
+          const unsigned left = end > begin ? end - begin : 0;
+          if (v != cid && left > most) {
+            victim = v;
+            most = left;
+          }
+        }
+        if (victim == cid) return false;
+        Slice& s = slices()[victim];
+        s.mutex.wait();
+        const unsigned left = s.end - s.begin;
+        if (left == 0) {
+          s.mutex.post();
+          continue;
+        }
+        const unsigned mid = s.end - (left + 1) / 2;
+        const unsigned end = s.end;
+        s.end = mid;
+        s.mutex.post();
+        Slice& own = slices()[cid];
+        own.mutex.wait();
+        own.begin = mid;
+        own.end = end;
+        own.mutex.post();
+        return true;
+      }
+    }
+
+    std::string ThroughputString(const std::vector<ChildStats>& stats) {
       std::ostringstream ss;
-      ss << "cnn_mp_work_queue";
-      ss << rand();
+      ss << "datums/s by child:";
+      for (const ChildStats& s : stats)
+        ss << " " << (s.seconds > 0 ? s.datums / s.seconds : 0.0);
+      ss << " (steals:";
+      for (const ChildStats& s : stats)
+        ss << " " << s.steals;
+      ss << ")";
       return ss.str();
     }
 
@@ -41,6 +124,34 @@ namespace cnn {
       return ss.str();
     }
 
+    unsigned long ProportionalSetSizeKB(pid_t pid) {
+      // smaps_rollup needs Linux 4.14; without it, fall back to the RSS
+      std::ostringstream path;
+      path << "/proc/" << pid << "/smaps_rollup";
+      std::ifstream in(path.str());
+      std::string key = "Pss:";
+      if (!in) {
+        path.str("");
+        path << "/proc/" << pid << "/status";
+        in.open(path.str());
+        key = "VmRSS:";
+      }
+      std::string line;
+      while (getline(in, line)) {
+        if (line.compare(0, key.size(), key) == 0) {
+          return strtoul(line.c_str() + key.size(), nullptr, 10);
+        }
+      }
+      return 0;
+    }
+
+    std::string SummaryString(const std::string& backend, unsigned workers, double throughput, unsigned long memory_kb) {
+      std::ostringstream ss;
+      ss << "[mp] " << workers << " " << backend << ": " << throughput << " training datums/s, memory "
+         << memory_kb / 1024.0 << " MB";
+      return ss.str();
+    }
+
     unsigned SpawnChildren(std::vector<Workload>& workloads) {
       const unsigned num_children = workloads.size();
       assert (workloads.size() == num_children);
@@ -1,5 +1,6 @@
 #pragma once
 #include "cnn/cnn.h"
+#include "cnn/context.h"
 #include "cnn/training.h"
 #include "cnn/expr.h"
 #include "cnn/dict.h"
@@ -7,7 +8,6 @@
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/algorithm/string.hpp>
-#include <boost/interprocess/ipc/message_queue.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/sync/interprocess_semaphore.hpp>
@@ -24,14 +24,20 @@
 #include <sstream>
 #include <random>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace cnn {
   namespace mp {
     // TODO: Pass these around instead of having them be global
-    extern std::string queue_name;
     extern std::string shared_memory_name;
     extern timespec start_time;
-    extern bool stop_requested;
+    // may be set from a signal handler (std::atomic<bool> is lock-free)
+    extern std::atomic<bool> stop_requested;
 
     struct WorkloadHeader {
       bool is_dev_set;
@@ -55,6 +61,10 @@ namespace cnn {
       virtual ~ILearner() {}
       virtual S LearnFromDatum(const D& datum, bool learn) = 0;
       virtual void SaveModel() = 0;
+      // A learner for another thread of RunMultiThread: one that shares the
+      // parameters of this one but none of its other state (e.g., a copy
+      // of it). The process backend does not need it.
+      virtual ILearner* CloneForThread() { return nullptr; }
     };
 
     struct SharedObject {
@@ -65,6 +75,51 @@ namespace cnn {
     };
     extern SharedObject* shared_object;
 
+    // The indices of the data being processed, in shared memory. Each child
+    // has a slice of them. It takes chunks from the front of its slice,
+    // smaller ones as the slice empties, and once it is empty it steals the
+    // back half of the slice with the most work left. Children holding
+    // short sentences thus help the ones holding long sentences, and a
+    // child takes a lock about once per chunk rather than once per datum.
+    class WorkQueue {
+    public:
+      // shared memory for num_children slices of up to capacity indices
+      static WorkQueue* Create(unsigned num_children, unsigned capacity);
+      // Called by the parent, before the children start
+      void Fill(std::vector<unsigned>::const_iterator begin, std::vector<unsigned>::const_iterator end);
+      // Called by child cid: sets chunk to the next indices it should
+      // process, and returns false when there are none left
+      bool Next(unsigned cid, std::vector<unsigned>& chunk, bool& stolen);
+
+    private:
+      struct Slice {
+        Slice() : mutex(1), begin(0), end(0) {}
+        boost::interprocess::interprocess_semaphore mutex;
+        // positions in indices(). changed under mutex, but atomic since
+        // thieves read them without it to pick a victim (lock-free atomics
+        // also work across processes)
+        std::atomic<unsigned> begin, end;
+      };
+      WorkQueue(unsigned num_children, unsigned capacity) : num_children(num_children), capacity(capacity) {}
+      Slice* slices() { return reinterpret_cast<Slice*>(this + 1); }
+      unsigned* indices() { return reinterpret_cast<unsigned*>(slices() + num_children); }
+      bool Steal(unsigned cid);
+
+      unsigned num_children;
+      unsigned capacity;
+    };
+    extern WorkQueue* work_queue;
+
+    // What a child did with its share of a data set
+    struct ChildStats {
+      unsigned datums;
+      unsigned chunks;
+      unsigned steals;
+      double seconds;
+    };
+    // e.g. "datums/s by child: 210.5 198.2 (steals: 1 0)"
+    std::string ThroughputString(const std::vector<ChildStats>& stats);
+
     /// XXX: We never delete these objects
     template <class T>
     T* GetSharedMemory() {
@@ -95,7 +150,6 @@ namespace cnn {
       assert (err != -1);
     }
 
-    std::string GenerateQueueName();
     std::string GenerateSharedMemoryName();
 
     cnn::real SumValues(const std::vector<cnn::real>& values);
@@ -103,41 +157,35 @@ namespace cnn {
 
     std::string ElapsedTimeString(const timespec& start, const timespec& end);
 
+    // The memory of process pid, counting pages shared by n processes as
+    // 1/n of a page each (so that the sum over the children is meaningful)
+    unsigned long ProportionalSetSizeKB(pid_t pid);
+    // e.g. "[mp] 4 processes: 812.5 training datums/s, memory 530.1 MB"
+    std::string SummaryString(const std::string& backend, unsigned workers, double throughput, unsigned long memory_kb);
+
     unsigned SpawnChildren(std::vector<Workload>& workloads);
     std::vector<Workload> CreateWorkloads(unsigned num_children);
 
     // Called by the parent to process a chunk of data
     template <class S>
     S RunDataSet(std::vector<unsigned>::iterator begin, std::vector<unsigned>::iterator end, const std::vector<Workload>& workloads,
-        boost::interprocess::message_queue& mq, const WorkloadHeader& header) {
+        const WorkloadHeader& header, std::vector<ChildStats>& stats) {
       const unsigned num_children = workloads.size();
 
-      // Tell all the children to start up
+      // Share out the indices, then tell all the children to start up
+      work_queue->Fill(begin, end);
       for (unsigned cid = 0; cid < num_children; ++cid) {
         bool cont = true;
         Write(workloads[cid].p2c[1], cont);
         Write(workloads[cid].p2c[1], header);
       }
 
-      // Write all the indices to the queue for the children to process
-      for (auto curr = begin; curr != end; ++curr) {
-        unsigned i = *curr;
-        mq.send(&i, sizeof(i), 0);
-        if (stop_requested) {
-          break;
-        }
-      }
-
-      // Send a bunch of stop messages to the children
-      for (unsigned cid = 0; cid < num_children; ++cid) {
-        unsigned stop = -1U;
-        mq.send(&stop, sizeof(stop), (stop_requested ? 1 : 0));
-      }
-
       // Wait for each child to finish training its load
       std::vector<S> losses(num_children);
+      stats.resize(num_children);
       for(unsigned cid = 0; cid < num_children; ++cid) {
         losses[cid] = Read<S>(workloads[cid].c2p[0]);
+        stats[cid] = Read<ChildStats>(workloads[cid].c2p[0]);
       }
 
       S total_loss = S();
@@ -147,17 +195,23 @@ namespace cnn {
       return total_loss;
     }
 
-    template<class D, class S>
-    void RunParent(const std::vector<D>& train_data, const std::vector<D>& dev_data, ILearner<D, S>* learner,
-       std::vector<Workload>& workloads, unsigned num_iterations, unsigned dev_frequency, unsigned report_frequency) {
-      const unsigned num_children = workloads.size();
-      boost::interprocess::message_queue mq(boost::interprocess::open_or_create, queue_name.c_str(), 10000, sizeof(unsigned));
+    // The training loop of the parent: shuffles the training data every
+    // iteration, evaluates on the dev data every dev_frequency datums and
+    // saves the model when the dev loss improves. run_data_set(begin, end,
+    // header, stats) has the workers process a set of indices and returns
+    // their loss. Returns the training datums processed per second.
+    template<class D, class S, class RunSet>
+    double RunEpochs(const std::vector<D>& train_data, const std::vector<D>& dev_data, ILearner<D, S>* learner,
+        RunSet run_data_set, unsigned num_iterations, unsigned dev_frequency, unsigned report_frequency) {
       std::vector<unsigned> train_indices(train_data.size());
       std::iota(train_indices.begin(), train_indices.end(), 0);
 
       std::vector<unsigned> dev_indices(dev_data.size());
       std::iota(dev_indices.begin(), dev_indices.end(), 0);
 
+      std::vector<ChildStats> stats;
+      unsigned long train_datums = 0;
+      double train_seconds = 0;
       S best_dev_loss = S();
       bool first_dev_run = true;
       std::mt19937 rndeng(42);
@@ -174,15 +228,18 @@ namespace cnn {
             end = train_indices.end();
           }
           double fractional_iter = iter + 1.0 * distance(train_indices.begin(), end) / train_indices.size();
-          S batch_loss = RunDataSet<S>(begin, end, workloads, mq, {false, end == train_indices.end(), report_frequency});
+          auto start = std::chrono::steady_clock::now();
+          S batch_loss = run_data_set(begin, end, WorkloadHeader{false, end == train_indices.end(), report_frequency}, stats);
+          train_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+          for (const ChildStats& s : stats) train_datums += s.datums;
           train_loss += batch_loss;
-          std::cerr << fractional_iter << "\t" << "loss = " << batch_loss << std::endl;
+          std::cerr << fractional_iter << "\t" << "loss = " << batch_loss << "\t" << ThroughputString(stats) << std::endl;
 
           if (stop_requested) {
             break;
           }
 
-          S dev_loss = RunDataSet<S>(dev_indices.begin(), dev_indices.end(), workloads, mq, {true, false, report_frequency});
+          S dev_loss = run_data_set(dev_indices.begin(), dev_indices.end(), WorkloadHeader{true, false, report_frequency}, stats);
           bool new_best = (first_dev_run || dev_loss < best_dev_loss);
           first_dev_run = false;
           std::cerr << fractional_iter << "\t" << "dev loss = " << dev_loss << (new_best ? " (New best!)" : "") << std::endl;
@@ -197,6 +254,25 @@ namespace cnn {
           begin = end;
         }
       }
+      return train_seconds > 0 ? train_datums / train_seconds : 0.0;
+    }
+
+    template<class D, class S>
+    void RunParent(const std::vector<D>& train_data, const std::vector<D>& dev_data, ILearner<D, S>* learner,
+       std::vector<Workload>& workloads, unsigned num_iterations, unsigned dev_frequency, unsigned report_frequency) {
+      const unsigned num_children = workloads.size();
+      auto run_data_set = [&](std::vector<unsigned>::iterator begin, std::vector<unsigned>::iterator end,
+                              const WorkloadHeader& header, std::vector<ChildStats>& stats) {
+        return RunDataSet<S>(begin, end, workloads, header, stats);
+      };
+      double throughput = RunEpochs(train_data, dev_data, learner, run_data_set, num_iterations, dev_frequency, report_frequency);
+
+      // The children share the parameters, so count shared pages once
+      unsigned long memory_kb = ProportionalSetSizeKB(getpid());
+      for (unsigned cid = 0; cid < num_children; ++cid) {
+        memory_kb += ProportionalSetSizeKB(workloads[cid].pid);
+      }
+      std::cerr << SummaryString("processes", num_children, throughput, memory_kb) << std::endl;
 
       // Kill all children one by one and wait for them to exit
       for (unsigned cid = 0; cid < num_children; ++cid) {
@@ -206,16 +282,68 @@ namespace cnn {
       }
     }
 
+    // Processes the share of worker wid (a child process or a thread) of a
+    // data set, taking chunks of it from work_queue. Calls update() after
+    // each training datum.
+    template <class D, class S, class Update>
+    S ProcessWork(unsigned wid, ILearner<D, S>* learner, const WorkloadHeader& header,
+        const std::vector<D>& train_data, const std::vector<D>& dev_data, ChildStats& stats, Update update) {
+      S total_loss = S();
+      S batch_loss = S();
+      unsigned batch_counter = 0;
+      stats = ChildStats();
+      auto start = std::chrono::steady_clock::now();
+      std::vector<unsigned> chunk;
+      bool stolen;
+      while (!stop_requested && work_queue->Next(wid, chunk, stolen)) {
+        ++stats.chunks;
+        if (stolen) ++stats.steals;
+        for (unsigned i : chunk) {
+          assert (i < (header.is_dev_set ? dev_data.size() : train_data.size()));
+          const D& datum = (header.is_dev_set ? dev_data[i] : train_data[i]);
+          S datum_loss = learner->LearnFromDatum(datum, !header.is_dev_set);
+          total_loss += datum_loss;
+          batch_loss += datum_loss;
+          batch_counter++;
+          stats.datums++;
+
+          if (!header.is_dev_set) {
+            update();
+          }
+          if (batch_counter == header.report_frequency) {
+            if (wid == 0) {
+              std::cerr << (header.is_dev_set ? "dev" : "train") << " loss: " << batch_loss << std::endl;
+            }
+            batch_loss = S();
+            batch_counter = 0;
+          }
+        }
+      }
+      stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      return total_loss;
+    }
+
     template <class D, class S>
     int RunChild(unsigned cid, ILearner<D, S>* learner, Trainer* trainer,
         std::vector<Workload>& workloads, const std::vector<D>& train_data,
         const std::vector<D>& dev_data) {
       const unsigned num_children = workloads.size();
       assert (cid >= 0 && cid < num_children);
-      unsigned i;
-      unsigned priority;
-      unsigned long recvd_size;
-      boost::interprocess::message_queue mq(boost::interprocess::open_or_create, queue_name.c_str(), 10000, sizeof(unsigned));
+      // Child 0 applies the gradients accumulated by all the children
+      // after each of its datums, scaled by the number of datums since
+      auto update = [&]() {
+        bool do_update = cid == 0;
+        unsigned counter = 0;
+        shared_object->counter_mutex.wait();
+        counter = ++shared_object->counter;
+        if (do_update) { shared_object->counter = 0; }
+        shared_object->counter_mutex.post();
+        if (do_update) {
+          shared_object->update_mutex.wait();
+          trainer->update(1.0 / counter);
+          shared_object->update_mutex.post();
+        }
+      };
       while (true) {
         // Check if the parent wants us to exit
         bool cont = Read<bool>(workloads[cid].p2c[0]);
@@ -227,49 +355,15 @@ namespace cnn {
         WorkloadHeader header = Read<WorkloadHeader>(workloads[cid].p2c[0]);
 
         // Run the actual training loop
-        S total_loss = S();
-        S batch_loss = S();
-        unsigned batch_counter = 0;
-        while (true) {
-          mq.receive(&i, sizeof(unsigned), recvd_size, priority);
-          if (i == -1U) {
-            break;
-          }
-
-          assert (i < (header.is_dev_set ? dev_data.size() : train_data.size()));
-          const D& datum = (header.is_dev_set ? dev_data[i] : train_data[i]);
-          S datum_loss = learner->LearnFromDatum(datum, !header.is_dev_set);
-          total_loss += datum_loss;
-          batch_loss += datum_loss;
-          batch_counter++;
-
-          bool do_update = !header.is_dev_set && cid == 0;
-          unsigned counter = 0;
-          if (!header.is_dev_set) {
-            shared_object->counter_mutex.wait();
-            counter = ++shared_object->counter;
-            if (do_update) { shared_object->counter = 0; }
-            shared_object->counter_mutex.post();
-          }
-          if (do_update) {
-            shared_object->update_mutex.wait();
-            trainer->update(1.0 / counter); 
-            shared_object->update_mutex.post();
-          }
-          if (batch_counter == header.report_frequency) {
-            if (cid == 0) {
-              std::cerr << (header.is_dev_set ? "dev" : "train") << " loss: " << batch_loss << std::endl;
-            }
-            batch_loss = S();
-            batch_counter = 0;
-          }
-        }
+        ChildStats stats;
+        S total_loss = ProcessWork(cid, learner, header, train_data, dev_data, stats, update);
         if (header.end_of_epoch) {
           //trainer->update_epoch();
         }
 
         // Let the parent know that we're done and return the loss value
         Write(workloads[cid].c2p[1], total_loss);
+        Write(workloads[cid].c2p[1], stats);
       }
       return 0;
     }
@@ -278,11 +372,9 @@ namespace cnn {
     void RunMultiProcess(unsigned num_children, ILearner<D, S>* learner, Trainer* trainer, const std::vector<D>& train_data,
         const std::vector<D>& dev_data, unsigned num_iterations, unsigned dev_frequency, unsigned report_frequency) {
       assert (cnn::ps->is_shared());
-      queue_name = GenerateQueueName();
-      boost::interprocess::message_queue::remove(queue_name.c_str());
-      boost::interprocess::message_queue::remove(queue_name.c_str());
       shared_memory_name = GenerateSharedMemoryName();
       shared_object = GetSharedMemory<SharedObject>();
+      work_queue = WorkQueue::Create(num_children, std::max(train_data.size(), dev_data.size()));
       std::vector<Workload> workloads = CreateWorkloads(num_children);
       unsigned cid = SpawnChildren(workloads);
       if (cid < num_children) {
@@ -292,5 +384,122 @@ namespace cnn {
         RunParent(train_data, dev_data, learner, workloads, num_iterations, dev_frequency, report_frequency);
       }
     }
+
+    // How threads share the gradients they accumulate (see GradientLocks)
+    enum class ThreadUpdates {
+      kLockFree,  // dense gradients are added to without locks (but not while they are applied)
+      kStriped,  // every gradient is added to under the lock of its stripe
+    };
+
+    // The same training as RunMultiProcess, with a pool of threads in place
+    // of child processes. Every thread has its own learner (thread 0 uses
+    // learner, the others learner->CloneForThread()), its own
+    // ExecutionContext of context_mb megabytes for its graphs and its own
+    // random number stream; the parameters are shared. As with processes,
+    // thread 0 applies the accumulated gradients after each of its datums,
+    // holding the gradient locks, which keeps the other threads' backward
+    // passes from adding to the gradients meanwhile (in either mode). The
+    // parameters need not be in shared memory.
+    template<class D, class S>
+    void RunMultiThread(unsigned num_threads, ILearner<D, S>* learner, Trainer* trainer, const std::vector<D>& train_data,
+        const std::vector<D>& dev_data, unsigned num_iterations, unsigned dev_frequency, unsigned report_frequency,
+        ThreadUpdates updates = ThreadUpdates::kLockFree, unsigned context_mb = 128) {
+      assert (num_threads > 0);
+      std::vector<std::unique_ptr<ILearner<D, S>>> clones;
+      std::vector<ILearner<D, S>*> learners = {learner};
+      for (unsigned tid = 1; tid < num_threads; ++tid) {
+        clones.emplace_back(learner->CloneForThread());
+        if (!clones.back()) {
+          std::cerr << "RunMultiThread needs a learner that implements CloneForThread()" << std::endl;
+          abort();
+        }
+        learners.push_back(clones.back().get());
+      }
+      GradientLocks locks(updates == ThreadUpdates::kStriped);
+      gradient_locks = &locks;
+      work_queue = WorkQueue::Create(num_threads, std::max(train_data.size(), dev_data.size()));
+
+      // The parent bumps generation to start a data set; the threads count
+      // themselves in done when they have finished it
+      std::mutex m;
+      std::condition_variable start_cv, done_cv;
+      unsigned generation = 0, done = 0;
+      bool quit = false;
+      WorkloadHeader header = WorkloadHeader();
+      std::vector<S> losses(num_threads);
+      std::vector<ChildStats> thread_stats(num_threads);
+      std::atomic<unsigned> counter(0);
+
+      // Allocated up front, so that the first data set does not pay for it
+      std::vector<std::unique_ptr<ExecutionContext>> contexts;
+      for (unsigned tid = 0; tid < num_threads; ++tid) {
+        contexts.emplace_back(new ExecutionContext(context_mb));
+      }
+
+      auto work = [&](unsigned tid) {
+        set_thread_context(contexts[tid].get());
+        set_thread_rng_stream(tid + 1);
+        auto update = [&]() {
+          if (tid != 0) {
+            ++counter;
+            return;
+          }
+          const unsigned c = counter.exchange(0) + 1;
+          locks.lock_all();
+          trainer->update(1.0 / c);
+          locks.unlock_all();
+        };
+        unsigned seen = 0;
+        while (true) {
+          {
+            std::unique_lock<std::mutex> lock(m);
+            start_cv.wait(lock, [&]() { return quit || generation != seen; });
+            if (quit) break;
+            seen = generation;
+          }
+          losses[tid] = ProcessWork(tid, learners[tid], header, train_data, dev_data, thread_stats[tid], update);
+          std::lock_guard<std::mutex> lock(m);
+          if (++done == num_threads) done_cv.notify_one();
+        }
+        set_thread_context(nullptr);
+      };
+      std::vector<std::thread> threads;
+      for (unsigned tid = 0; tid < num_threads; ++tid) {
+        threads.emplace_back(work, tid);
+      }
+
+      auto run_data_set = [&](std::vector<unsigned>::iterator begin, std::vector<unsigned>::iterator end,
+                              const WorkloadHeader& h, std::vector<ChildStats>& stats) {
+        work_queue->Fill(begin, end);
+        {
+          std::lock_guard<std::mutex> lock(m);
+          header = h;
+          done = 0;
+          ++generation;
+        }
+        start_cv.notify_all();
+        std::unique_lock<std::mutex> lock(m);
+        done_cv.wait(lock, [&]() { return done == num_threads; });
+        stats = thread_stats;
+        S total_loss = S();
+        for (S& loss : losses) {
+          total_loss += loss;
+        }
+        return total_loss;
+      };
+      double throughput = RunEpochs(train_data, dev_data, learner, run_data_set, num_iterations, dev_frequency, report_frequency);
+      std::cerr << SummaryString(updates == ThreadUpdates::kStriped ? "threads (striped)" : "threads (lock-free)",
+                                 num_threads, throughput, ProportionalSetSizeKB(getpid())) << std::endl;
+
+      {
+        std::lock_guard<std::mutex> lock(m);
+        quit = true;
+      }
+      start_cv.notify_all();
+      for (auto& t : threads) {
+        t.join();
+      }
+      gradient_locks = nullptr;
+    }
   }
 }
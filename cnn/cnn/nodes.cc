@@ -506,7 +506,7 @@ void Reshape::backward_impl(const vector<const Tensor*>& xs,
   throw std::runtime_error("Reshape not yet implemented for CUDA");
 #else
   const Tensor reshaped(dEdxi.d, dEdf.v);
-  *dEdxi += *reshaped;
+  dEdxi.vec() += reshaped.vec();
 #endif
 }
 
@@ -705,8 +705,7 @@ void BlockDropout::forward_impl(const vector<const Tensor*>& xs, Tensor& fx) con
 #ifdef HAVE_CUDA
   throw std::runtime_error("BlockDropout not yet implemented for CUDA");
 #else
-  bernoulli_distribution distribution(1.0 - dropout_probability);
-  float block_multiplier = distribution(*rndeng)? 1.0 : 0.0;
+  float block_multiplier = thread_rng().uniform() < 1.0 - dropout_probability ? 1.0 : 0.0;
   block_multiplier = 
     dropout_probability == 1.0? 0.0 : block_multiplier / (1.0 - dropout_probability);
   if (dropout_probability > 1.0 || dropout_probability < 0.0) {
@@ -1156,7 +1155,6 @@ void Concatenate::backward_impl(const vector<const Tensor*>& xs,
 #endif
 }
 
-#define MAX_CONCAT_COLS_ARGS 512
 size_t ConcatenateColumns::aux_storage_size() const {
   return MAX_CONCAT_COLS_ARGS * sizeof(unsigned);
 }
@@ -1380,9 +1378,14 @@ void Softmax::backward_impl(const vector<const Tensor*>& xs,
 #endif
 }
 
+// logz of each batch element, for the backward pass
+size_t PickNegLogSoftmax::aux_storage_size() const {
+  return dim.batch_elems() * sizeof(float);
+}
+
 void PickNegLogSoftmax::forward_impl(const vector<const Tensor*>& xs, Tensor& fx) const {
   if (xs[0]->d.cols() == 1) {
-    logz = (float*)fxs->allocate(sizeof(float)*fx.d.batch_elems());
+    logz = static_cast<float*>(aux_mem);
 #if HAVE_CUDA
     if(pval) {
       gpu::pnlsoftmax(xs[0]->d.size(), *pval, xs[0]->v, fx.v, logz);
@@ -1864,8 +1867,13 @@ void AffineTransform::backward_impl(const vector<const Tensor*>& xs,
             xs[i+1]->batch_ptr(b), xs[i+1]->d.rows(),
             kSCALAR_ONE, dEdxi.batch_ptr(b), dEdxi.d.rows()));
 #else
-    for(int b = 0; b < max_b; ++b)
-      dEdxi.batch_matrix(b).noalias() += dEdf.batch_matrix(b) * xs[i+1]->batch_matrix(b).transpose();
+    // a batch of inputs to shared weights: one product for all of them
+    if(dEdxi.d.bd == 1 && dEdf.d.bd > 1 && xs[i+1]->d.bd == dEdf.d.bd) {
+      (*dEdxi).noalias() += dEdf.colbatch_matrix() * xs[i+1]->colbatch_matrix().transpose();
+    } else {
+      for(int b = 0; b < max_b; ++b)
+        dEdxi.batch_matrix(b).noalias() += dEdf.batch_matrix(b) * xs[i+1]->batch_matrix(b).transpose();
+    }
 #endif
   } else {  // right argument of matrix multiply
     int max_b = max(xs[i-1]->d.bd, dEdf.d.bd);
@@ -207,6 +207,8 @@ struct Reshape : public Node {
   explicit Reshape(const std::initializer_list<VariableIndex>& a, const Dim& to) : Node(a), to(to) {}
   std::string as_string(const std::vector<std::string>& arg_names) const override;
   Dim dim_forward(const std::vector<Dim>& xs) const override;
+  // to may move columns into the batch or back
+  virtual bool supports_multibatch() const override { return true; }
   void forward_impl(const std::vector<const Tensor*>& xs, Tensor& fx) const override;
   void backward_impl(const std::vector<const Tensor*>& xs,
                   const Tensor& fx,
@@ -487,6 +489,8 @@ struct Concatenate : public Node {
 
 // concatenate column vectors into a matrix
 // x_i must be a column vector in R^n
+// takes fewer than MAX_CONCAT_COLS_ARGS arguments (see concatenate_many_cols)
+#define MAX_CONCAT_COLS_ARGS 512
 struct ConcatenateColumns : public Node {
   template <typename T> explicit ConcatenateColumns(const T& a) : Node(a) {}
   std::string as_string(const std::vector<std::string>& arg_names) const override;
@@ -906,6 +910,7 @@ struct PickNegLogSoftmax : public Node {
                     const Tensor& dEdf,
                     unsigned i,
                     Tensor& dEdxi) const override;
+  size_t aux_storage_size() const override;
   mutable float* logz;
   unsigned val;
   const unsigned* pval;
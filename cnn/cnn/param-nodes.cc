@@ -143,16 +143,7 @@ void LookupNode::forward_impl(const vector<const Tensor*>& xs, Tensor& fx) const
   } else {
     assert (pindices);
     assert (fx.d.batch_elems() == pindices->size());
-    for (unsigned b = 0; b < pindices->size(); ++b) {
-      unsigned i = pindices->at(b);
-      assert (i < params->values.size());
-      float* v = fx.v + fx.d.batch_size() * (b % fx.d.batch_elems());
-#if HAVE_CUDA
-      cudaMemcpyAsync(v, params->values[i].v, fx.d.batch_size() * sizeof(float), cudaMemcpyDeviceToDevice);
-#else
-      memcpy(v, params->values[i].v, fx.d.batch_size() * sizeof(float));
-#endif
-    }
+    params->gather(*pindices, fx.v);
   }
 }
 
@@ -170,12 +161,8 @@ void LookupNode::accumulate_grad(const Tensor& g) {
     params->accumulate_grad(*pindex, g);
   } else {
     assert (pindices);
-    const vector<Tensor>& gb = g.batch_elems();
-    for (unsigned b = 0; b < pindices->size(); ++b) {
-      unsigned i = pindices->at(b);
-      assert (i < params->values.size());
-      params->accumulate_grad(i, gb[b]);
-    }
+    assert (g.d.batch_elems() == pindices->size());
+    params->scatter_add_grads(*pindices, g.v);
   }
 }
 
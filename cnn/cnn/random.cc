@@ -0,0 +1,147 @@
+#include "cnn/random.h"
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+using namespace std;
+
+namespace cnn {
+
+static unsigned global_seed = 0;
+static atomic<unsigned> next_stream(1);
+
+static inline uint64_t splitmix64(uint64_t& x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static inline uint32_t rotl(uint32_t x, int k) {
+  return (x << k) | (x >> (32 - k));
+}
+
+void RandomEngine::seed(uint64_t seed, uint64_t stream) {
+  uint64_t x = splitmix64(seed) ^ (stream * 0xD1B54A32D192ED03ULL);
+  for (unsigned l = 0; l < kLanes; ++l) {
+    for (unsigned j = 0; j < 4; j += 2) {
+      const uint64_t z = splitmix64(x);
+      s[j][l] = z;
+      s[j + 1][l] = z >> 32;
+    }
+    // the all-zero state is the one state xoshiro never leaves
+    if (!(s[0][l] | s[1][l] | s[2][l] | s[3][l])) s[0][l] = 1;
+  }
+}
+
+RandomEngine::result_type RandomEngine::operator()() {
+  const uint32_t r = s[0][0] + s[3][0];
+  const uint32_t t = s[1][0] << 9;
+  s[2][0] ^= s[0][0];
+  s[3][0] ^= s[1][0];
+  s[1][0] ^= s[2][0];
+  s[0][0] ^= s[3][0];
+  s[2][0] ^= t;
+  s[3][0] = rotl(s[3][0], 11);
+  return r;
+}
+
+// one step of every lane
+void RandomEngine::next_block(uint32_t* out) {
+  for (unsigned l = 0; l < kLanes; ++l) {
+    out[l] = s[0][l] + s[3][l];
+    const uint32_t t = s[1][l] << 9;
+    s[2][l] ^= s[0][l];
+    s[3][l] ^= s[1][l];
+    s[1][l] ^= s[2][l];
+    s[0][l] ^= s[3][l];
+    s[2][l] ^= t;
+    s[3][l] = rotl(s[3][l], 11);
+  }
+}
+
+void RandomEngine::fill_uniform(float* x, size_t n, float lo, float hi) {
+  const float scale = (hi - lo) * (1.f / (1 << 24));
+  uint32_t u[kLanes];
+  for (size_t i = 0; i < n; i += kLanes) {
+    next_block(u);
+    const size_t m = n - i < kLanes ? n - i : kLanes;
+    for (unsigned l = 0; l < m; ++l)
+      x[i + l] = lo + (u[l] >> 8) * scale;
+  }
+}
+
+void RandomEngine::fill_bernoulli(float* x, size_t n, float p, float scale) {
+  // u < p * 2^32, computed in 64 bits so that p = 1 keeps everything
+  const uint64_t threshold = (uint64_t)ldexp((double)p, 32);
+  uint32_t u[kLanes];
+  for (size_t i = 0; i < n; i += kLanes) {
+    next_block(u);
+    const size_t m = n - i < kLanes ? n - i : kLanes;
+    for (unsigned l = 0; l < m; ++l)
+      x[i + l] = u[l] < threshold ? scale : 0.f;
+  }
+}
+
+void RandomEngine::fill_normal(float* x, size_t n, float mean, float stddev) {
+  // Box-Muller: two uniforms give two normals
+  const float kTwoPi = 6.283185307179586f;
+  uint32_t u[kLanes], v[kLanes];
+  float a[kLanes], b[kLanes];
+  for (size_t i = 0; i < n; i += 2 * kLanes) {
+    next_block(u);
+    next_block(v);
+    for (unsigned l = 0; l < kLanes; ++l) {
+      // (0, 1], so the log is finite
+      const float r = sqrt(-2.f * log(((u[l] >> 8) + 1) * (1.f / (1 << 24))));
+      const float theta = kTwoPi * (v[l] >> 8) * (1.f / (1 << 24));
+      a[l] = mean + stddev * r * cos(theta);
+      b[l] = mean + stddev * r * sin(theta);
+    }
+    for (unsigned l = 0; l < kLanes && i + l < n; ++l) x[i + l] = a[l];
+    for (unsigned l = 0; l < kLanes && i + kLanes + l < n; ++l) x[i + kLanes + l] = b[l];
+  }
+}
+
+namespace {
+
+struct ThreadEngine {
+  ThreadEngine() : stream(next_stream++), engine(global_seed, stream) {}
+  unsigned stream;
+  RandomEngine engine;
+};
+
+thread_local unique_ptr<ThreadEngine> thread_engine;
+thread_local RandomEngine* current_engine = nullptr;  // null: thread_engine
+
+ThreadEngine& this_thread_engine() {
+  if (!thread_engine) thread_engine.reset(new ThreadEngine);
+  return *thread_engine;
+}
+
+} // namespace
+
+RandomEngine& thread_rng() {
+  return current_engine ? *current_engine : this_thread_engine().engine;
+}
+
+RandomEngine* swap_thread_rng(RandomEngine* e) {
+  RandomEngine* prev = current_engine;
+  current_engine = e;
+  return prev;
+}
+
+void set_thread_rng_stream(unsigned i) {
+  ThreadEngine& t = this_thread_engine();
+  t.stream = i;
+  t.engine.seed(global_seed, i);
+}
+
+void set_random_seed(unsigned seed) {
+  global_seed = seed;
+  next_stream = 1;
+  set_thread_rng_stream(0);
+}
+
+} // namespace cnn
@@ -1,12 +1,72 @@
 #ifndef CNN_EIGEN_RANDOM_H
 #define CNN_EIGEN_RANDOM_H
 
+#include <cstddef>
+#include <cstdint>
 #include <random>
 
 namespace cnn {
 
+// the engine the example programs use to shuffle their training data.
+// the library itself draws from thread_rng()
 extern std::mt19937* rndeng;
 
+// xoshiro128+ (Blackman and Vigna). it is a UniformRandomBitGenerator, so it
+// can be used with the std:: distributions. the bulk fills run kLanes
+// independent generators side by side, which the compiler turns into SIMD
+// code; single draws come from the first of them
+struct RandomEngine {
+  typedef uint32_t result_type;
+  static const unsigned kLanes = 8;
+
+  explicit RandomEngine(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+  // different streams of the same seed are independent
+  void seed(uint64_t seed, uint64_t stream = 0);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+  result_type operator()();
+  // uniform in [0, 1)
+  float uniform() { return ((*this)() >> 8) * (1.f / (1 << 24)); }
+
+  // x[0..n) uniform in [lo, hi)
+  void fill_uniform(float* x, size_t n, float lo, float hi);
+  // x[0..n) is scale with probability p, 0 otherwise
+  void fill_bernoulli(float* x, size_t n, float p, float scale);
+  // x[0..n) normal with the given mean and standard deviation
+  void fill_normal(float* x, size_t n, float mean, float stddev);
+
+ private:
+  void next_block(uint32_t* out);
+  uint32_t s[4][kLanes];
+};
+
+// the engine of the calling thread. the engine of stream i is seeded from
+// the cnn seed (--cnn-seed) and i, so a run is reproducible as long as the
+// same work is done by the same streams
+RandomEngine& thread_rng();
+// makes the calling thread use stream i (e.g., the id of a worker). threads
+// that don't call it are numbered in the order in which they first draw;
+// the thread that called Initialize is stream 0
+void set_thread_rng_stream(unsigned i);
+// makes the calling thread draw from e instead of its own engine (or from
+// its own one again, if e is null). returns what it drew from before
+RandomEngine* swap_thread_rng(RandomEngine* e);
+// makes the calling thread draw from e, if it is not null, until it goes
+// out of scope (exceptions included)
+struct ScopedThreadRng {
+  explicit ScopedThreadRng(RandomEngine* e) : swapped(e != nullptr), prev(swapped ? swap_thread_rng(e) : nullptr) {}
+  ~ScopedThreadRng() { if (swapped) swap_thread_rng(prev); }
+  ScopedThreadRng(const ScopedThreadRng&) = delete;
+  ScopedThreadRng& operator=(const ScopedThreadRng&) = delete;
+ private:
+  bool swapped;
+  RandomEngine* prev;
+};
+// sets the seed of all streams and makes the calling thread stream 0.
+// Initialize calls it, before other threads start drawing
+void set_random_seed(unsigned seed);
+
 } // namespace cnn
 
 #endif
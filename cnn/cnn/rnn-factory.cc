@@ -0,0 +1,35 @@
+#include "cnn/rnn-factory.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include "cnn/lstm.h"
+#include "cnn/fast-lstm.h"
+#include "cnn/gru.h"
+
+using namespace std;
+
+namespace cnn {
+
+RNNBuilder* NewRNNBuilder(const string& cell,
+                          unsigned layers,
+                          unsigned input_dim,
+                          unsigned hidden_dim,
+                          Model* model) {
+  if (cell == "lstm")
+    return new LSTMBuilder(layers, input_dim, hidden_dim, model);
+  if (cell == "fast-lstm")
+    return new FastLSTMBuilder(layers, input_dim, hidden_dim, model);
+  if (cell == "gru")
+    return new GRUBuilder(layers, input_dim, hidden_dim, model);
+  if (cell == "rnn")
+    return new SimpleRNNBuilder(layers, input_dim, hidden_dim, model);
+  cerr << "Unknown RNN cell type: " << cell << endl;
+  throw std::invalid_argument("unknown RNN cell type");
+}
+
+bool IsKnownRNNCell(const string& cell) {
+  return cell == "lstm" || cell == "fast-lstm" || cell == "gru" || cell == "rnn";
+}
+
+} // namespace cnn
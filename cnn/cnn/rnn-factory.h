@@ -0,0 +1,30 @@
+#ifndef CNN_RNN_FACTORY_H_
+#define CNN_RNN_FACTORY_H_
+
+#include <string>
+
+#include "cnn/rnn.h"
+
+namespace cnn {
+
+class Model;
+
+// creates a recurrent builder by name, so that programs can choose the cell
+// type at run time. known cells:
+//   lstm       LSTMBuilder
+//   fast-lstm  FastLSTMBuilder (diagonal cell-to-gate connections)
+//   gru        GRUBuilder (no cell state, one fewer gate)
+//   rnn        SimpleRNNBuilder
+// the caller owns the returned builder
+RNNBuilder* NewRNNBuilder(const std::string& cell,
+                          unsigned layers,
+                          unsigned input_dim,
+                          unsigned hidden_dim,
+                          Model* model);
+
+// true if NewRNNBuilder knows about this cell type
+bool IsKnownRNNCell(const std::string& cell);
+
+} // namespace cnn
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "cnn/nodes.h"
 #include "cnn/expr.h"
+#include "cnn/random.h"
 
 using namespace std;
 using namespace cnn::expr;
@@ -18,6 +19,12 @@ enum { X2H=0, H2H, HB, L2H };
 
 RNNBuilder::~RNNBuilder() {}
 
+vector<float> sample_dropout_mask(unsigned n, float p) {
+  vector<float> mask(n);
+  thread_rng().fill_bernoulli(mask.data(), n, 1.f - p, 1.f / (1.f - p));
+  return mask;
+}
+
 SimpleRNNBuilder::SimpleRNNBuilder(unsigned layers,
                        unsigned input_dim,
                        unsigned hidden_dim,
@@ -92,6 +92,11 @@ struct RNNBuilder {
   std::vector<RNNPointer> head; // head[i] returns the head position
 };
 
+// variational dropout (Gal and Ghahramani, 2016) drops the same units at
+// every step of a sequence. this samples the mask for n units: 1 / (1 - p)
+// for the units that are kept, 0 for the ones that are dropped
+std::vector<float> sample_dropout_mask(unsigned n, float p);
+
 struct SimpleRNNBuilder : public RNNBuilder {
   SimpleRNNBuilder() = default;
   explicit SimpleRNNBuilder(unsigned layers,
@@ -14,9 +14,7 @@ void OrthonormalRandom(unsigned dd, float g, Tensor& x) {
   Tensor t;
   t.d = Dim({dd, dd});
   t.v = new float[dd * dd];
-  normal_distribution<float> distribution(0, 0.01);
-  auto b = [&] () {return distribution(*rndeng);};
-  generate(t.v, t.v + dd*dd, b);
+  thread_rng().fill_normal(t.v, dd * dd, 0, 0.01);
   Eigen::JacobiSVD<Eigen::MatrixXf> svd(*t, Eigen::ComputeFullU);
   *x = svd.matrixU();
   delete[] t.v;
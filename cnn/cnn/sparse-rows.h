@@ -0,0 +1,69 @@
+#ifndef CNN_SPARSE_ROWS_H_
+#define CNN_SPARSE_ROWS_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace cnn {
+
+// a set of the rows of a table (e.g., the rows of a lookup table whose
+// gradients may be nonzero): a bitmap with a bit per row, for constant time
+// insertion and lookup, and the list of the rows in the set, so that
+// iterating and clearing cost in proportion to the rows in it.
+// iteration is in increasing row order; the list is sorted on demand
+struct SparseRowTracker {
+  typedef std::vector<unsigned>::const_iterator const_iterator;
+
+  explicit SparseRowTracker(unsigned n = 0) : n(n), bits((n + 63) / 64), sorted(true) {}
+
+  // returns whether i was not in the set
+  bool insert(unsigned i) {
+    assert(i < n);
+    uint64_t& w = bits[i >> 6];
+    const uint64_t m = uint64_t(1) << (i & 63);
+    if (w & m) return false;
+    w |= m;
+    if (!rows.empty() && i < rows.back()) sorted = false;
+    rows.push_back(i);
+    return true;
+  }
+  unsigned count(unsigned i) const {
+    assert(i < n);
+    return (bits[i >> 6] >> (i & 63)) & 1;
+  }
+  // adds the rows of other, e.g., ones touched by another thread
+  void merge(const SparseRowTracker& other) {
+    assert(other.n == n);
+    for (unsigned i : other.rows) insert(i);
+  }
+  void clear() {
+    for (unsigned i : rows) bits[i >> 6] = 0;
+    rows.clear();
+    sorted = true;
+  }
+  size_t size() const { return rows.size(); }
+  bool empty() const { return rows.empty(); }
+  unsigned capacity() const { return n; }
+
+  // sorting the list makes these unsafe to call from several threads at
+  // once; call sort() first if that's needed
+  const_iterator begin() const { sort(); return rows.begin(); }
+  const_iterator end() const { return rows.end(); }
+  void sort() const {
+    if (sorted) return;
+    std::sort(rows.begin(), rows.end());
+    sorted = true;
+  }
+
+ private:
+  unsigned n;  // rows in the table
+  std::vector<uint64_t> bits;
+  mutable std::vector<unsigned> rows;
+  mutable bool sorted;
+};
+
+} // namespace cnn
+
+#endif
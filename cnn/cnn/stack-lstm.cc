@@ -0,0 +1,241 @@
+#include "cnn/stack-lstm.h"
+
+#include <cassert>
+#include <stdexcept>
+#include <vector>
+
+#include "cnn/nodes.h"
+#include "cnn/lstm.h"
+#include "cnn/gru.h"
+#include "cnn/rnn-factory.h"
+
+using namespace std;
+using namespace cnn::expr;
+
+namespace cnn {
+
+// same layouts as LSTMBuilder::params and GRUBuilder::params
+enum { X2I, H2I, C2I, BI, X2O, H2O, C2O, BO, X2C, H2C, BC };
+enum { X2Z, H2Z, BZ, X2R, H2R, BR, X2H, H2H, BH };
+
+StackLSTMBuilder::StackLSTMBuilder(unsigned layers,
+                                   unsigned input_dim,
+                                   unsigned hidden_dim,
+                                   Model* model) :
+    StackLSTMBuilder("lstm", layers, input_dim, hidden_dim, model) {}
+
+StackLSTMBuilder::StackLSTMBuilder(const string& cell,
+                                   unsigned layers,
+                                   unsigned input_dim,
+                                   unsigned hidden_dim,
+                                   Model* model) :
+    rnn(NewRNNBuilder(cell, layers, input_dim, hidden_dim, model)),
+    lstm(dynamic_cast<LSTMBuilder*>(rnn.get())),
+    gru(dynamic_cast<GRUBuilder*>(rnn.get())),
+    pcg(nullptr), eager(false), layers(layers), hidden_dim(hidden_dim) {}
+
+void StackLSTMBuilder::new_graph(ComputationGraph& cg, bool inference) {
+  pcg = &cg;
+#if HAVE_CUDA
+  // parameter values live on the device, so always build the graph
+  eager = false;
+#else
+  eager = inference && (lstm || gru);
+#endif
+  // the eager path reads the parameter values directly and does not need
+  // them in the graph
+  if (!eager) rnn->new_graph(cg);
+  start_new_sequence();
+}
+
+void StackLSTMBuilder::start_new_sequence() {
+  if (!eager) rnn->start_new_sequence();
+  stack.clear();
+  free_slots.clear();
+  for (unsigned i = slots.size(); i > 0; --i)
+    free_slots.push_back(i - 1);
+}
+
+unsigned StackLSTMBuilder::new_slot() {
+  if (free_slots.empty()) {
+    slots.push_back(Slot());
+    return slots.size() - 1;
+  }
+  unsigned si = free_slots.back();
+  free_slots.pop_back();
+  return si;
+}
+
+void StackLSTMBuilder::push(const Expression& x) {
+  push_impl(x, nullptr);
+}
+
+void StackLSTMBuilder::push(const Expression& x, const Tensor& folded_x) {
+  assert(folded_x.d.size() == 3 * hidden_dim);
+  push_impl(x, folded_x.v);
+}
+
+void StackLSTMBuilder::push_impl(const Expression& x, const float* folded_x) {
+  const unsigned si = new_slot();
+  Slot& s = slots[si];
+  const Slot* prev = stack.empty() ? nullptr : &slots[stack.back()];
+  s.input = x;
+  if (eager) {
+    // x is only read by the first layer, which has it folded if folded_x is set
+    if (!folded_x) x_scratch = x.value().vec();
+    if (lstm)
+      eager_lstm_step(prev, x_scratch, folded_x, s);
+    else
+      eager_gru_step(prev, x_scratch, folded_x, s);
+    s.output = Expression();
+  } else {
+    // the output, with the cell's output dropout
+    s.output = rnn->add_input(prev ? prev->state : RNNPointer(-1), x);
+    s.state = rnn->state();
+  }
+  stack.push_back(si);
+}
+
+void StackLSTMBuilder::pop() {
+  assert(!stack.empty());
+  free_slots.push_back(stack.back());
+  stack.pop_back();
+}
+
+Expression StackLSTMBuilder::top() {
+  assert(!stack.empty());
+  Slot& s = slots[stack.back()];
+  if (!eager) return s.output;
+  if (!s.output.pg) {
+    const Eigen::VectorXf& h = s.h.back();
+    s.output = input(*pcg, {hidden_dim}, vector<float>(h.data(), h.data() + h.size()));
+  }
+  return s.output;
+}
+
+Expression StackLSTMBuilder::top_input() const {
+  assert(!stack.empty());
+  return slots[stack.back()].input;
+}
+
+void StackLSTMBuilder::set_dropout(float d) {
+  if (lstm)
+    lstm->set_dropout(d);
+  else if (gru)
+    gru->set_dropout(d);
+  else if (d > 0)
+    throw std::invalid_argument("StackLSTMBuilder: dropout is only supported by lstm and gru cells");
+}
+
+void StackLSTMBuilder::set_variational_dropout(float d) {
+  if (lstm)
+    lstm->set_variational_dropout(d);
+  else if (gru)
+    gru->set_variational_dropout(d);
+  else if (d > 0)
+    throw std::invalid_argument("StackLSTMBuilder: dropout is only supported by lstm and gru cells");
+}
+
+void StackLSTMBuilder::disable_dropout() {
+  if (lstm) lstm->disable_dropout();
+  if (gru) gru->disable_dropout();
+}
+
+static Eigen::VectorXf eager_logistic(const Eigen::VectorXf& a) {
+  return (1.f + (-a.array()).exp()).inverse().matrix();
+}
+
+typedef Eigen::Map<const Eigen::VectorXf> ConstVectorMap;
+
+void StackLSTMBuilder::fold_inputs(const LookupParameters& inputs, LookupParameters* table) const {
+  assert(can_fold_inputs());
+  assert(table->values.size() == inputs.values.size());
+  assert(table->dim.size() == 3 * hidden_dim);
+  const vector<Parameters*>& p = lstm ? lstm->params[0] : gru->params[0];
+  // rows are [i; c; o] for lstm and [z; r; h] for gru
+  const unsigned g1x = lstm ? +X2I : +X2Z, g1b = lstm ? +BI : +BZ;
+  const unsigned g2x = lstm ? +X2C : +X2R, g2b = lstm ? +BC : +BR;
+  const unsigned g3x = lstm ? +X2O : +X2H, g3b = lstm ? +BO : +BH;
+  for (unsigned i = 0; i < inputs.values.size(); ++i) {
+    auto x = inputs.values[i].vec();
+    auto y = table->values[i].vec();
+    y.segment(0, hidden_dim) = p[g1b]->values.vec() + *p[g1x]->values * x;
+    y.segment(hidden_dim, hidden_dim) = p[g2b]->values.vec() + *p[g2x]->values * x;
+    y.segment(2 * hidden_dim, hidden_dim) = p[g3b]->values.vec() + *p[g3x]->values * x;
+  }
+}
+
+// the same recurrence as LSTMBuilder::add_input_impl, without dropout
+void StackLSTMBuilder::eager_lstm_step(const Slot* prev, const Eigen::VectorXf& x, const float* folded_x, Slot& out) const {
+  out.h.resize(layers);
+  out.c.resize(layers);
+  const Eigen::VectorXf* in = &x;
+  for (unsigned i = 0; i < layers; ++i) {
+    const vector<Parameters*>& p = lstm->params[i];
+    Eigen::VectorXf& ht = out.h[i];
+    Eigen::VectorXf& ct = out.c[i];
+    Eigen::VectorXf ait, awt, aot;
+    if (i == 0 && folded_x) {
+      ait = ConstVectorMap(folded_x, hidden_dim);
+      awt = ConstVectorMap(folded_x + hidden_dim, hidden_dim);
+      aot = ConstVectorMap(folded_x + 2 * hidden_dim, hidden_dim);
+    } else {
+      ait = p[BI]->values.vec() + *p[X2I]->values * *in;
+      awt = p[BC]->values.vec() + *p[X2C]->values * *in;
+      aot = p[BO]->values.vec() + *p[X2O]->values * *in;
+    }
+    if (prev) {
+      const Eigen::VectorXf& h_tm1 = prev->h[i];
+      const Eigen::VectorXf& c_tm1 = prev->c[i];
+      ait.noalias() += *p[H2I]->values * h_tm1;
+      ait.noalias() += *p[C2I]->values * c_tm1;
+      awt.noalias() += *p[H2C]->values * h_tm1;
+      aot.noalias() += *p[H2O]->values * h_tm1;
+      Eigen::VectorXf it = eager_logistic(ait);
+      ct = (1.f - it.array()) * c_tm1.array() + it.array() * awt.array().tanh();
+    } else {
+      ct = eager_logistic(ait).array() * awt.array().tanh();
+    }
+    aot.noalias() += *p[C2O]->values * ct;
+    ht = eager_logistic(aot).array() * ct.array().tanh();
+    in = &ht;
+  }
+}
+
+// the same recurrence as GRUBuilder::add_input_impl
+void StackLSTMBuilder::eager_gru_step(const Slot* prev, const Eigen::VectorXf& x, const float* folded_x, Slot& out) const {
+  out.h.resize(layers);
+  const Eigen::VectorXf* in = &x;
+  for (unsigned i = 0; i < layers; ++i) {
+    const vector<Parameters*>& p = gru->params[i];
+    Eigen::VectorXf& ht = out.h[i];
+    const bool folded = (i == 0 && folded_x);
+    Eigen::VectorXf azt, act;
+    if (folded) {
+      azt = ConstVectorMap(folded_x, hidden_dim);
+      act = ConstVectorMap(folded_x + 2 * hidden_dim, hidden_dim);
+    } else {
+      azt = p[BZ]->values.vec() + *p[X2Z]->values * *in;
+      act = p[BH]->values.vec() + *p[X2H]->values * *in;
+    }
+    if (prev) {
+      const Eigen::VectorXf& h_tm1 = prev->h[i];
+      Eigen::VectorXf art;
+      if (folded)
+        art = ConstVectorMap(folded_x + hidden_dim, hidden_dim);
+      else
+        art = p[BR]->values.vec() + *p[X2R]->values * *in;
+      art.noalias() += *p[H2R]->values * h_tm1;
+      azt.noalias() += *p[H2Z]->values * h_tm1;
+      Eigen::VectorXf ght = eager_logistic(art).cwiseProduct(h_tm1);
+      act.noalias() += *p[H2H]->values * ght;
+      Eigen::VectorXf zt = eager_logistic(azt);
+      ht = (1.f - zt.array()) * h_tm1.array() + zt.array() * act.array().tanh();
+    } else {
+      ht = eager_logistic(azt).array() * act.array().tanh();
+    }
+    in = &ht;
+  }
+}
+
+} // namespace cnn
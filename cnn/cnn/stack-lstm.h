@@ -0,0 +1,106 @@
+#ifndef CNN_STACK_LSTM_H_
+#define CNN_STACK_LSTM_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cnn/cnn.h"
+#include "cnn/rnn.h"
+#include "cnn/expr.h"
+
+using namespace cnn::expr;
+
+namespace cnn {
+
+class Model;
+struct LSTMBuilder;
+struct GRUBuilder;
+
+// an LSTM that summarizes the contents of a stack (Dyer et al., 2015). the
+// summary of the stack is the LSTM state that was current when the top
+// element was pushed, so pop() just goes back to the state below it.
+//
+// states live in an arena of slots, and the slots of popped states are
+// reused by later pushes. when training, the recurrence is built in the
+// computation graph as usual (backprop needs every state). in inference mode
+// the recurrence of lstm and gru cells is evaluated eagerly outside of the
+// graph, so popped states leave nothing behind and neither the builder nor
+// the graph grow with the number of transitions.
+struct StackLSTMBuilder {
+  StackLSTMBuilder() = default;
+  explicit StackLSTMBuilder(unsigned layers,
+                            unsigned input_dim,
+                            unsigned hidden_dim,
+                            Model* model);
+  // cell is any type known to NewRNNBuilder
+  explicit StackLSTMBuilder(const std::string& cell,
+                            unsigned layers,
+                            unsigned input_dim,
+                            unsigned hidden_dim,
+                            Model* model);
+
+  // call this when working with a newly created ComputationGraph. if
+  // inference is true, no gradients can flow into the LSTM parameters.
+  void new_graph(ComputationGraph& cg, bool inference = false);
+  // empties the stack
+  void start_new_sequence();
+
+  void push(const Expression& x);
+  // the same, with the first layer's input projections of x read from a row
+  // of a table made by fold_inputs (only used when evaluating eagerly)
+  void push(const Expression& x, const Tensor& folded_x);
+  void pop();
+  // summary of the whole stack (the output of the deepest layer)
+  Expression top();
+  // the element that was pushed last
+  Expression top_input() const;
+  unsigned size() const { return stack.size(); }
+  bool empty() const { return stack.empty(); }
+
+  // dropout of the lstm or gru cell; throws for the other cells, unless d
+  // is 0. the eager evaluation of inference mode drops nothing. variational
+  // masks are sampled by new_graph and start_new_sequence
+  void set_dropout(float d);
+  void set_variational_dropout(float d);
+  void disable_dropout();
+
+  // true for the cells that fold_inputs supports (lstm and gru)
+  bool can_fold_inputs() const { return lstm || gru; }
+  // fills row i of table ({3 * hidden_dim} per row) with the input
+  // projections of the first layer, biases included, for input row i, so
+  // inputs that come from a lookup don't need them computed at every push
+  void fold_inputs(const LookupParameters& inputs, LookupParameters* table) const;
+
+  // holds the parameters, and the graph states when training
+  std::unique_ptr<RNNBuilder> rnn;
+
+ private:
+  struct Slot {
+    Expression input;
+    RNNPointer state;  // training: position of the state in rnn
+    std::vector<Eigen::VectorXf> h, c;  // inference: state of each layer
+    Expression output;  // training: what rnn returned; inference: h.back() in the graph, made on demand
+  };
+  unsigned new_slot();
+  void push_impl(const Expression& x, const float* folded_x);
+  void eager_lstm_step(const Slot* prev, const Eigen::VectorXf& x, const float* folded_x, Slot& out) const;
+  void eager_gru_step(const Slot* prev, const Eigen::VectorXf& x, const float* folded_x, Slot& out) const;
+
+  // non-null if rnn has a cell that can be evaluated eagerly
+  LSTMBuilder* lstm = nullptr;
+  GRUBuilder* gru = nullptr;
+
+  ComputationGraph* pcg = nullptr;
+  bool eager = false;
+  std::vector<Slot> slots;
+  std::vector<unsigned> free_slots;
+  std::vector<unsigned> stack;  // slot indices, top of stack is last
+  Eigen::VectorXf x_scratch;
+  unsigned layers = 0;
+  unsigned hidden_dim = 0;
+};
+
+} // namespace cnn
+
+#endif
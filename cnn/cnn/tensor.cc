@@ -107,15 +107,13 @@ void TensorTools::Zero(Tensor& d) {
 }
 
 void TensorTools::Randomize(Tensor& val, real scale) {
-  uniform_real_distribution<real> distribution(-scale,scale);
-  auto b = [&] {return distribution(*rndeng);};
 #if HAVE_CUDA
   float* t = new float[val.d.size()];
-  generate(t, t + val.d.size(), b);
+  thread_rng().fill_uniform(t, val.d.size(), -scale, scale);
   CUDA_CHECK(cudaMemcpy(val.v, t, sizeof(real) * val.d.size(), cudaMemcpyHostToDevice));
   delete[] t;
 #else
-  generate(val.v, val.v + val.d.size(), b);
+  thread_rng().fill_uniform(val.v, val.d.size(), -scale, scale);
 #endif
 }
 
@@ -124,34 +122,29 @@ void TensorTools::Randomize(Tensor& d) {
 }
 
 void TensorTools::RandomBernoulli(Tensor& val, real p, real scale) {
-  bernoulli_distribution distribution(p);
-  auto b = [&] {return distribution(*rndeng) * scale;};
 #if HAVE_CUDA
   float* t = new float[val.d.size()];
-  generate(t, t + val.d.size(), b);
+  thread_rng().fill_bernoulli(t, val.d.size(), p, scale);
   CUDA_CHECK(cudaMemcpy(val.v, t, sizeof(real) * val.d.size(), cudaMemcpyHostToDevice));
   delete[] t;
 #else
-  generate(val.v, val.v + val.d.size(), b);
+  thread_rng().fill_bernoulli(val.v, val.d.size(), p, scale);
 #endif
 }
 
 void TensorTools::RandomizeNormal(real mean, real stddev, Tensor& val) {
-  normal_distribution<real> distribution(mean, stddev);
-  auto b = [&] {return distribution(*rndeng);};
 #if HAVE_CUDA
   float* t = new float[val.d.size()];
-  generate(t, t + val.d.size(), b);
+  thread_rng().fill_normal(t, val.d.size(), mean, stddev);
   CUDA_CHECK(cudaMemcpy(val.v, t, sizeof(real) * val.d.size(), cudaMemcpyHostToDevice));
   delete[] t;
 #else
-  generate(val.v, val.v + val.d.size(), b);
+  thread_rng().fill_normal(val.v, val.d.size(), mean, stddev);
 #endif
 }
 
 real rand01() {
-  uniform_real_distribution<real> distribution(0, 1);
-  return distribution(*rndeng);
+  return thread_rng().uniform();
 }
 
 int rand0n(int n) {
@@ -163,7 +156,7 @@ int rand0n(int n) {
 
 real rand_normal() {
   normal_distribution<real> distribution(0, 1);
-  return distribution(*rndeng);
+  return distribution(thread_rng());
 }
 
 } // namespace cnn
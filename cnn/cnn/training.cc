@@ -56,6 +56,7 @@ void SimpleSGDTrainer::update(const std::vector<LookupParameters*> &lookup_param
     p->clear();
   }
   ++updates;
+  model->values_changed();
 }
 
 void MomentumSGDTrainer::update(real scale) {
@@ -88,6 +89,7 @@ void MomentumSGDTrainer::update(real scale) {
     p->clear();
   }
   ++updates;
+  model->values_changed();
 }
 
 void AdagradTrainer::update(real scale) {
@@ -127,6 +129,7 @@ void AdagradTrainer::update(real scale) {
   }
 
   ++updates;
+  model->values_changed();
 }
 
 void AdadeltaTrainer::update(real scale) {
@@ -199,6 +202,7 @@ void AdadeltaTrainer::update(real scale) {
     pi++;
   }
   ++updates;
+  model->values_changed();
 }
 
 void RmsPropTrainer::update(real scale) {
@@ -239,6 +243,7 @@ void RmsPropTrainer::update(real scale) {
     p->clear();
   }
   ++updates;
+  model->values_changed();
 }
 
 void AdamTrainer::update(real scale) {
@@ -296,6 +301,7 @@ void AdamTrainer::update(real scale) {
     pi++;
   }
   ++updates;
+  model->values_changed();
 }
 
 } // namespace cnn
@@ -41,7 +41,8 @@ vector<Datum> ReadData(string filename) {
 template<class T, class D>
 class Learner : public ILearner<D, cnn::real> {
 public:
-  explicit Learner(RNNLanguageModel<T>& rnnlm, unsigned data_size) : rnnlm(rnnlm) {}
+  // the copy of rnnlm shares its parameters
+  explicit Learner(const RNNLanguageModel<T>& rnnlm, unsigned data_size) : rnnlm(rnnlm) {}
   ~Learner() {}
 
   cnn::real LearnFromDatum(const D& datum, bool learn) {
@@ -56,13 +57,15 @@ public:
 
   void SaveModel() {}
 
+  Learner* CloneForThread() { return new Learner(*this); }
+
 private:
-  RNNLanguageModel<T>& rnnlm;
+  RNNLanguageModel<T> rnnlm;
 };
 
 int main(int argc, char** argv) {
   if (argc < 4) {
-    cerr << "Usage: " << argv[0] << " cores corpus.txt dev.txt [iterations]" << endl;
+    cerr << "Usage: " << argv[0] << " cores corpus.txt dev.txt [iterations [fork|threads|threads-striped]]" << endl;
     return 1;
   }
   srand(time(NULL));
@@ -71,10 +74,16 @@ int main(int argc, char** argv) {
   vector<Datum> data = ReadData(argv[2]);
   vector<Datum> dev_data = ReadData(argv[3]);
   unsigned num_iterations = (argc >= 5) ? atoi(argv[4]) : UINT_MAX;
+  string backend = (argc >= 6) ? argv[5] : "fork";
+  if (backend != "fork" && backend != "threads" && backend != "threads-striped") {
+    cerr << "ERROR: Unknown backend " << backend << endl;
+    return 1;
+  }
   unsigned dev_frequency = 5000;
   unsigned report_frequency = 10;
 
-  cnn::Initialize(argc, argv, 1, true);
+  // only child processes need the parameters in shared memory
+  cnn::Initialize(argc, argv, 1, backend == "fork");
 
   Model model;
   SimpleSGDTrainer sgd(&model, 0.0, 0.2);
@@ -84,5 +93,10 @@ int main(int argc, char** argv) {
   RNNLanguageModel<LSTMBuilder> rnnlm(model);
 
   Learner<LSTMBuilder, Datum> learner(rnnlm, data.size());
-  RunMultiProcess<Datum>(num_children, &learner, &sgd, data, dev_data, num_iterations, dev_frequency, report_frequency);
+  if (backend == "fork") {
+    RunMultiProcess<Datum>(num_children, &learner, &sgd, data, dev_data, num_iterations, dev_frequency, report_frequency);
+  } else {
+    ThreadUpdates updates = (backend == "threads") ? ThreadUpdates::kLockFree : ThreadUpdates::kStriped;
+    RunMultiThread<Datum>(num_children, &learner, &sgd, data, dev_data, num_iterations, dev_frequency, report_frequency, updates);
+  }
 }
@@ -5,6 +5,7 @@
 #include "cnn/rnn.h"
 #include "cnn/gru.h"
 #include "cnn/lstm.h"
+#include "cnn/bilstm-encoder.h"
 #include "cnn/dict.h"
 #include "cnn/expr.h"
 
@@ -167,47 +168,35 @@ struct BinnedDurationEmbedding : public DurationEmbedding {
   LookupParameters* p_e;
 };
 
-template <class Builder>
 struct BiTrans {
-  Builder l2rbuilder;
-  Builder r2lbuilder;
+  BiLSTMEncoder bilstm;
   Parameters* p_f2c;
   Parameters* p_r2c;
   Parameters* p_cb;
 
   explicit BiTrans(Model& model) :
-      l2rbuilder(LAYERS, INPUT_DIM, XCRIBE_DIM, &model),
-      r2lbuilder(LAYERS, INPUT_DIM, XCRIBE_DIM, &model) {
+      bilstm(LAYERS, INPUT_DIM, XCRIBE_DIM, &model) {
     p_f2c = model.add_parameters({XCRIBE_DIM, XCRIBE_DIM});
     p_r2c = model.add_parameters({XCRIBE_DIM, XCRIBE_DIM});
     p_cb = model.add_parameters({XCRIBE_DIM});
   }
 
   vector<Expression> transcribe(ComputationGraph& cg, const vector<Expression>& x) {
-    l2rbuilder.new_graph(cg);
+    bilstm.new_graph(cg);
     if(use_dropout){
-      l2rbuilder.set_dropout(dropout_rate);
+      bilstm.set_dropout(dropout_rate);
     }else{
-      l2rbuilder.disable_dropout();
+      bilstm.disable_dropout();
     }
-    l2rbuilder.start_new_sequence();
-    r2lbuilder.new_graph(cg);
-    if(use_dropout){
-      r2lbuilder.set_dropout(dropout_rate);
-    }else{
-      r2lbuilder.disable_dropout();
-    }
-    r2lbuilder.start_new_sequence();
     Expression f2c = parameter(cg, p_f2c);
     Expression r2c = parameter(cg, p_r2c);
     Expression cb = parameter(cg, p_cb);
 
     const int len = x.size();
-    vector<Expression> fwd(len), rev(len), res(len);
-    for (int i = 0; i < len; ++i)
-      fwd[i] = l2rbuilder.add_input(x[i]);
-    for (int i = len - 1; i >= 0; --i)
-      rev[i] = r2lbuilder.add_input(x[i]);
+    vector<Expression> res(len);
+    bilstm.encode(x);
+    const vector<Expression>& fwd = bilstm.forward_states();
+    const vector<Expression>& rev = bilstm.backward_states();
     for (int i = 0; i < len; ++i)
       res[i] = affine_transform({cb, f2c, fwd[i], r2c, rev[i]});
     return res;
@@ -302,7 +291,7 @@ struct SegmentalRNN {
   SymbolEmbedding* xe;
   SymbolEmbedding* ye;
   DurationEmbedding* de;
-  BiTrans<Builder> bt;
+  BiTrans bt;
   SegEmbedBi<Builder> seb;
   cnn::Dict d;
   cnn::Dict td;
@@ -5,6 +5,7 @@
 #include "cnn/rnn.h"
 #include "cnn/gru.h"
 #include "cnn/lstm.h"
+#include "cnn/bilstm-encoder.h"
 #include "cnn/dict.h"
 # include "cnn/expr.h"
 
@@ -34,7 +35,6 @@ int kNONE;
 int kSOS;
 int kEOS;
 
-template <class Builder>
 struct RNNLanguageModel {
   LookupParameters* p_w;
   Parameters* p_l2th;
@@ -43,11 +43,9 @@ struct RNNLanguageModel {
 
   Parameters* p_th2t;
   Parameters* p_tbias;
-  Builder l2rbuilder;
-  Builder r2lbuilder;
+  BiLSTMEncoder bilstm;
   explicit RNNLanguageModel(Model& model) :
-      l2rbuilder(LAYERS, INPUT_DIM, HIDDEN_DIM, &model),
-      r2lbuilder(LAYERS, INPUT_DIM, HIDDEN_DIM, &model) {
+      bilstm(LAYERS, INPUT_DIM, HIDDEN_DIM, &model) {
     p_w = model.add_lookup_parameters(VOCAB_SIZE, {INPUT_DIM}); 
     p_l2th = model.add_parameters({TAG_HIDDEN_DIM, HIDDEN_DIM});
     p_r2th = model.add_parameters({TAG_HIDDEN_DIM, HIDDEN_DIM});
@@ -60,37 +58,31 @@ struct RNNLanguageModel {
   // return Expression of total loss
   Expression BuildTaggingGraph(const vector<int>& sent, const vector<int>& tags, ComputationGraph& cg, double* cor = 0, unsigned* ntagged = 0) {
     const unsigned slen = sent.size();
-    l2rbuilder.new_graph(cg);  // reset RNN builder for new graph
-    l2rbuilder.start_new_sequence();
-    r2lbuilder.new_graph(cg);  // reset RNN builder for new graph
-    r2lbuilder.start_new_sequence();
+    bilstm.new_graph(cg);  // reset RNN builder for new graph
     Expression i_l2th = parameter(cg, p_l2th);
     Expression i_r2th = parameter(cg, p_r2th);
     Expression i_thbias = parameter(cg, p_thbias);
     Expression i_th2t = parameter(cg, p_th2t);
     Expression i_tbias = parameter(cg, p_tbias); 
     vector<Expression> errs;
-    vector<Expression> i_words(slen);
-    vector<Expression> fwds(slen);
-    vector<Expression> revs(slen);
+    vector<Expression> i_words(slen + 2);
 
-    // read sequence from left to right
-    l2rbuilder.add_input(lookup(cg, p_w, kSOS));
+    // read <s> sequence </s> in both directions
+    i_words[0] = lookup(cg, p_w, kSOS);
     for (unsigned t = 0; t < slen; ++t) {
-      i_words[t] = lookup(cg, p_w, sent[t]);
-      if (!eval) { i_words[t] = noise(i_words[t], 0.1); }
-      fwds[t] = l2rbuilder.add_input(i_words[t]);
+      i_words[t + 1] = lookup(cg, p_w, sent[t]);
+      if (!eval) { i_words[t + 1] = noise(i_words[t + 1], 0.1); }
     }
-
-    // read sequence from right to left
-    r2lbuilder.add_input(lookup(cg, p_w, kEOS));
-    for (unsigned t = 0; t < slen; ++t)
-      revs[slen - t - 1] = r2lbuilder.add_input(i_words[slen - t - 1]);
+    i_words[slen + 1] = lookup(cg, p_w, kEOS);
+    bilstm.encode(i_words);
+    // the forward state of a word has read <s>, the backward one </s>
+    const vector<Expression>& fwds = bilstm.forward_states();
+    const vector<Expression>& revs = bilstm.backward_states();
 
     for (unsigned t = 0; t < slen; ++t) {
       if (tags[t] != kNONE) {
         if (ntagged) (*ntagged)++;
-        Expression i_th = tanh(affine_transform({i_thbias, i_l2th, fwds[t], i_r2th, revs[t]}));
+        Expression i_th = tanh(affine_transform({i_thbias, i_l2th, fwds[t + 1], i_r2th, revs[t + 1]}));
         //if (!eval) { i_th = dropout(i_th, pdrop); }
         Expression i_t = affine_transform({i_tbias, i_th2t, i_th});
         if (cor) {
@@ -188,8 +180,7 @@ int main(int argc, char** argv) {
   else
     sgd = new SimpleSGDTrainer(&model);
 
-  RNNLanguageModel<LSTMBuilder> lm(model);
-  //RNNLanguageModel<SimpleRNNBuilder> lm(model);
+  RNNLanguageModel lm(model);
   if (argc == 4) {
     string fname = argv[3];
     ifstream in(fname);
@@ -6,6 +6,9 @@ ctypedef float real
 cdef extern from "cnn/init.h" namespace "cnn":
     cdef void Initialize(int& argc, char **& argv, unsigned random_seed)
 
+cdef extern from "cnn/dim.h":
+    enum: CNN_MAX_TENSOR_DIM
+
 cdef extern from "cnn/dim.h" namespace "cnn":
     cdef cppclass CDim "cnn::Dim":
         CDim() except +
@@ -20,6 +23,7 @@ cdef extern from "cnn/dim.h" namespace "cnn":
         int ndims()
         int rows()
         int cols()
+        int batch_elems()
         void set(unsigned i, unsigned s)
         int size(unsigned i)
         CDim transpose()
@@ -55,7 +59,10 @@ cdef extern from "cnn/model.h" namespace "cnn":
         #void accumulate_grad(const Tensor& g)
         #void clear()
         CDim dim
+        unsigned stride
+        CTensor all_values
         void Initialize(unsigned index, const vector[float]& val)
+        void Initialize(const float* rows, unsigned n) nogil
         pass
 
     cdef cppclass CModel "cnn::Model":
@@ -66,13 +73,27 @@ cdef extern from "cnn/model.h" namespace "cnn":
         #void save(string fname)
         #void load(string fname)
 
+    # striped locks on the gradients, for backward passes from several threads
+    cdef cppclass CGradientLocks "cnn::GradientLocks":
+        CGradientLocks(bint lock_dense)
+        void lock_shared() nogil
+        void unlock_shared() nogil
+        void lock_all() nogil
+        void unlock_all() nogil
+    CGradientLocks* c_gradient_locks "cnn::gradient_locks"
+
     void load_cnn_model "cnn::load_cnn_model" (string filename, CModel *model)
     void save_cnn_model "cnn::save_cnn_model" (string filename, CModel *model)
 
+cdef extern from "cnn/context.h" namespace "cnn":
+    cdef cppclass CExecutionContext "cnn::ExecutionContext":
+        CExecutionContext(unsigned long mb) except +
+
 cdef extern from "cnn/cnn.h" namespace "cnn":
     ctypedef unsigned VariableIndex
     cdef cppclass CComputationGraph "cnn::ComputationGraph":
         CComputationGraph() except +
+        CComputationGraph(CExecutionContext& context) except +
         # Inputs
         VariableIndex add_input(real s)
         VariableIndex add_input(const real* ps)
@@ -85,43 +106,44 @@ cdef extern from "cnn/cnn.h" namespace "cnn":
         VariableIndex add_const_lookup(CLookupParameters* p, const unsigned* pindex)
         VariableIndex add_const_lookup(CLookupParameters* p, unsigned index)
         
-        const CTensor& forward()
-        const CTensor& incremental_forward()
-        const CTensor& get_value(VariableIndex i)
+        # evaluation does not touch python objects, so it runs without the GIL
+        const CTensor& forward() nogil
+        const CTensor& incremental_forward() nogil
+        const CTensor& get_value(VariableIndex i) nogil
         void invalidate()
-        void backward()
-        void backward(VariableIndex i)
+        void backward() nogil
+        void backward(VariableIndex i) nogil
 
         void PrintGraphviz() const
 
 cdef extern from "cnn/training.h" namespace "cnn":
     cdef cppclass CSimpleSGDTrainer "cnn::SimpleSGDTrainer":
         CSimpleSGDTrainer(CModel* m, float lam, float e0)
-        void update(float s)
+        void update(float s) nogil
         void update_epoch(float r)
         void status()
 
     cdef cppclass CMomentumSGDTrainer "cnn::MomentumSGDTrainer":
         CMomentumSGDTrainer(CModel* m, float lam, float e0, float mom)
-        void update(float s)
+        void update(float s) nogil
         void update_epoch(float r)
         void status()
 
     cdef cppclass CAdagradTrainer "cnn::AdagradTrainer":
         CAdagradTrainer(CModel* m, float lam, float e0, float eps)
-        void update(float s)
+        void update(float s) nogil
         void update_epoch(float r)
         void status()
 
     cdef cppclass CAdadeltaTrainer "cnn::AdadeltaTrainer":
         CAdadeltaTrainer(CModel* m, float lam, float eps, float rho)
-        void update(float s)
+        void update(float s) nogil
         void update_epoch(float r)
         void status()
 
     cdef cppclass CAdamTrainer "cnn::AdamTrainer":
         CAdamTrainer(CModel* m, float lam, float alpha, float beta_1, float beta_2, float eps)
-        void update(float s)
+        void update(float s) nogil
         void update_epoch(float r)
         void status()
 
@@ -1,8 +1,11 @@
 # on numpy arrays, see: https://github.com/cython/cython/wiki/tutorials-NumpyPointerToC
 
 import sys
+import threading
 from cython.operator cimport dereference as deref
 from libc.stdlib cimport malloc, free
+from cpython.buffer cimport PyBUF_WRITABLE
+from cpython.pythread cimport PyThread_get_thread_ident
 import numpy as np
 # TODO:
 #  - set random seed (in CNN)
@@ -35,7 +38,7 @@ cimport pycnn
 cdef init(random_seed=None):
     cdef int argc = len(sys.argv)
     cdef char** c_argv
-    args = [bytes(x) for x in sys.argv]
+    args = [x if isinstance(x, bytes) else x.encode('utf-8') for x in sys.argv]
     c_argv = <char**>malloc(sizeof(char*) * len(args)) # TODO check failure?
     for idx, s in enumerate(args):
         c_argv[idx] = s
@@ -68,11 +71,62 @@ cdef CDim Dim(dim):
         return CDim(cvec)
     raise "Unsupported dimension",dim
 
-cdef c_tensor_as_np(CTensor &t):
-    # TODO: make more efficient, with less copy
-    arr = np.array(c_as_vector(t))
-    if t.d.ndims() == 1: return arr
-    else: return arr.reshape(t.d.rows(), t.d.cols(),order='F')
+cdef class TensorView:
+    """
+    The memory of a Tensor, through the buffer protocol: np.asarray(view) is
+    an array over it, without a copy. The view keeps owner alive, but the
+    memory is only valid as long as the tensor is (for the values of a graph,
+    until the graph is renewed).
+    """
+    cdef float* data
+    cdef int ndim
+    cdef Py_ssize_t shape[CNN_MAX_TENSOR_DIM + 1]
+    cdef Py_ssize_t strides[CNN_MAX_TENSOR_DIM + 1]
+    cdef bint readonly
+    cdef object owner
+
+    def __getbuffer__(self, Py_buffer* buf, int flags):
+        if self.readonly and (flags & PyBUF_WRITABLE):
+            raise BufferError("the tensor is read only")
+        cdef Py_ssize_t n = 1
+        for i in range(self.ndim): n *= self.shape[i]
+        buf.buf = self.data
+        buf.format = b'f'
+        buf.internal = NULL
+        buf.itemsize = sizeof(float)
+        buf.len = n * sizeof(float)
+        buf.ndim = self.ndim
+        buf.obj = self
+        buf.readonly = self.readonly
+        buf.shape = self.shape
+        buf.strides = self.strides
+        buf.suboffsets = NULL
+
+    def __releasebuffer__(self, Py_buffer* buf):
+        pass
+
+cdef TensorView tensor_view(CTensor &t, owner, bint readonly):
+    # column major, like cnn, with the batch as the last axis (if any)
+    cdef TensorView view = TensorView()
+    cdef Py_ssize_t stride = sizeof(float)
+    view.data = t.v
+    view.ndim = t.d.ndims()
+    for i in range(view.ndim):
+        view.shape[i] = t.d.size(i)
+        view.strides[i] = stride
+        stride *= t.d.size(i)
+    if t.d.batch_elems() > 1:
+        view.shape[view.ndim] = t.d.batch_elems()
+        view.strides[view.ndim] = stride
+        view.ndim += 1
+    view.readonly = readonly
+    view.owner = owner
+    return view
+
+cdef c_tensor_as_np(CTensor &t, owner, bint copy=True, bint readonly=False):
+    arr = np.asarray(tensor_view(t, owner, readonly))
+    if copy: return arr.copy(order='F')
+    return arr
 
 # {{{ Model / Parameters 
 cdef class Parameters:
@@ -89,17 +143,15 @@ cdef class Parameters:
         if self.thisptr.dim.ndims() == 1: return (self.thisptr.dim.rows())
         return (self.thisptr.dim.rows(), self.thisptr.dim.cols())
 
-    cpdef as_array(self):
+    cpdef as_array(self, copy=True):
         """
-        Return as a numpy array.
+        Return as a numpy array. With copy=False, the array is a view of the
+        parameters: changing it changes them.
         """
-        cdef CTensor t
-        return c_tensor_as_np(self.thisptr.values)
+        return c_tensor_as_np(self.thisptr.values, self, copy)
 
-    # TODO: make more efficient
     cpdef load_array(self, arr):
         cdef CTensor t
-        cdef float* vals
         t = self.thisptr.values
         shape = arr.shape
         if len(shape) == 1:
@@ -107,10 +159,7 @@ cdef class Parameters:
             assert(t.d.size() == arr.size)
         if len(shape) == 2:
             assert(t.d.rows() == shape[0] and t.d.cols() == shape[1])
-        vals = t.v
-        arr = arr.flatten()
-        for i in xrange(arr.size):
-            vals[i] = arr[i]
+        c_tensor_as_np(t, self, False)[...] = arr
 
 
 cdef class LookupParameters:
@@ -124,13 +173,18 @@ cdef class LookupParameters:
         return self
 
     cpdef init_from_array(self, arr):
+        """
+        Set the first len(arr) rows, all at once, from the rows of arr.
+        """
         if len(arr) > self.thisptr.values.size():
             raise Exception("too many rows")
         if arr.shape[1] != self.thisptr.values[0].d.rows():
             raise Exception("dim mismatch")
-        cdef vector[float] r
-        for i,row in enumerate(arr):
-            self.init_row(i, row)
+        cdef float[:, ::1] rows = np.ascontiguousarray(arr, dtype=np.float32)
+        cdef unsigned n = rows.shape[0]
+        if n == 0: return
+        with nogil:
+            self.thisptr.Initialize(&rows[0, 0], n)
 
     cpdef shape(self):
         if self.thisptr.dim.cols() != 1:
@@ -146,13 +200,24 @@ cdef class LookupParameters:
     cpdef init_row(self, unsigned i, vector[float] row):
         self.thisptr.Initialize(i, row)
 
-    cpdef as_array(self):
+    cpdef as_array(self, copy=True):
         """
-        Return as a numpy array.
+        Return as a numpy array, a row per index. With copy=False, the array
+        is a view of the table: changing it changes the parameters.
         """
-        cdef vector[CTensor] vals
-        vals = self.thisptr.values
-        return np.vstack([c_tensor_as_np(t).reshape(1,-1,order='F') for t in vals])
+        # the rows are stride floats apart in the table
+        cdef TensorView view = TensorView()
+        view.data = self.thisptr.all_values.v
+        view.ndim = 2
+        view.shape[0] = self.thisptr.values.size()
+        view.shape[1] = self.thisptr.dim.size()
+        view.strides[0] = self.thisptr.stride * sizeof(float)
+        view.strides[1] = sizeof(float)
+        view.readonly = False
+        view.owner = self
+        arr = np.asarray(view)
+        if copy: return arr.copy()
+        return arr
 
 
 cdef class Model:
@@ -257,30 +322,109 @@ cdef class FloatVectorValue:
 # }}}
 
 cdef int SECRET = 923148
+
+# the graphs of all threads share the parameters of the model and add to its
+# gradients. the locks that keep them apart are installed by cg() when a
+# second thread creates its graph, and kept for the life of the module: from
+# then on graphs run without the GIL, forward passes lock the parameters for
+# reading, backward passes take striped locks on the gradients (see
+# cnn::GradientLocks), and the trainers' updates take all the locks, so that
+# no update changes what a pass reads or adds to. until then the graph of the
+# importing thread runs with the GIL held, so that no pass is halfway through
+# when the locks appear. reading or setting parameters from python
+# (as_array, load_array, ...) takes no lock: do not do it while another
+# thread updates them.
+# the graph of the thread that imported pycnn, which is evaluated in the
+# default context. every other thread gets a graph of its own, with an
+# execution context of its own, so threads can build and run graphs at once
+# (the GIL is released while they run). a thread's expressions belong to its
+# graph, and must not be shared with other threads.
 cdef ComputationGraph _cg = ComputationGraph(SECRET)
+cdef long _cg_thread = PyThread_get_thread_ident()
+cdef object _thread_cgs = threading.local()
+cdef unsigned long _thread_context_mb = 128
 
-def cg_version(): return _cg._cg_version
-def renew_cg(): return _cg.renew()
+def set_thread_context_mb(unsigned long mb):
+    """
+    Set the memory (in MB, for values and again for gradients) of the graphs
+    threads other than the first create from now on.
+    """
+    global _thread_context_mb
+    _thread_context_mb = mb
+
+def cg_version(): return cg()._cg_version
+def renew_cg(): return cg().renew()
 
 cpdef ComputationGraph cg():
-    global _cg
-    return _cg
+    global c_gradient_locks
+    if PyThread_get_thread_ident() == _cg_thread: return _cg
+    try:
+        return _thread_cgs.cg
+    except AttributeError:
+        if c_gradient_locks == NULL: c_gradient_locks = new CGradientLocks(True)
+        _thread_cgs.cg = ComputationGraph(SECRET, _thread_context_mb)
+        return _thread_cgs.cg
+
+# forward and backward passes (see above on the locks)
+cdef CTensor _run_forward(CComputationGraph* g, bint incremental):
+    cdef CTensor t
+    if c_gradient_locks == NULL:
+        if incremental: t = g.incremental_forward()
+        else: t = g.forward()
+        return t
+    with nogil:
+        c_gradient_locks.lock_shared()
+        if incremental: t = g.incremental_forward()
+        else: t = g.forward()
+        c_gradient_locks.unlock_shared()
+    return t
+
+# the value of node i, which runs the graph forward up to it if needed
+cdef CTensor _get_value(CComputationGraph* g, VariableIndex i):
+    cdef CTensor t
+    if c_gradient_locks == NULL:
+        t = g.get_value(i)
+        return t
+    with nogil:
+        c_gradient_locks.lock_shared()
+        t = g.get_value(i)
+        c_gradient_locks.unlock_shared()
+    return t
+
+# from node *i, or from the last node if i is NULL
+cdef void _run_backward(CComputationGraph* g, const VariableIndex* i):
+    if c_gradient_locks == NULL:
+        if i == NULL: g.backward()
+        else: g.backward(i[0])
+        return
+    # backward locks the gradients itself
+    with nogil:
+        if i == NULL: g.backward()
+        else: g.backward(i[0])
 
 cdef class ComputationGraph:
     cdef CComputationGraph *thisptr, 
+    cdef CExecutionContext *context
     cdef list _inputs
     cdef int _cg_version
-    def __cinit__(self, int guard=0):
+    def __cinit__(self, int guard=0, unsigned long context_mb=0):
         if guard != SECRET: raise RuntimeError("Do not instantiate ComputationGraph directly. Use pycnn.cg()")
-        self.thisptr = new CComputationGraph()
+        self.context = NULL
+        if context_mb: self.context = new CExecutionContext(context_mb)
+        self.thisptr = self.new_graph()
         self._inputs = []
         self._cg_version = 0
     def __dealloc__(self):
         del self.thisptr
+        del self.context
+
+    cdef CComputationGraph* new_graph(self):
+        if self.context == NULL: return new CComputationGraph()
+        return new CComputationGraph(self.context[0])
 
     cpdef renew(self):
         del self.thisptr
-        self.thisptr = new CComputationGraph()
+        self.thisptr = self.new_graph()
         self._inputs = []
         self._cg_version += 1
         return self
@@ -300,23 +444,34 @@ cdef class ComputationGraph:
     #        results[name] = self.lookup(model[name])
     #    return results
 
+    # the graph runs without the GIL once several threads have graphs, so
+    # that the others can go on
     cpdef forward_scalar(self):
-        return c_as_scalar(self.thisptr.forward())
+        cdef CTensor t = _run_forward(self.thisptr, False)
+        return c_as_scalar(t)
 
     cpdef inc_forward_scalar(self):
-        return c_as_scalar(self.thisptr.incremental_forward())
+        cdef CTensor t = _run_forward(self.thisptr, True)
+        return c_as_scalar(t)
 
     cpdef forward_vec(self):
-        return c_as_vector(self.thisptr.forward())
+        cdef CTensor t = _run_forward(self.thisptr, False)
+        return c_as_vector(t)
 
     cpdef inc_forward_vec(self):
-        return c_as_vector(self.thisptr.incremental_forward())
+        cdef CTensor t = _run_forward(self.thisptr, True)
+        return c_as_vector(t)
 
-    cpdef forward(self): self.thisptr.forward()
-    cpdef inc_forward(self): self.thisptr.incremental_forward()
+    cpdef forward(self):
+        _run_forward(self.thisptr, False)
+    cpdef inc_forward(self):
+        _run_forward(self.thisptr, True)
 
     cpdef backward(self):
-        self.thisptr.backward()
+        _run_backward(self.thisptr, NULL)
+
+    cdef backward_from(self, VariableIndex i):
+        _run_backward(self.thisptr, &i)
 
     cpdef PrintGraphviz(self):
         self.thisptr.PrintGraphviz()
@@ -360,7 +515,7 @@ cdef class ComputationGraph:
 
 #{{{ Expressions
 cdef ensure_freshness(Expression a):
-    if a.cg_version != _cg.version(): raise ValueError("Attempt to use a stale expression.")
+    if a.cg_version != cg().version(): raise ValueError("Attempt to use a stale expression.")
 
 cdef _add(Expression a, Expression b): ensure_freshness(b); return Expression.from_cexpr(a.cg_version, c_op_add(a.c(), b.c()))
 cdef _mul(Expression a, Expression b): ensure_freshness(b); return Expression.from_cexpr(a.cg_version, c_op_mul(a.c(), b.c()))
@@ -387,7 +542,7 @@ cdef class Expression: #{{{
         self.vindex = 0
     @staticmethod
     cdef Expression from_cexpr(int cgv, CExpression cexpr):
-        if cgv != _cg._cg_version: raise ValueError("Attempt to use a stale expression, from a previous Computation Graph.")
+        if cgv != cg()._cg_version: raise ValueError("Attempt to use a stale expression, from a previous Computation Graph.")
         self = Expression()
         #self.cg = cexpr.pg
         self.vindex = cexpr.i
@@ -408,32 +563,35 @@ cdef class Expression: #{{{
         return pickrange(self, i, j)
 
     cpdef scalar_value(self, recalculate=False):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        cdef CTensor t
         if recalculate: self.cg().forward()
-        return c_as_scalar(self.cgp().get_value(self.vindex))
+        t = _get_value(self.cgp(), self.vindex)
+        return c_as_scalar(t)
 
     cpdef vec_value(self, recalculate=False):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        cdef CTensor t
         if recalculate: self.cg().forward()
-        return c_as_vector(self.cgp().get_value(self.vindex))
+        t = _get_value(self.cgp(), self.vindex)
+        return c_as_vector(t)
 
-    cpdef npvalue(self, recalculate=False):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+    cpdef npvalue(self, recalculate=False, copy=True):
+        """
+        The value as a numpy array. With copy=False, the array is a read only
+        view of the value in the graph, valid until the graph is renewed.
+        """
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
         cdef CTensor t
-        cdef CDim dim
         if recalculate: self.cg().forward()
-        t = self.cgp().get_value(self.vindex)
-        dim = t.d
-        arr = np.array(c_as_vector(t))
-        if dim.ndims() == 2:
-            arr = arr.reshape(dim.rows(), dim.cols(),order='F')
-        return arr
+        t = _get_value(self.cgp(), self.vindex)
+        return c_tensor_as_np(t, self.cg(), copy, True)
 
     cpdef value(self, recalculate=False):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
         cdef CTensor t
         if recalculate: self.cg().forward()
-        t = self.cgp().get_value(self.vindex)
+        t = _get_value(self.cgp(), self.vindex)
         if t.d.ndims() == 2:
             return self.npvalue()
         vec = self.vec_value()
@@ -442,13 +600,13 @@ cdef class Expression: #{{{
 
     # TODO this runs incremental forward on the entire graph, may not be optimal in terms of efficiency.
     cpdef forward(self, recalculate=False):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
         if recalculate: self.cg().forward()
         else: self.cg().inc_forward()
 
     cpdef backward(self):
-        if self.cg_version != _cg._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
-        self.cgp().backward(self.vindex)
+        if self.cg_version != cg()._cg_version: raise RuntimeError("Stale Expression (created before renewing the Computation Graph).")
+        self.cg().backward_from(self.vindex)
 
     def __add__(self, other):
         if isinstance(self, Expression) and isinstance(other, Expression):
@@ -480,7 +638,7 @@ cdef class Expression: #{{{
 cdef Expression _parameter(ComputationGraph g, Parameters p):
     return Expression.from_cexpr(g.version(), c_parameter(g.thisptr[0], p.thisptr))
 
-def parameter(Parameters p): return _parameter(_cg, p)
+def parameter(Parameters p): return _parameter(cg(), p)
 
 # {{{ Mutable Expressions
 #     These depend values that can be set by the caller
@@ -500,7 +658,7 @@ cdef class _inputExpression(Expression):
         self.val.set(s)
 
 def scalarInput(float s):
-    return _cg.inputValue(s)
+    return cg().inputValue(s)
 
 cdef class _vecInputExpression(Expression):
     cdef FloatVectorValue val
@@ -518,16 +676,16 @@ cdef class _vecInputExpression(Expression):
         self.val.set(data)
 
 def vecInput(int dim):
-    return _cg.inputVector(dim)
+    return cg().inputVector(dim)
 
 def inputVector(vector[float] v):
-    return _cg.inputVectorLiteral(v)
+    return cg().inputVectorLiteral(v)
 
 def matInput(int d1, int d2):
-    return _cg.inputMatrix(d1, d2)
+    return cg().inputMatrix(d1, d2)
 
 def inputMatrix(vector[float] v, tuple d):
-    return _cg.inputMatrixLiteral(v, d)
+    return cg().inputMatrixLiteral(v, d)
 
 cdef class _lookupExpression(Expression):
     cdef UnsignedValue val
@@ -563,10 +721,10 @@ cdef class _lookupBatchExpression(Expression):
         self.val.set(i)
 
 def lookup(LookupParameters p, unsigned index=0, update=True):
-    return _cg.lookup(p, index, update)
+    return cg().lookup(p, index, update)
 
 def lookup_batch(LookupParameters p, vector[unsigned] indices, update=True):
-    return _cg.lookup_batch(p, indices, update)
+    return cg().lookup_batch(p, indices, update)
 
 cdef class _pickerExpression(Expression):
     cdef UnsignedValue val
@@ -583,7 +741,7 @@ cdef class _pickerExpression(Expression):
         self.val.set(i)
 
 def pick(Expression e, unsigned index=0):
-    return _cg.outputPicker(e, index)
+    return cg().outputPicker(e, index)
 
 cdef class _pickerBatchExpression(Expression):
     cdef UnsignedVectorValue val
@@ -599,7 +757,7 @@ cdef class _pickerBatchExpression(Expression):
         self.val.set(i)
 
 def pick_batch(Expression e, vector[unsigned] indices):
-    return _cg.outputBatchPicker(e, indices)
+    return cg().outputBatchPicker(e, indices)
 
 cdef class _hingeExpression(Expression):
     cdef UnsignedValue val
@@ -616,7 +774,7 @@ cdef class _hingeExpression(Expression):
         self.val.set(i)
 
 def hinge(Expression x, unsigned index, float m=1.0):
-    return _hingeExpression(_cg, x, index, m)
+    return _hingeExpression(cg(), x, index, m)
 
 # }}}
 
@@ -755,11 +913,11 @@ cdef class _RNNBuilder: # {{{
         del self.thisptr
 
     cdef new_graph(self):
-        self.thisptr.new_graph(_cg.thisptr[0])
-        self.cg_version = _cg.version()
+        self.thisptr.new_graph(cg().thisptr[0])
+        self.cg_version = cg().version()
 
     cdef start_new_sequence(self, es=None):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         cdef vector[CExpression] ces = vector[CExpression]()
         cdef Expression e
         if es:
@@ -770,24 +928,24 @@ cdef class _RNNBuilder: # {{{
 
     cdef Expression add_input(self, Expression e):
         ensure_freshness(e)
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         return Expression.from_cexpr(self.cg_version, self.thisptr.add_input(e.c()))
 
     cdef Expression add_input_to_prev(self, CRNNPointer prev, Expression e):
         ensure_freshness(e)
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         return Expression.from_cexpr(self.cg_version, self.thisptr.add_input(prev, e.c()))
 
     cdef rewind_one_step(self):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         self.thisptr.rewind_one_step()
 
     cdef Expression back(self):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         return Expression.from_cexpr(self.cg_version, self.thisptr.back())
 
     cdef final_h(self):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         cdef list res = []
         cdef CExpression cexp
         cdef vector[CExpression] cexps = self.thisptr.final_h()
@@ -796,7 +954,7 @@ cdef class _RNNBuilder: # {{{
         return res
 
     cdef final_s(self):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         cdef list res = []
         cdef CExpression cexp
         cdef vector[CExpression] cexps = self.thisptr.final_s()
@@ -805,7 +963,7 @@ cdef class _RNNBuilder: # {{{
         return res
 
     cdef get_h(self, CRNNPointer i):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         cdef list res = []
         cdef CExpression cexp
         cdef vector[CExpression] cexps = self.thisptr.get_h(i)
@@ -814,7 +972,7 @@ cdef class _RNNBuilder: # {{{
         return res
 
     cdef get_s(self, CRNNPointer i):
-        if self.cg_version != _cg.version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
+        if self.cg_version != cg().version(): raise ValueError("Using stale builder. Create .new_graph() after computation graph is renewed.")
         cdef list res = []
         cdef CExpression cexp
         cdef vector[CExpression] cexps = self.thisptr.get_s(i)
@@ -823,7 +981,7 @@ cdef class _RNNBuilder: # {{{
         return res
 
     cpdef RNNState initial_state(self,vecs=None):
-        if self.cg_version != _cg.version():
+        if self.cg_version != cg().version():
             self.new_graph()
             if vecs is not None:
                 self.start_new_sequence(vecs)
@@ -833,7 +991,7 @@ cdef class _RNNBuilder: # {{{
         return self._init_state
 
     cpdef RNNState initial_state_from_raw_vectors(self,vecs=None):
-        if self.cg_version != _cg.version():
+        if self.cg_version != cg().version():
             self.new_graph()
             if vecs is not None:
                 es = []
@@ -1103,7 +1261,13 @@ cdef class SimpleSGDTrainer:
     def __dealloc__(self):
         del self.thisptr
     cpdef update(self, float s=1.0):
-        self.thisptr.update(s)
+        if c_gradient_locks == NULL:
+            self.thisptr.update(s)
+            return
+        with nogil:
+            c_gradient_locks.lock_all()
+            self.thisptr.update(s)
+            c_gradient_locks.unlock_all()
     cpdef update_epoch(self, float r = 1.0):
         self.thisptr.update_epoch(r)
     cpdef status(self):
@@ -1116,7 +1280,13 @@ cdef class MomentumSGDTrainer:
     def __dealloc__(self):
         del self.thisptr
     cpdef update(self, float s=1.0):
-        self.thisptr.update(s)
+        if c_gradient_locks == NULL:
+            self.thisptr.update(s)
+            return
+        with nogil:
+            c_gradient_locks.lock_all()
+            self.thisptr.update(s)
+            c_gradient_locks.unlock_all()
     cpdef update_epoch(self, float r = 1.0):
         self.thisptr.update_epoch(r)
     cpdef status(self):
@@ -1129,7 +1299,13 @@ cdef class AdagradTrainer:
     def __dealloc__(self):
         del self.thisptr
     cpdef update(self, float s=1.0):
-        self.thisptr.update(s)
+        if c_gradient_locks == NULL:
+            self.thisptr.update(s)
+            return
+        with nogil:
+            c_gradient_locks.lock_all()
+            self.thisptr.update(s)
+            c_gradient_locks.unlock_all()
     cpdef update_epoch(self, float r = 1.0):
         self.thisptr.update_epoch(r)
     cpdef status(self):
@@ -1142,7 +1318,13 @@ cdef class AdadeltaTrainer:
     def __dealloc__(self):
         del self.thisptr
     cpdef update(self, float s=1.0):
-        self.thisptr.update(s)
+        if c_gradient_locks == NULL:
+            self.thisptr.update(s)
+            return
+        with nogil:
+            c_gradient_locks.lock_all()
+            self.thisptr.update(s)
+            c_gradient_locks.unlock_all()
     cpdef update_epoch(self, float r = 1.0):
         self.thisptr.update_epoch(r)
     cpdef status(self):
@@ -1155,7 +1337,13 @@ cdef class AdamTrainer:
     def __dealloc__(self):
         del self.thisptr
     cpdef update(self, float s=1.0):
-        self.thisptr.update(s)
+        if c_gradient_locks == NULL:
+            self.thisptr.update(s)
+            return
+        with nogil:
+            c_gradient_locks.lock_all()
+            self.thisptr.update(s)
+            c_gradient_locks.unlock_all()
     cpdef update_epoch(self, float r = 1.0):
         self.thisptr.update_epoch(r)
     cpdef status(self):
@@ -98,10 +98,13 @@ struct RNNLanguageModel {
     Expression R = parameter(cg, p_R); // hidden -> word rep parameter
     Expression bias = parameter(cg, p_bias);  // word bias
     vector<Expression> errs(slen + 1);
+    vector<Expression> hs;  // the reps that predict each word, for cfsm
+    vector<unsigned> words;
     Expression h_t = builder.add_input(lookup(cg, p_c, kSOS)); // read <s>
     for (unsigned t = 0; t < slen; ++t) { // h_t = RNN(x_0,...,x_t)
-      if (cfsm) { // class-factored softmax
-        errs[t] = cfsm->neg_log_softmax(h_t, sent[t]);
+      if (cfsm) { // class-factored softmax, scored for the whole sentence below
+        hs.push_back(h_t);
+        words.push_back(sent[t]);
       } else { // regular softmax
         Expression u_t = affine_transform({bias, R, h_t});
         errs[t] = pickneglogsoftmax(u_t, sent[t]);
@@ -111,11 +114,12 @@ struct RNNLanguageModel {
     }
     // it reamins to deal predict </s>
     if (cfsm) {
-      errs.back() = cfsm->neg_log_softmax(h_t, kEOS);
-    } else {
-      Expression u_last = affine_transform({bias, R, h_t});
-      errs.back() = pickneglogsoftmax(u_last, kEOS); // predict </s>
+      hs.push_back(h_t);
+      words.push_back(kEOS);
+      return cfsm->neg_log_softmax(concatenate_many_cols(hs), words);
     }
+    Expression u_last = affine_transform({bias, R, h_t});
+    errs.back() = pickneglogsoftmax(u_last, kEOS); // predict </s>
     return sum(errs);
   }
 
@@ -0,0 +1,121 @@
+#include <cnn/cnn.h>
+#include <cnn/expr.h>
+#include <cnn/bilstm-encoder.h>
+#include <boost/test/unit_test.hpp>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+struct BiLSTMEncoderTest {
+  BiLSTMEncoderTest() : enc(2, 3, 4, &mod) {
+    sents = {{{1.f, 0.f, -1.f}, {0.5f, 0.2f, 0.1f}, {-0.3f, 0.8f, 0.f}, {0.f, 0.f, 2.f}},
+             {{0.1f, -0.4f, 0.3f}, {1.f, 1.f, 0.f}},
+             {{0.f, 0.7f, -0.2f}}};
+  }
+
+  vector<Expression> inputs(ComputationGraph& cg, const vector<vector<float>>& sent) {
+    vector<Expression> xs;
+    for (auto& x : sent) xs.push_back(input(cg, {3}, x));
+    return xs;
+  }
+
+  // the concatenated states of each position, computed with the builders
+  // one input at a time
+  vector<vector<float>> reference(const vector<vector<float>>& sent) {
+    ComputationGraph cg;
+    vector<Expression> xs = inputs(cg, sent);
+    enc.fwd.new_graph(cg);
+    enc.fwd.start_new_sequence();
+    enc.bwd.new_graph(cg);
+    enc.bwd.start_new_sequence();
+    vector<Expression> f(xs.size()), b(xs.size());
+    for (unsigned t = 0; t < xs.size(); ++t)
+      f[t] = enc.fwd.add_input(xs[t]);
+    for (unsigned t = xs.size(); t > 0; --t)
+      b[t - 1] = enc.bwd.add_input(xs[t - 1]);
+    vector<vector<float>> res;
+    for (unsigned t = 0; t < xs.size(); ++t)
+      res.push_back(as_vector(concatenate({f[t], b[t]}).value()));
+    return res;
+  }
+
+  void check_close(const vector<float>& expected, const vector<float>& actual) {
+    BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+    for (unsigned i = 0; i < expected.size(); ++i)
+      BOOST_CHECK_SMALL(expected[i] - actual[i], 1e-5f);
+  }
+
+  Model mod;
+  BiLSTMEncoder enc;
+  vector<vector<vector<float>>> sents;
+};
+
+BOOST_FIXTURE_TEST_SUITE(bilstm_encoder_test, BiLSTMEncoderTest);
+
+BOOST_AUTO_TEST_CASE( sentence_matches_builders ) {
+  for (auto& sent : sents) {
+    vector<vector<float>> expected = reference(sent);
+    ComputationGraph cg;
+    enc.new_graph(cg);
+    vector<Expression> hs = enc.transduce(inputs(cg, sent));
+    BOOST_REQUIRE_EQUAL(hs.size(), sent.size());
+    for (unsigned t = 0; t < hs.size(); ++t)
+      check_close(expected[t], as_vector(hs[t].value()));
+  }
+}
+
+BOOST_AUTO_TEST_CASE( minibatch_matches_builders ) {
+  vector<vector<float>> values;
+  {
+    ComputationGraph cg;
+    enc.new_graph(cg);
+    vector<vector<Expression>> xs;
+    for (auto& sent : sents) xs.push_back(inputs(cg, sent));
+    vector<Expression> hs = enc.transduce(xs);
+    BOOST_REQUIRE_EQUAL(hs.size(), sents[0].size());
+    for (auto& h : hs) values.push_back(as_vector(h.value()));
+  }
+  for (unsigned b = 0; b < sents.size(); ++b) {
+    vector<vector<float>> expected = reference(sents[b]);
+    for (unsigned t = 0; t < sents[b].size(); ++t) {
+      // column b of a {8, 3} matrix
+      vector<float> actual(values[t].begin() + b * 8, values[t].begin() + (b + 1) * 8);
+      check_close(expected[t], actual);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( large_minibatch ) {
+  // more sentences than ConcatenateColumns takes arguments
+  const unsigned batch = 1100;
+  vector<vector<vector<float>>> expected;
+  for (auto& sent : sents) expected.push_back(reference(sent));
+  ComputationGraph cg;
+  enc.new_graph(cg);
+  vector<vector<Expression>> xs;
+  for (unsigned b = 0; b < batch; ++b) xs.push_back(inputs(cg, sents[b % sents.size()]));
+  vector<Expression> hs = enc.transduce(xs);
+  BOOST_REQUIRE_EQUAL(hs.size(), sents[0].size());
+  for (unsigned t = 0; t < hs.size(); ++t) {
+    vector<float> values = as_vector(hs[t].value());
+    BOOST_REQUIRE_EQUAL(values.size(), 8 * batch);
+    for (unsigned b = 0; b < batch; ++b) {
+      const unsigned s = b % sents.size();
+      if (t >= sents[s].size()) continue;
+      vector<float> actual(values.begin() + b * 8, values.begin() + (b + 1) * 8);
+      check_close(expected[s][t], actual);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( default_constructed ) {
+  BiLSTMEncoder e;
+  e.disable_dropout();
+  e = BiLSTMEncoder(1, 3, 4, &mod);
+  ComputationGraph cg;
+  e.new_graph(cg);
+  BOOST_CHECK_EQUAL(e.transduce(inputs(cg, sents[0])).size(), sents[0].size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
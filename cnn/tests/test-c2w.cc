@@ -0,0 +1,134 @@
+#include <cnn/cnn.h>
+#include <cnn/expr.h>
+#include <cnn/c2w.h>
+#include <cnn/training.h>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+struct C2WTest {
+  C2WTest() {
+    words = {{1, 2, 3}, {4, 5}, {2, 2, 6, 1}, {7}};
+  }
+
+  // the representations of words, computed in a new graph
+  vector<vector<float>> reps(C2WBuilder& b, bool inference, const vector<int>& ids) {
+    ComputationGraph cg;
+    b.new_graph(cg, inference);
+    vector<vector<int>> chars;
+    for (int id : ids) chars.push_back(words[id]);
+    vector<vector<float>> res;
+    for (auto& e : b.add_words(ids, chars)) res.push_back(as_vector(e.value()));
+    return res;
+  }
+
+  // true if the word is taken from the cache: that adds a single input node
+  // to the graph, where reading its characters adds many
+  bool is_cached(C2WBuilder& b, int id) {
+    ComputationGraph cg;
+    b.new_graph(cg, true);
+    const unsigned before = cg.nodes.size();
+    b.add_word(id, words[id]);
+    return cg.nodes.size() == before + 1;
+  }
+
+  void check_close(const vector<float>& expected, const vector<float>& actual) {
+    BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+    for (unsigned i = 0; i < expected.size(); ++i)
+      BOOST_CHECK_SMALL(expected[i] - actual[i], 1e-5f);
+  }
+
+  Model mod;
+  vector<vector<int>> words;
+};
+
+BOOST_FIXTURE_TEST_SUITE(c2w_test, C2WTest);
+
+BOOST_AUTO_TEST_CASE( cached_matches_fresh ) {
+  C2WBuilder b(10, 1, 3, 4, &mod);
+  const vector<int> ids = {0, 1, 2, 3};
+  // fresh: training graphs never use the cache
+  vector<vector<float>> fresh = reps(b, false, ids);
+  BOOST_CHECK_EQUAL(b.cache_size(), 0u);
+  // read as a minibatch, then taken from the cache
+  vector<vector<float>> read = reps(b, true, ids);
+  BOOST_CHECK_EQUAL(b.cache_size(), ids.size());
+  for (int id : ids) BOOST_CHECK(is_cached(b, id));
+  vector<vector<float>> cached = reps(b, true, ids);
+  for (unsigned i = 0; i < ids.size(); ++i) {
+    check_close(fresh[i], read[i]);
+    check_close(fresh[i], cached[i]);
+  }
+  // one word at a time, not as a minibatch
+  for (unsigned i = 0; i < ids.size(); ++i)
+    check_close(fresh[i], reps(b, false, {ids[i]})[0]);
+}
+
+BOOST_AUTO_TEST_CASE( evicts_least_recently_used ) {
+  C2WBuilder b(10, 1, 3, 4, &mod, 2);
+  reps(b, true, {0, 1});
+  BOOST_CHECK_EQUAL(b.cache_size(), 2u);
+  BOOST_CHECK(is_cached(b, 0));  // 1 is now the least recently used
+  reps(b, true, {2});
+  BOOST_CHECK_EQUAL(b.cache_size(), 2u);
+  BOOST_CHECK(is_cached(b, 2));
+  BOOST_CHECK(is_cached(b, 0));
+  BOOST_CHECK(!is_cached(b, 1));  // read again, dropping 2
+  BOOST_CHECK(!is_cached(b, 2));
+  BOOST_CHECK_EQUAL(b.cache_size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE( training_graph_clears_cache ) {
+  C2WBuilder b(10, 1, 3, 4, &mod);
+  reps(b, true, {0, 1, 2});
+  BOOST_CHECK_EQUAL(b.cache_size(), 3u);
+  {
+    ComputationGraph cg;
+    b.new_graph(cg, false);
+    BOOST_CHECK_EQUAL(b.cache_size(), 0u);
+    b.add_word(0, words[0]);
+    BOOST_CHECK_EQUAL(b.cache_size(), 0u);
+  }
+  BOOST_CHECK(!is_cached(b, 0));
+}
+
+BOOST_AUTO_TEST_CASE( update_and_load_clear_cache ) {
+  C2WBuilder b(10, 1, 3, 4, &mod);
+  vector<float> before = reps(b, true, {0})[0];
+  BOOST_CHECK(is_cached(b, 0));
+  // an update, without a training graph built through b
+  {
+    ComputationGraph cg;
+    Expression loss = squared_norm(lookup(cg, b.p_lookup, words[0][0]));
+    cg.forward();
+    cg.backward(loss.i);
+  }
+  SimpleSGDTrainer sgd(&mod, 1e-6, 1.0);
+  sgd.update(1.0);
+  BOOST_CHECK(!is_cached(b, 0));
+  BOOST_CHECK(before != reps(b, true, {0})[0]);
+  // loading values drops what was computed from the earlier ones
+  std::stringstream ss;
+  {
+    boost::archive::text_oarchive oa(ss);
+    oa << mod;
+  }
+  BOOST_CHECK(is_cached(b, 0));
+  boost::archive::text_iarchive ia(ss);
+  ia >> mod;
+  BOOST_CHECK(!is_cached(b, 0));
+}
+
+BOOST_AUTO_TEST_CASE( no_cache ) {
+  C2WBuilder b(10, 1, 3, 4, &mod, 0);
+  reps(b, true, {0, 1});
+  BOOST_CHECK_EQUAL(b.cache_size(), 0u);
+  BOOST_CHECK(!is_cached(b, 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+#include <cnn/cnn.h>
+#include <cnn/context.h>
+#include <cnn/expr.h>
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+struct ContextTest {
+  ContextTest() : own(1), other(1) {
+    W = mod.add_parameters({2, 3});
+    TensorTools::SetElements(W->values, {1.f, -2.f, 0.5f, 3.f, 0.f, 1.f});
+  }
+
+  // a loss whose value is 5.5 and whose gradient wrt W is {1, 2, 1, 2, 1, 2}
+  Expression loss(ComputationGraph& cg) {
+    Expression x = input(cg, {3}, {1.f, 1.f, 1.f});
+    Expression y = parameter(cg, W) * x;
+    return dot_product(y, input(cg, {2}, {1.f, 2.f}));
+  }
+
+  Model mod;
+  Parameters* W;
+  ExecutionContext own, other;
+};
+
+BOOST_FIXTURE_TEST_SUITE(context_test, ContextTest);
+
+BOOST_AUTO_TEST_CASE( graphs_in_different_contexts ) {
+  ComputationGraph cg1(own);
+  ComputationGraph cg2(other);
+  loss(cg1);
+  loss(cg2);
+  BOOST_CHECK_CLOSE(as_scalar(cg1.forward()), 5.5f, 1e-4);
+  BOOST_CHECK_CLOSE(as_scalar(cg2.forward()), 5.5f, 1e-4);
+  mod.reset_gradient();
+  cg1.backward();
+  cg2.backward();
+  vector<float> g = as_vector(W->g);
+  vector<float> expected = {2.f, 4.f, 2.f, 4.f, 2.f, 4.f};
+  for (unsigned i = 0; i < g.size(); ++i)
+    BOOST_CHECK_CLOSE(g[i], expected[i], 1e-4);
+  mod.reset_gradient();
+}
+
+BOOST_AUTO_TEST_CASE( one_graph_per_context ) {
+  ComputationGraph cg(own);
+  BOOST_CHECK_THROW(ComputationGraph cg2(own), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( context_random_engine ) {
+  own.set_random_engine(3);
+  other.set_random_engine(3);
+  vector<float> ones(100, 1.f), a, b;
+  {
+    ComputationGraph cg(own);
+    a = as_vector(dropout(input(cg, {100}, ones), 0.5f).value());
+  }
+  {
+    ComputationGraph cg(other);
+    b = as_vector(dropout(input(cg, {100}, ones), 0.5f).value());
+  }
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_CASE( thread_context_graphs ) {
+  ComputationGraph cg;  // in default_context
+  BOOST_CHECK_EQUAL(cg.context, default_context);
+  float value = 0.f;
+  ExecutionContext* used = nullptr;
+  thread t([&]() {
+    set_thread_context(&own);
+    ComputationGraph tcg;
+    used = tcg.context;
+    loss(tcg);
+    value = as_scalar(tcg.forward());
+    set_thread_context(nullptr);
+  });
+  t.join();
+  BOOST_CHECK_EQUAL(used, &own);
+  BOOST_CHECK_CLOSE(value, 5.5f, 1e-4);
+}
+
+// lock_all keeps a backward pass from adding to the gradients, even when
+// dense gradients are added to without locks
+BOOST_AUTO_TEST_CASE( lock_all_excludes_backward ) {
+  GradientLocks locks(false);
+  gradient_locks = &locks;
+  mod.reset_gradient();
+  locks.lock_all();
+  atomic<bool> finished(false);
+  thread t([&]() {
+    set_thread_context(&own);
+    {
+      ComputationGraph tcg;
+      loss(tcg);
+      tcg.forward();
+      tcg.backward();
+    }
+    set_thread_context(nullptr);
+    finished = true;
+  });
+  this_thread::sleep_for(chrono::milliseconds(50));
+  BOOST_CHECK(!finished);
+  BOOST_CHECK_EQUAL(as_vector(W->g)[0], 0.f);
+  locks.unlock_all();
+  t.join();
+  BOOST_CHECK_CLOSE(as_vector(W->g)[0], 1.f, 1e-4);
+  gradient_locks = nullptr;
+  mod.reset_gradient();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
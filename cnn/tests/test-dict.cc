@@ -0,0 +1,103 @@
+#include <cnn/dict.h>
+#include <cnn/frozen-dict.h>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace cnn;
+using namespace std;
+
+struct DictTest {
+  DictTest() {
+    for (unsigned i = 0; i < 1000; ++i) words.push_back("w" + to_string(i * 7919 % 1000));
+    words[3] = "";  // a hole
+    words[10] = "two words";
+  }
+
+  // every word is found at its id, and nothing else is found
+  void check(const FrozenDict& d) {
+    BOOST_REQUIRE_EQUAL(d.size(), words.size());
+    for (unsigned i = 0; i < words.size(); ++i) {
+      BOOST_CHECK_EQUAL(d.c_str(i), words[i]);
+      BOOST_CHECK_EQUAL(d.length(i), words[i].size());
+      if (!words[i].empty()) BOOST_CHECK_EQUAL(d.find(words[i]), (int)i);
+    }
+    BOOST_CHECK_EQUAL(d.find(""), -1);
+    BOOST_CHECK_EQUAL(d.find("w1000"), -1);
+    BOOST_CHECK_EQUAL(d.find("two"), -1);
+    BOOST_CHECK_EQUAL(d.find("two words", 3), -1);
+  }
+
+  vector<string> words;
+};
+
+BOOST_FIXTURE_TEST_SUITE(dict_test, DictTest);
+
+BOOST_AUTO_TEST_CASE( frozen_dict_lookup ) {
+  FrozenDict d(words);
+  check(d);
+  FrozenDict copy = d;
+  check(copy);
+  BOOST_CHECK_EQUAL(FrozenDict().find("w1"), -1);
+  BOOST_CHECK_EQUAL(FrozenDict(vector<string>()).find("w1"), -1);
+  const vector<string> twice = {"a", "b", "a"};
+  BOOST_CHECK_THROW(FrozenDict{twice}, std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( frozen_dict_save_map ) {
+  char fname[] = "/tmp/test-dict-XXXXXX";
+  close(mkstemp(fname));
+  FrozenDict(words).save(fname);
+  FrozenDict d;
+  d.map(fname);
+  remove(fname);
+  check(d);
+  BOOST_CHECK_THROW(d.map(fname), std::runtime_error);
+  check(d);
+}
+
+BOOST_AUTO_TEST_CASE( frozen_dict_serialize ) {
+  stringstream ss;
+  {
+    boost::archive::text_oarchive oa(ss);
+    FrozenDict d(words);
+    oa << d;
+  }
+  boost::archive::text_iarchive ia(ss);
+  FrozenDict d;
+  ia >> d;
+  check(d);
+}
+
+BOOST_AUTO_TEST_CASE( frozen_dict_convert ) {
+  Dict d;
+  for (unsigned i = 0; i < 5; ++i) d.Convert("w" + to_string(i));
+  d.Freeze();
+  BOOST_CHECK_EQUAL(d.Convert("w3"), 3);
+  BOOST_CHECK(d.Contains("w4"));
+  BOOST_CHECK(!d.Contains("w5"));
+  BOOST_CHECK_THROW(d.Convert("w5"), std::runtime_error);
+  d.SetUnk("<unk>");
+  BOOST_CHECK_EQUAL(d.Convert("w5"), 5);
+  BOOST_CHECK_EQUAL(d.Convert("<unk>"), 5);
+  BOOST_CHECK_EQUAL(d.Convert(1), "w1");
+  BOOST_CHECK_EQUAL(d.size(), 6u);
+
+  stringstream ss;
+  {
+    boost::archive::text_oarchive oa(ss);
+    oa << d;
+  }
+  boost::archive::text_iarchive ia(ss);
+  Dict e;
+  ia >> e;
+  BOOST_CHECK(e.is_frozen());
+  BOOST_CHECK_EQUAL(e.Convert("w2"), 2);
+  BOOST_CHECK_EQUAL(e.Convert("w7"), 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+#include <cnn/cnn.h>
+#include <cnn/expr.h>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(model_test);
+
+// rows of 10 floats are padded to 16
+BOOST_AUTO_TEST_CASE( lookup_table_layout ) {
+  Model mod;
+  LookupParameters* p = mod.add_lookup_parameters(5, {10});
+  BOOST_CHECK_EQUAL(p->stride, 16u);
+  for (unsigned i = 0; i < 5; ++i)
+    BOOST_CHECK_EQUAL(p->values[i].v, p->all_values.v + i * 16);
+  vector<float> block = as_vector(p->all_values);
+  for (unsigned i = 0; i < 5; ++i)
+    for (unsigned j = 10; j < 16; ++j)
+      BOOST_CHECK_EQUAL(block[i * 16 + j], 0.f);
+}
+
+// the rows come packed, and go to their padded places; the rest stay
+BOOST_AUTO_TEST_CASE( lookup_table_initialize_rows ) {
+  for (unsigned d : {3u, 10u}) {
+    Model mod;
+    LookupParameters* p = mod.add_lookup_parameters(5, {d});
+    const vector<float> last = as_vector(p->values[4]);
+    vector<float> rows(4 * d);
+    for (unsigned i = 0; i < rows.size(); ++i) rows[i] = i;
+    p->Initialize(rows.data(), 4);
+    for (unsigned i = 0; i < 4; ++i)
+      BOOST_CHECK(as_vector(p->values[i]) == vector<float>(rows.begin() + i * d, rows.begin() + (i + 1) * d));
+    BOOST_CHECK(as_vector(p->values[4]) == last);
+    vector<float> block = as_vector(p->all_values);
+    for (unsigned i = 0; i < 5; ++i)
+      for (unsigned j = d; j < p->stride; ++j)
+        BOOST_CHECK_EQUAL(block[i * p->stride + j], 0.f);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( lookup_table_save_load ) {
+  Model m1, m2;
+  LookupParameters* p1 = m1.add_lookup_parameters(5, {10});
+  LookupParameters* p2 = m2.add_lookup_parameters(5, {10});
+  stringstream ss;
+  {
+    boost::archive::text_oarchive oa(ss);
+    oa << m1;
+  }
+  boost::archive::text_iarchive ia(ss);
+  ia >> m2;
+  BOOST_CHECK(as_vector(p1->all_values) == as_vector(p2->all_values));
+}
+
+BOOST_AUTO_TEST_CASE( batched_lookup_gradients ) {
+  Model mod;
+  LookupParameters* p = mod.add_lookup_parameters(4, {3});
+  const vector<unsigned> ids = {2, 0, 2};
+  {
+    ComputationGraph cg;
+    Expression x = lookup(cg, p, ids);
+    vector<float> v = as_vector(x.value());
+    for (unsigned b = 0; b < ids.size(); ++b)
+      for (unsigned j = 0; j < 3; ++j)
+        BOOST_CHECK_EQUAL(v[b * 3 + j], as_vector(p->values[ids[b]])[j]);
+    // the gradient of row i is the number of times it is looked up
+    sum_batches(sum_cols(transpose(x))).value();
+    cg.backward();
+  }
+  BOOST_CHECK(as_vector(p->grads[0]) == vector<float>(3, 1.f));
+  BOOST_CHECK(as_vector(p->grads[1]) == vector<float>(3, 0.f));
+  BOOST_CHECK(as_vector(p->grads[2]) == vector<float>(3, 2.f));
+  p->clear();
+}
+
+BOOST_AUTO_TEST_CASE( sparse_row_tracker ) {
+  SparseRowTracker t(200), u(200);
+  BOOST_CHECK(t.insert(150));
+  BOOST_CHECK(t.insert(3));
+  BOOST_CHECK(!t.insert(150));
+  u.insert(64);
+  u.insert(3);
+  t.merge(u);
+  BOOST_CHECK_EQUAL(t.size(), 3u);
+  BOOST_CHECK(vector<unsigned>(t.begin(), t.end()) == vector<unsigned>({3, 64, 150}));
+  BOOST_CHECK_EQUAL(t.count(64), 1u);
+  BOOST_CHECK_EQUAL(t.count(65), 0u);
+  t.clear();
+  BOOST_CHECK(t.empty());
+  BOOST_CHECK_EQUAL(t.count(150), 0u);
+  BOOST_CHECK(t.insert(150));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
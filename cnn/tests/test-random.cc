@@ -0,0 +1,79 @@
+#include <cnn/random.h>
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace cnn;
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(random_test);
+
+BOOST_AUTO_TEST_CASE( streams_are_reproducible ) {
+  // an odd size, so the fills also end with a partial block
+  const unsigned n = 1001;
+  vector<float> a(n), b(n), c(n);
+  RandomEngine(7, 1).fill_uniform(a.data(), n, 0.f, 1.f);
+  RandomEngine(7, 1).fill_uniform(b.data(), n, 0.f, 1.f);
+  RandomEngine(7, 2).fill_uniform(c.data(), n, 0.f, 1.f);
+  BOOST_CHECK(a == b);
+  BOOST_CHECK(a != c);
+}
+
+BOOST_AUTO_TEST_CASE( scoped_thread_rng_restores_on_throw ) {
+  RandomEngine e(3);
+  RandomEngine* own = &thread_rng();
+  try {
+    ScopedThreadRng scoped(&e);
+    BOOST_CHECK_EQUAL(&thread_rng(), &e);
+    throw 1;
+  } catch (int) {}
+  BOOST_CHECK_EQUAL(&thread_rng(), own);
+  {
+    ScopedThreadRng scoped(nullptr);
+    BOOST_CHECK_EQUAL(&thread_rng(), own);
+  }
+  BOOST_CHECK_EQUAL(&thread_rng(), own);
+}
+
+BOOST_AUTO_TEST_CASE( fills_have_the_right_distributions ) {
+  const unsigned n = 100001;
+  RandomEngine rng(11);
+  vector<float> x(n);
+  double sum = 0, sq = 0;
+
+  rng.fill_uniform(x.data(), n, -2.f, 2.f);
+  for (float v : x) {
+    BOOST_REQUIRE(v >= -2.f && v < 2.f);
+    sum += v;
+  }
+  BOOST_CHECK_SMALL(sum / n, 0.05);
+
+  rng.fill_bernoulli(x.data(), n, 0.3f, 2.f);
+  unsigned kept = 0;
+  for (float v : x) {
+    BOOST_REQUIRE(v == 0.f || v == 2.f);
+    kept += v != 0.f;
+  }
+  BOOST_CHECK_CLOSE(kept / (double)n, 0.3, 3);
+
+  rng.fill_normal(x.data(), n, 1.f, 0.5f);
+  sum = 0;
+  for (float v : x) {
+    sum += v;
+    sq += v * v;
+  }
+  BOOST_CHECK_CLOSE(sum / n, 1.0, 2);
+  BOOST_CHECK_CLOSE(sq / n - (sum / n) * (sum / n), 0.25, 3);
+}
+
+BOOST_AUTO_TEST_CASE( thread_streams_follow_the_seed ) {
+  set_random_seed(5);
+  const unsigned a = thread_rng()();
+  set_thread_rng_stream(3);
+  const unsigned b = thread_rng()();
+  BOOST_CHECK_EQUAL(a, RandomEngine(5, 0)());
+  BOOST_CHECK_EQUAL(b, RandomEngine(5, 3)());
+  set_thread_rng_stream(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
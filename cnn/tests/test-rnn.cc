@@ -0,0 +1,115 @@
+#include <cnn/cnn.h>
+#include <cnn/expr.h>
+#include <cnn/gru.h>
+#include <cnn/lstm.h>
+#include <boost/test/unit_test.hpp>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+struct RNNTest {
+  RNNTest() : lstm(2, 3, 16, &mod), gru(2, 3, 16, &mod) {
+    xs = {{1.f, 0.f, -1.f}, {0.5f, 0.2f, 0.1f}, {-0.3f, 0.8f, 0.f}, {0.f, 0.f, 2.f}};
+  }
+
+  // the outputs of a sequence; units dropped by the mask are exactly 0
+  vector<vector<float>> outputs(RNNBuilder& rnn) {
+    ComputationGraph cg;
+    rnn.new_graph(cg);
+    rnn.start_new_sequence();
+    vector<Expression> hs;
+    for (auto& x : xs) hs.push_back(rnn.add_input(input(cg, {3}, x)));
+    vector<vector<float>> res;
+    for (auto& h : hs) res.push_back(as_vector(h.value()));
+    return res;
+  }
+
+  // the nodes that a step after the first adds to the graph
+  unsigned step_nodes(RNNBuilder& rnn) {
+    ComputationGraph cg;
+    rnn.new_graph(cg);
+    rnn.start_new_sequence();
+    rnn.add_input(input(cg, {3}, xs[0]));
+    Expression x = input(cg, {3}, xs[1]);
+    const unsigned before = cg.nodes.size();
+    rnn.add_input(x);
+    return cg.nodes.size() - before;
+  }
+
+  // every step of the sequence drops the same output units
+  void check_same_mask(const vector<vector<float>>& hs) {
+    unsigned dropped = 0;
+    for (unsigned i = 0; i < hs[0].size(); ++i) {
+      if (hs[0][i] == 0.f) ++dropped;
+      for (unsigned t = 1; t < hs.size(); ++t)
+        BOOST_CHECK_EQUAL(hs[0][i] == 0.f, hs[t][i] == 0.f);
+    }
+    BOOST_CHECK(dropped > 0);
+    BOOST_CHECK(dropped < hs[0].size());
+  }
+
+  Model mod;
+  LSTMBuilder lstm;
+  GRUBuilder gru;
+  vector<vector<float>> xs;
+};
+
+BOOST_FIXTURE_TEST_SUITE(rnn_test, RNNTest);
+
+BOOST_AUTO_TEST_CASE( lstm_variational_dropout ) {
+  lstm.set_variational_dropout(0.5f);
+  check_same_mask(outputs(lstm));
+  lstm.disable_dropout();
+}
+
+BOOST_AUTO_TEST_CASE( gru_variational_dropout ) {
+  gru.set_variational_dropout(0.5f);
+  check_same_mask(outputs(gru));
+  gru.disable_dropout();
+}
+
+// with one layer and zero inputs, only the mask of h_{t-1} can make two
+// sequences differ (in the units both keep) after their first step
+BOOST_AUTO_TEST_CASE( masks_recurrent_input ) {
+  LSTMBuilder lstm1(1, 3, 16, &mod);
+  GRUBuilder gru1(1, 3, 16, &mod);
+  lstm1.set_variational_dropout(0.5f);
+  gru1.set_variational_dropout(0.5f);
+  xs = vector<vector<float>>(xs.size(), vector<float>(3, 0.f));
+  for (RNNBuilder* rnn : {(RNNBuilder*)&lstm1, (RNNBuilder*)&gru1}) {
+    vector<vector<float>> a = outputs(*rnn), b = outputs(*rnn);
+    bool differ = false;
+    for (unsigned i = 0; i < a[0].size(); ++i) {
+      if (a[0][i] == 0.f || b[0][i] == 0.f) continue;
+      BOOST_CHECK_EQUAL(a[0][i], b[0][i]);
+      for (unsigned t = 1; t < a.size(); ++t)
+        if (a[t][i] != b[t][i]) differ = true;
+    }
+    BOOST_CHECK(differ);
+  }
+}
+
+// the gates share the masks: a step masks the input and h_{t-1} of each
+// layer once, and the output
+BOOST_AUTO_TEST_CASE( variational_dropout_nodes ) {
+  for (RNNBuilder* rnn : {(RNNBuilder*)&lstm, (RNNBuilder*)&gru}) {
+    const unsigned plain = step_nodes(*rnn);
+    if (rnn == &lstm) lstm.set_variational_dropout(0.5f);
+    else gru.set_variational_dropout(0.5f);
+    BOOST_CHECK_EQUAL(step_nodes(*rnn), plain + 2 * 2 + 1);
+  }
+  lstm.disable_dropout();
+  gru.disable_dropout();
+}
+
+BOOST_AUTO_TEST_CASE( variational_dropout_rate ) {
+  for (float p : {1.f, 1.5f, -0.1f}) {
+    BOOST_CHECK_THROW(lstm.set_variational_dropout(p), std::invalid_argument);
+    BOOST_CHECK_THROW(gru.set_variational_dropout(p), std::invalid_argument);
+  }
+  lstm.set_variational_dropout(0.f);
+  gru.set_variational_dropout(0.f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
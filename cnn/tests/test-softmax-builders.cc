@@ -0,0 +1,114 @@
+#include <cnn/cnn.h>
+#include <cnn/cfsm-builder.h>
+#include <cnn/expr.h>
+#include <cnn/hsm-builder.h>
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+const unsigned kRepDim = 4;
+
+struct SoftmaxBuilderTest {
+  SoftmaxBuilderTest() {
+    for (unsigned i = 0; i < 7; ++i) d.Convert("w" + to_string(i));
+    // classes of 3 and 2 words, and a singleton
+    clusters = write_file("a\tw0\na\tw1\na\tw2\nb\tw3\nb\tw4\nc\tw5\nc\tw6\n");
+    singletons = write_file("a\tw0\na\tw1\na\tw2\nb\tw3\nb\tw4\nc\tw5\nd\tw6\n");
+    // a ternary root, a binary node, and a leaf with a single word
+    paths = write_file("0 0\tw0\n0 0\tw1\n0 1\tw2\n0 1\tw3\n1\tw4\n1\tw5\n2\tw6\n");
+    words = {0, 3, 5, 0, 6, 2, 1, 4};
+    for (unsigned i = 0; i < words.size() * kRepDim; ++i)
+      reps.push_back(0.1f * ((i * 7) % 11) - 0.5f);
+  }
+  ~SoftmaxBuilderTest() {
+    for (auto& f : files) remove(f.c_str());
+  }
+
+  string write_file(const string& contents) {
+    char fname[] = "/tmp/test-softmax-XXXXXX";
+    close(mkstemp(fname));
+    ofstream(fname) << contents;
+    files.push_back(fname);
+    return fname;
+  }
+
+  // the loss and all gradients of the words, one at a time or batched as
+  // columns (or as a mini-batch)
+  vector<float> loss_and_grads(FactoredSoftmaxBuilder& sm, Model& mod, bool batched,
+                               bool minibatch = false) {
+    ComputationGraph cg;
+    sm.new_graph(cg);
+    Expression loss;
+    if (!batched) {
+      vector<Expression> losses;
+      for (unsigned i = 0; i < words.size(); ++i) {
+        vector<float> rep(reps.begin() + i * kRepDim, reps.begin() + (i + 1) * kRepDim);
+        losses.push_back(sm.neg_log_softmax(input(cg, {kRepDim}, rep), words[i]));
+      }
+      loss = sum(losses);
+    } else if (minibatch) {
+      loss = sm.neg_log_softmax(input(cg, Dim({kRepDim}, words.size()), reps), words);
+    } else {
+      loss = sm.neg_log_softmax(input(cg, {kRepDim, (unsigned)words.size()}, reps), words);
+    }
+    vector<float> res = {as_scalar(cg.forward())};
+    mod.reset_gradient();
+    cg.backward();
+    for (auto p : mod.parameters_list()) {
+      vector<float> g = as_vector(p->g);
+      res.insert(res.end(), g.begin(), g.end());
+    }
+    mod.reset_gradient();
+    return res;
+  }
+
+  void check_batched(FactoredSoftmaxBuilder& sm, Model& mod) {
+    vector<float> expected = loss_and_grads(sm, mod, false);
+    BOOST_CHECK_GT(expected[0], 0.f);
+    for (bool minibatch : {false, true}) {
+      vector<float> actual = loss_and_grads(sm, mod, true, minibatch);
+      BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+      for (unsigned i = 0; i < actual.size(); ++i)
+        BOOST_CHECK_SMALL(actual[i] - expected[i], 1e-5f);
+    }
+  }
+
+  Dict d;
+  string clusters, singletons, paths;
+  vector<string> files;
+  vector<unsigned> words;
+  vector<float> reps;
+};
+
+BOOST_FIXTURE_TEST_SUITE(softmax_builder_test, SoftmaxBuilderTest);
+
+BOOST_AUTO_TEST_CASE( non_factored_batch ) {
+  Model mod;
+  NonFactoredSoftmaxBuilder sm(kRepDim, d.size(), &mod);
+  check_batched(sm, mod);
+}
+
+BOOST_AUTO_TEST_CASE( class_factored_batch ) {
+  Model mod;
+  ClassFactoredSoftmaxBuilder sm(kRepDim, clusters, &d, &mod);
+  check_batched(sm, mod);
+}
+
+BOOST_AUTO_TEST_CASE( class_factored_batch_singletons ) {
+  Model mod;
+  ClassFactoredSoftmaxBuilder sm(kRepDim, singletons, &d, &mod);
+  check_batched(sm, mod);
+}
+
+BOOST_AUTO_TEST_CASE( hierarchical_batch ) {
+  Model mod;
+  HierarchicalSoftmaxBuilder sm(kRepDim, paths, &d, &mod);
+  check_batched(sm, mod);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,144 @@
+#include <cnn/cnn.h>
+#include <cnn/expr.h>
+#include <cnn/stack-lstm.h>
+#include <boost/test/unit_test.hpp>
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace std;
+
+struct StackLSTMTest {
+  StackLSTMTest() : slstm(2, 3, 4, &mod) {
+    xs = {{1.f, 0.f, -1.f}, {0.5f, 0.2f, 0.1f}, {-0.3f, 0.8f, 0.f}, {0.f, 0.f, 2.f}};
+    // push the first three elements, pop twice, push the last one
+    ops = {0, 1, 2, -1, -1, 3};
+  }
+
+  // returns top() after each operation
+  vector<vector<float>> run(StackLSTMBuilder& b, bool inference) {
+    vector<vector<float>> tops;
+    ComputationGraph cg;
+    b.new_graph(cg, inference);
+    for (int op : ops) {
+      if (op < 0) {
+        b.pop();
+      } else {
+        b.push(input(cg, {3}, xs[op]));
+      }
+      tops.push_back(as_vector(b.top().value()));
+    }
+    return tops;
+  }
+
+  void check_inference_matches_graph(StackLSTMBuilder& b) {
+    vector<vector<float>> expected = run(b, false);
+    vector<vector<float>> actual = run(b, true);
+    BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+    for (unsigned t = 0; t < expected.size(); ++t)
+      for (unsigned i = 0; i < expected[t].size(); ++i)
+        BOOST_CHECK_SMALL(expected[t][i] - actual[t][i], 1e-5f);
+    // popping goes back to the state of the element below
+    for (unsigned i = 0; i < expected[0].size(); ++i)
+      BOOST_CHECK_EQUAL(expected[0][i], expected[4][i]);
+  }
+
+  Model mod;
+  StackLSTMBuilder slstm;
+  vector<vector<float>> xs;
+  vector<int> ops;
+};
+
+BOOST_FIXTURE_TEST_SUITE(stack_lstm_test, StackLSTMTest);
+
+BOOST_AUTO_TEST_CASE( inference_matches_graph ) {
+  check_inference_matches_graph(slstm);
+}
+
+BOOST_AUTO_TEST_CASE( gru_inference_matches_graph ) {
+  StackLSTMBuilder sgru("gru", 2, 3, 4, &mod);
+  check_inference_matches_graph(sgru);
+}
+
+BOOST_AUTO_TEST_CASE( sizes ) {
+  ComputationGraph cg;
+  slstm.new_graph(cg, true);
+  BOOST_CHECK(slstm.empty());
+  slstm.push(input(cg, {3}, xs[0]));
+  slstm.push(input(cg, {3}, xs[1]));
+  BOOST_CHECK_EQUAL(slstm.size(), 2);
+  slstm.pop();
+  BOOST_CHECK_EQUAL(slstm.size(), 1);
+  BOOST_CHECK_EQUAL(slstm.top_input().i, 0);
+}
+
+BOOST_AUTO_TEST_CASE( default_constructed ) {
+  // a placeholder, as the parser's buffer LSTM is for window models
+  StackLSTMBuilder b;
+  BOOST_CHECK(b.empty());
+  BOOST_CHECK(!b.can_fold_inputs());
+  BOOST_CHECK(!b.rnn);
+  b.disable_dropout();
+  b = StackLSTMBuilder(2, 3, 4, &mod);
+  BOOST_CHECK(b.can_fold_inputs());
+}
+
+BOOST_AUTO_TEST_CASE( dropout_by_cell ) {
+  for (const char* cell : {"lstm", "gru"}) {
+    StackLSTMBuilder b(cell, 2, 3, 4, &mod);
+    b.set_dropout(0.5f);
+    b.set_variational_dropout(0.5f);
+    b.disable_dropout();
+  }
+  for (const char* cell : {"fast-lstm", "rnn"}) {
+    StackLSTMBuilder b(cell, 2, 3, 4, &mod);
+    BOOST_CHECK_THROW(b.set_dropout(0.5f), std::invalid_argument);
+    BOOST_CHECK_THROW(b.set_variational_dropout(0.5f), std::invalid_argument);
+    b.set_dropout(0.f);
+    b.disable_dropout();
+  }
+}
+
+// the same output units are dropped after every push and pop, and none
+// in inference mode
+BOOST_AUTO_TEST_CASE( variational_dropout ) {
+  for (const char* cell : {"lstm", "gru"}) {
+    StackLSTMBuilder b(cell, 2, 3, 16, &mod);
+    b.set_variational_dropout(0.5f);
+    vector<vector<float>> tops = run(b, false);
+    unsigned dropped = 0;
+    for (unsigned i = 0; i < tops[0].size(); ++i) {
+      if (tops[0][i] == 0.f) ++dropped;
+      for (unsigned t = 1; t < tops.size(); ++t)
+        BOOST_CHECK_EQUAL(tops[0][i] == 0.f, tops[t][i] == 0.f);
+    }
+    BOOST_CHECK(dropped > 0);
+    for (auto& top : run(b, true))
+      for (float h : top) BOOST_CHECK(h != 0.f);
+    b.disable_dropout();
+  }
+}
+
+BOOST_AUTO_TEST_CASE( folded_inputs_match ) {
+  for (const char* cell : {"lstm", "gru"}) {
+    StackLSTMBuilder b(cell, 2, 3, 4, &mod);
+    LookupParameters* p_x = mod.add_lookup_parameters(xs.size(), {3});
+    LookupParameters* p_fold = mod.add_lookup_parameters(xs.size(), {12});
+    for (unsigned i = 0; i < xs.size(); ++i) p_x->Initialize(i, xs[i]);
+    b.fold_inputs(*p_x, p_fold);
+    vector<vector<float>> expected = run(b, true);
+    ComputationGraph cg;
+    b.new_graph(cg, true);
+    for (unsigned t = 0; t < ops.size(); ++t) {
+      if (ops[t] < 0) {
+        b.pop();
+      } else {
+        b.push(const_lookup(cg, p_x, ops[t]), p_fold->values[ops[t]]);
+      }
+      vector<float> actual = as_vector(b.top().value());
+      for (unsigned i = 0; i < actual.size(); ++i)
+        BOOST_CHECK_SMALL(expected[t][i] - actual[i], 1e-5f);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Compares decoding speed and accuracy of the recurrent cell configurations.
+# Each configuration is trained for the same wall-clock budget and then
+# evaluated on the dev set.
+#
+# usage: benchmark-cells.sh path/to/lstm-parse trainOracle.txt devOracle.txt
+#          [training seconds] [extra lstm-parse options]
+
+if [ $# -lt 3 ]; then
+  echo "usage: $0 lstm-parse trainOracle.txt devOracle.txt [seconds] [options]" >&2
+  exit 1
+fi
+PARSER=$(readlink -f "$1")
+TRAIN=$(readlink -f "$2")
+DEV=$(readlink -f "$3")
+SECONDS_PER_CONFIG=${4:-600}
+shift 4 2>/dev/null
+EXTRA="$@"
+
+# stack buffer action
+CONFIGS=(
+  "lstm lstm lstm"
+  "fast-lstm fast-lstm fast-lstm"
+  "gru gru gru"
+  "lstm lstm rnn"
+  "gru gru rnn"
+)
+
+WORK=$(mktemp -d)
+cd "$WORK"
+printf "%-10s %-10s %-10s %8s %10s\n" stack buffer action uas sents/sec
+for config in "${CONFIGS[@]}"; do
+  set -- $config
+  timeout -s INT "$SECONDS_PER_CONFIG" "$PARSER" -T "$TRAIN" -d "$DEV" -t \
+      --stack_cell $1 --buffer_cell $2 --action_cell $3 $EXTRA \
+      > /dev/null 2> log.txt
+  # TEST llh=0 ppl: 1 err: 0.1 uas: 0.9	[N sents in X ms]
+  line=$(grep '^TEST' log.txt | tail -1)
+  uas=$(echo "$line" | sed -e 's/.*uas: \([^[:space:]]*\).*/\1/')
+  rate=$(echo "$line" | sed -e 's/.*\[\([0-9]*\) sents in \([0-9.]*\) ms\].*/\1 \2/' |
+         awk '{ printf "%.1f", $1 * 1000 / $2 }')
+  printf "%-10s %-10s %-10s %8s %10s\n" $1 $2 $3 "$uas" "$rate"
+done
+rm -rf "$WORK"
@@ -0,0 +1,54 @@
+#!/bin/bash
+# Compares decoding speed with the token projections of the composition
+# function computed for the whole sentence at once (the default) and one
+# token at a time (--unbatched_compose), by sentence length.
+#
+# usage: benchmark-compose.sh path/to/lstm-parse trainOracle.txt devOracle.txt
+#          model.params [repetitions] [extra lstm-parse options]
+# the extra options must match the ones the model was trained with.
+
+if [ $# -lt 4 ]; then
+  echo "usage: $0 lstm-parse trainOracle.txt devOracle.txt model.params [repetitions] [options]" >&2
+  exit 1
+fi
+PARSER=$(readlink -f "$1")
+TRAIN=$(readlink -f "$2")
+DEV=$(readlink -f "$3")
+MODEL=$(readlink -f "$4")
+REPETITIONS=${5:-3}
+shift 5 2>/dev/null
+EXTRA="$@"
+
+# sentence length buckets (in tokens, including ROOT)
+BUCKETS=("1 10" "11 20" "21 40" "41 80" "81 100000")
+
+WORK=$(mktemp -d)
+cd "$WORK"
+
+# best time in ms over the repetitions
+decode_ms() {
+  local best=""
+  for r in $(seq "$REPETITIONS"); do
+    "$PARSER" -T "$TRAIN" -d "$1" -m "$MODEL" $EXTRA $2 > /dev/null 2> log.txt
+    # TEST llh=0 ppl: 1 err: 0.1 uas: 0.9	[N sents in X ms]
+    ms=$(grep '^TEST' log.txt | tail -1 | sed -e 's/.*sents in \([0-9.]*\) ms\].*/\1/')
+    best=$(echo "$best $ms" | awk '{ if (NF == 1 || $2 < $1) print $NF; else print $1 }')
+  done
+  echo "$best"
+}
+
+printf "%-10s %6s %12s %12s %8s\n" tokens sents batched-ms unbatched-ms speedup
+for bucket in "${BUCKETS[@]}"; do
+  set -- $bucket
+  # sentences are blank-line separated; the first line lists the tokens
+  awk -v lo=$1 -v hi=$2 'BEGIN { RS = ""; ORS = "\n\n" }
+      { split($0, lines, "\n"); n = split(lines[1], toks, ", ");
+        if (n >= lo && n <= hi) print }' "$DEV" > bucket.txt
+  nsents=$(grep -c '^\[\]\[' bucket.txt)
+  if [ "$nsents" -eq 0 ]; then continue; fi
+  batched=$(decode_ms bucket.txt "")
+  unbatched=$(decode_ms bucket.txt --unbatched_compose)
+  printf "%-10s %6d %12s %12s %8s\n" "$1-$2" "$nsents" "$batched" "$unbatched" \
+      $(echo "$batched $unbatched" | awk '{ printf "%.2fx", $2 / $1 }')
+done
+rm -rf "$WORK"
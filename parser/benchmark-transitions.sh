@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compares the transition systems: each is trained for the same wall-clock
+# budget and then evaluated on the dev set, reporting the number of
+# transitions per sentence and decoding speed. the UAS of every system is
+# measured against the dev trees as read, so the non-projective arcs that
+# arc-hybrid and arc-eager cannot build count as errors.
+#
+# usage: benchmark-transitions.sh path/to/lstm-parse train.conll dev.conll
+#          [training seconds] [extra lstm-parse options]
+
+if [ $# -lt 3 ]; then
+  echo "usage: $0 lstm-parse train.conll dev.conll [seconds] [options]" >&2
+  exit 1
+fi
+PARSER=$(readlink -f "$1")
+TRAIN=$(readlink -f "$2")
+DEV=$(readlink -f "$3")
+SECONDS_PER_CONFIG=${4:-600}
+shift 3; [ $# -gt 0 ] && shift
+EXTRA="$@"
+
+WORK=$(mktemp -d)
+cd "$WORK"
+printf "%-8s %8s %14s %8s %10s\n" system uas transitions max sents/sec
+for system in swap hybrid eager; do
+  timeout -s INT "$SECONDS_PER_CONFIG" "$PARSER" -T "$TRAIN" -d "$DEV" -t \
+      --transitions $system $EXTRA > /dev/null 2> log.txt
+  # TEST llh=0 ppl: 1 err: 0.1 uas: 0.9	[N sents in X ms]
+  line=$(grep '^TEST' log.txt | tail -1)
+  uas=$(echo "$line" | sed -e 's/.*uas: \([^[:space:]]*\).*/\1/')
+  rate=$(echo "$line" | sed -e 's/.*\[\([0-9]*\) sents in \([0-9.]*\) ms\].*/\1 \2/' |
+         awk '{ printf "%.1f", $1 * 1000 / $2 }')
+  # TRANSITIONS per sentence: X (max Y)
+  transitions=$(grep '^TRANSITIONS' log.txt | tail -1 |
+                sed -e 's/.*sentence: \([0-9.]*\) (max \([0-9]*\)).*/\1 \2/')
+  printf "%-8s %8s %14s %8s %10s\n" $system "$uas" $transitions "$rate"
+done
+rm -rf "$WORK"
@@ -1,6 +1,7 @@
 #ifndef CPYPDICT_H_
 #define CPYPDICT_H_
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <cassert>
@@ -12,8 +13,12 @@
 #include <functional>
 #include <vector>
 #include <map>
+#include <stdexcept>
 #include <string>
 
+#include "cnn/frozen-dict.h"
+#include "oracle.h"
+
 namespace cpyp {
 
 class Corpus {
@@ -30,7 +35,17 @@ public:
    std::map<int,std::vector<unsigned>> sentencesDev;
    std::map<int,std::vector<unsigned>> sentencesPosDev;
    std::map<int,std::vector<std::string>> sentencesStrDev;
+   // the heads of the dev sentences when read from a CoNLL file, which the
+   // dev UAS is measured against (see OracleSentence::heads)
+   std::map<int,std::vector<int>> headsDev;
    unsigned nsentencesDev;
+   // the system of the oracles computed for treebanks (oracle files are
+   // always of kSWAP)
+   TransitionSystem transitions = kSWAP;
+   // the non-projective arcs lifted in the training and dev treebanks (see
+   // read_conll_oracle)
+   unsigned lifted = 0;
+   unsigned liftedDev = 0;
 
    unsigned nsentences;
    unsigned nwords;
@@ -53,6 +68,11 @@ public:
    std::map<std::string, unsigned> charsToInt;
    std::map<unsigned, std::string> intToChars;
 
+   // the words and POS tags known when freeze() is called, for lookups while
+   // reading the dev/test data
+   cnn::FrozenDict frozenWords;
+   cnn::FrozenDict frozenPos;
+
    // String literals
    static constexpr const char* UNK = "UNK";
    static constexpr const char* BAD0 = "<BAD0>";
@@ -86,9 +106,61 @@ inline unsigned UTF8Len(unsigned char x) {
 
 
 
+// adds a token of a training sentence, and its word and POS tag if they
+// are new
+inline void add_token(const std::string& word, const std::string& pos,
+                      std::vector<unsigned>* current_sent, std::vector<unsigned>* current_sent_pos) {
+  // new POS tag
+  if (posToInt[pos] == 0) {
+    posToInt[pos] = maxPos;
+    intToPos[maxPos] = pos;
+    npos = maxPos;
+    maxPos++;
+  }
+
+  // new word
+  if (wordsToInt[word] == 0) {
+    wordsToInt[word] = max;
+    intToWords[max] = word;
+    nwords = max;
+    max++;
+
+    unsigned j = 0;
+    while(j < word.length()) {
+      std::string wj = "";
+      for (unsigned h = j; h < j + UTF8Len(word[j]); h++) {
+        wj += word[h];
+      }
+      if (charsToInt[wj] == 0) {
+        charsToInt[wj] = maxChars;
+        intToChars[maxChars] = wj;
+        maxChars++;
+      }
+      j += UTF8Len(word[j]);
+    }
+  }
+
+  current_sent->push_back(wordsToInt[word]);
+  current_sent_pos->push_back(posToInt[pos]);
+}
+
+// adds a transition of a training sentence, and the action if it is new
+inline void add_action(int sentence, const std::string& action) {
+  auto it = std::find(actions.begin(), actions.end(), action);
+  correct_act_sent[sentence].push_back(std::distance(actions.begin(), it));
+  if (it == actions.end()) actions.push_back(action);
+}
+
+// reads the training sentences and their transitions from an oracle file,
+// or from a CoNLL treebank, computing the oracle (see read_conll_oracle)
 inline void load_correct_actions(std::string file){
 	
-  std::ifstream actionsFile(file);
+  const bool conll = is_conll(file);
+  // the oracle, unless the file is a treebank
+  std::ifstream actionsFile;
+  if (!conll && transitions != kSWAP)
+    throw std::invalid_argument("Oracle files are arc-standard with SWAP: read " + file + " as a CoNLL treebank instead");
+  if (!conll) actionsFile.open(file);
   //correct_act_sent=new vector<vector<unsigned>>();
   std::string lineS;
 	
@@ -111,6 +183,25 @@ inline void load_correct_actions(std::string file){
   
 	std::vector<unsigned> current_sent;
   std::vector<unsigned> current_sent_pos;
+  if (conll) {
+    std::vector<OracleSentence> oracle = read_conll_oracle(file, transitions, &lifted);
+    for (unsigned s = 0; s < oracle.size(); ++s) {
+      OracleSentence& o = oracle[s];
+      for (unsigned i = 0; i < o.words.size(); ++i) {
+        ReplaceStringInPlace(o.words[i], "-RRB-", "_RRB_");
+        ReplaceStringInPlace(o.words[i], "-LRB-", "_LRB_");
+        ReplaceStringInPlace(o.tags[i], "-RRB-", "_RRB_");
+        ReplaceStringInPlace(o.tags[i], "-LRB-", "_LRB_");
+        add_token(o.words[i], o.tags[i], &current_sent, &current_sent_pos);
+      }
+      sentences[s] = current_sent;
+      sentencesPos[s] = current_sent_pos;
+      current_sent.clear();
+      current_sent_pos.clear();
+      for (auto& a : o.actions) add_action(s, a);
+    }
+    nsentences = oracle.size();
+  }
   while (getline(actionsFile, lineS)){
     //istringstream iss(line);
     //string lineS;
@@ -157,60 +248,13 @@ inline void load_correct_actions(std::string file){
           assert(posIndex != std::string::npos);
           std::string pos = word.substr(posIndex + 1);
           word = word.substr(0, posIndex);
-          // new POS tag
-          if (posToInt[pos] == 0) {
-            posToInt[pos] = maxPos;
-            intToPos[maxPos] = pos;
-            npos = maxPos;
-            maxPos++;
-          }
-
-          // new word
-          if (wordsToInt[word] == 0) {
-            wordsToInt[word] = max;
-            intToWords[max] = word;
-            nwords = max;
-            max++;
-
-            unsigned j = 0;
-            while(j < word.length()) {
-              std::string wj = "";
-              for (unsigned h = j; h < j + UTF8Len(word[j]); h++) {
-                wj += word[h];
-              }
-              if (charsToInt[wj] == 0) {
-                charsToInt[wj] = maxChars;
-                intToChars[maxChars] = wj;
-                maxChars++;
-              }
-              j += UTF8Len(word[j]);
-            }
-          }
-        
-          current_sent.push_back(wordsToInt[word]);
-          current_sent_pos.push_back(posToInt[pos]);
+          add_token(word, pos, &current_sent, &current_sent_pos);
         } while(iss);
 			}
 			initial=false;
 		}
 		else if (count==1){
-			int i=0;
-			bool found=false;
-			for (auto a: actions) {
-				if (a==lineS) {
-					std::vector<unsigned> a=correct_act_sent[sentence];
-	                                a.push_back(i);
-        	                        correct_act_sent[sentence]=a;
-					found=true;
-				}
-				i++;
-			}
-			if (!found) {
-				actions.push_back(lineS);
-				std::vector<unsigned> a=correct_act_sent[sentence];
-				a.push_back(actions.size()-1);
-				correct_act_sent[sentence]=a;
-			}
+			add_action(sentence, lineS);
 			count=0;
 		}
 	}
@@ -234,16 +278,6 @@ inline void load_correct_actions(std::string file){
         nwords=max;
         max++;*/
 
-	std::cerr<<"done"<<"\n";
-	for (auto a: actions) {
-		std::cerr<<a<<"\n";
-	}
-	nactions=actions.size();
-	std::cerr<<"nactions:"<<nactions<<"\n";
-        std::cerr<<"nwords:"<<nwords<<"\n";
-	for (unsigned i=0;i<npos;i++){
-                std::cerr<<i<<":"<<intToPos[i]<<"\n";
-        }
 	nactions=actions.size();
 	
 }
@@ -259,8 +293,81 @@ inline unsigned get_or_add_word(const std::string& word) {
   return id;
 }
 
+// builds frozenWords and frozenPos. words or tags added later are still
+// found in the maps
+inline void freeze() {
+  std::vector<std::string> words(max), tags(maxPos);
+  for (auto& w : intToWords)
+    if (w.first < words.size()) words[w.first] = w.second;
+  for (auto& t : intToPos)
+    if (t.first < tags.size()) tags[t.first] = t.second;
+  frozenWords = cnn::FrozenDict(words);
+  frozenPos = cnn::FrozenDict(tags);
+}
+
+// adds a token of a dev sentence. the words and tags not seen in training
+// are added too, but the words are read as UNK (unless USE_SPELLING), and
+// their surface forms kept in current_sent_str
+inline void add_tokenDev(const std::string& word, const std::string& pos,
+                         std::vector<unsigned>* current_sent, std::vector<unsigned>* current_sent_pos,
+                         std::vector<std::string>* current_sent_str) {
+  int posId = frozenPos.find(pos);
+  if (posId < 0) {
+    // new POS tag
+    if (posToInt[pos] == 0) {
+      posToInt[pos] = maxPos;
+      intToPos[maxPos] = pos;
+      npos = maxPos;
+      maxPos++;
+    }
+    posId = posToInt[pos];
+  }
+  // add an empty string for any token except OOVs (it is easy to 
+  // recover the surface form of non-OOV using intToWords(id)).
+  current_sent_str->push_back("");
+  int wordId = frozenWords.find(word);
+  if (wordId <= 0) {  // not found, or BAD0
+    auto wit = wordsToInt.find(word);
+    if (wit != wordsToInt.end() && wit->second != 0) {
+      wordId = wit->second;
+    } else if (USE_SPELLING) {
+      // OOV word
+      max = nwords + 1;
+      //std::cerr<< "max:" << max << "\n";
+      wordsToInt[word] = max;
+      intToWords[max] = word;
+      nwords = max;
+      wordId = max;
+    } else {
+      // save the surface form of this OOV before overwriting it.
+      current_sent_str->back() = word;
+      wordId = wordsToInt[Corpus::UNK];
+    }
+  }
+  current_sent->push_back(wordId);
+  current_sent_pos->push_back(posId);
+}
+
+inline void add_actionDev(int sentence, const std::string& action) {
+  auto actionIter = std::find(actions.begin(), actions.end(), action);
+  if (actionIter != actions.end()) {
+    unsigned actionIndex = std::distance(actions.begin(), actionIter);
+    correct_act_sentDev[sentence].push_back(actionIndex);
+  } else {
+    // TODO: right now, new actions which haven't been observed in training
+    // are not added to correct_act_sentDev. This may be a problem if the
+    // training data is little.
+  }
+}
+
+// reads the dev (or test) sentences and their transitions, from an oracle
+// file or a CoNLL treebank, as load_correct_actions does
 inline void load_correct_actionsDev(std::string file) {
-  std::ifstream actionsFile(file);
+  const bool conll = is_conll(file);
+  std::ifstream actionsFile;
+  if (!conll && transitions != kSWAP)
+    throw std::invalid_argument("Oracle files are arc-standard with SWAP: read " + file + " as a CoNLL treebank instead");
+  if (!conll) actionsFile.open(file);
   std::string lineS;
 
   assert(maxPos > 1);
@@ -272,6 +379,28 @@ inline void load_correct_actionsDev(std::string file) {
   std::vector<unsigned> current_sent;
   std::vector<unsigned> current_sent_pos;
   std::vector<std::string> current_sent_str;
+  if (conll) {
+    std::vector<OracleSentence> oracle = read_conll_oracle(file, transitions, &liftedDev);
+    for (unsigned s = 0; s < oracle.size(); ++s) {
+      OracleSentence& o = oracle[s];
+      for (unsigned i = 0; i < o.words.size(); ++i) {
+        ReplaceStringInPlace(o.words[i], "-RRB-", "_RRB_");
+        ReplaceStringInPlace(o.words[i], "-LRB-", "_LRB_");
+        ReplaceStringInPlace(o.tags[i], "-RRB-", "_RRB_");
+        ReplaceStringInPlace(o.tags[i], "-LRB-", "_LRB_");
+        add_tokenDev(o.words[i], o.tags[i], &current_sent, &current_sent_pos, &current_sent_str);
+      }
+      sentencesDev[s] = current_sent;
+      sentencesPosDev[s] = current_sent_pos;
+      sentencesStrDev[s] = current_sent_str;
+      headsDev[s].swap(o.heads);
+      current_sent.clear();
+      current_sent_pos.clear();
+      current_sent_str.clear();
+      for (auto& a : o.actions) add_actionDev(s, a);
+    }
+    nsentencesDev = oracle.size();
+  }
   while (getline(actionsFile, lineS)) {
     ReplaceStringInPlace(lineS, "-RRB-", "_RRB_");
     ReplaceStringInPlace(lineS, "-LRB-", "_LRB_");
@@ -315,45 +444,12 @@ inline void load_correct_actionsDev(std::string file) {
           assert(posIndex != std::string::npos);
           std::string pos = word.substr(posIndex + 1);
           word = word.substr(0, posIndex);
-          // new POS tag
-          if (posToInt[pos] == 0) {
-            posToInt[pos] = maxPos;
-            intToPos[maxPos] = pos;
-            npos = maxPos;
-            maxPos++;
-          }
-          // add an empty string for any token except OOVs (it is easy to 
-          // recover the surface form of non-OOV using intToWords(id)).
-          current_sent_str.push_back("");
-          // OOV word
-          if (wordsToInt[word] == 0) {
-            if (USE_SPELLING) {
-              max = nwords + 1;
-              //std::cerr<< "max:" << max << "\n";
-              wordsToInt[word] = max;
-              intToWords[max] = word;
-              nwords = max;
-            } else {
-              // save the surface form of this OOV before overwriting it.
-              current_sent_str[current_sent_str.size()-1] = word;
-              word = Corpus::UNK;
-            }
-          }
-          current_sent.push_back(wordsToInt[word]);
-          current_sent_pos.push_back(posToInt[pos]);
+          add_tokenDev(word, pos, &current_sent, &current_sent_pos, &current_sent_str);
         } while(iss);
       }
       initial = false;
     } else if (count == 1) {
-      auto actionIter = std::find(actions.begin(), actions.end(), lineS);
-      if (actionIter != actions.end()) {
-        unsigned actionIndex = std::distance(actions.begin(), actionIter);
-        correct_act_sentDev[sentence].push_back(actionIndex);
-      } else {
-        // TODO: right now, new actions which haven't been observed in training
-        // are not added to correct_act_sentDev. This may be a problem if the
-        // training data is little.
-      }
+      add_actionDev(sentence, lineS);
       count=0;
     }
   }
@@ -0,0 +1,118 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// the phases of parsing a sentence that are timed separately
+enum ParsePhase { kBUFFER, kTRANSITIONS, kOUTPUT, kTOTAL, kNUM_PHASES };
+
+// a histogram of latencies with logarithmic bins, each kGROWTH times as wide
+// as the one before, from kMIN_MS up: percentiles are exact to within that
+// factor, and memory does not grow with the number of sentences
+struct LatencyHistogram {
+  static constexpr double kMIN_MS = 1e-3;
+  static constexpr double kGROWTH = 1.05;
+  LatencyHistogram() : count(), max_ms(), bins(450) {}
+
+  void add(double ms) {
+    unsigned b = 0;
+    if (ms > kMIN_MS) b = std::min<unsigned>(bins.size() - 1, std::log(ms / kMIN_MS) / std::log(kGROWTH));
+    ++bins[b];
+    ++count;
+    max_ms = std::max(max_ms, ms);
+  }
+
+  // the upper edge of the bin of the p'th percentile (p in [0, 100])
+  double percentile(double p) const {
+    if (count == 0) return 0;
+    const unsigned long rank = std::max<unsigned long>(1, std::ceil(p / 100 * count));
+    unsigned long seen = 0;
+    for (unsigned b = 0; b < bins.size(); ++b) {
+      seen += bins[b];
+      if (seen >= rank) return std::min(max_ms, kMIN_MS * std::pow(kGROWTH, b + 1));
+    }
+    return max_ms;
+  }
+
+  unsigned long count;
+  double max_ms;
+  std::vector<unsigned long> bins;
+};
+
+// per sentence latencies of each phase, bucketed by sentence length (in
+// words, ROOT not counted)
+struct LatencyStats {
+  LatencyStats() : buckets({1, 11, 21, 41, 81}), histograms(buckets.size() * kNUM_PHASES) {}
+
+  void add(unsigned length, const double ms[kNUM_PHASES]) {
+    unsigned b = buckets.size() - 1;
+    while (b > 0 && length < buckets[b]) --b;
+    for (unsigned p = 0; p < kNUM_PHASES; ++p)
+      histograms[b * kNUM_PHASES + p].add(ms[p]);
+  }
+
+  void print(std::ostream& out) const {
+    const std::streamsize precision = out.precision(4);
+    out << "LATENCY (ms)     " << std::setw(12) << "phase" << std::setw(8) << "sents"
+        << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+        << std::setw(10) << "max" << std::endl;
+    for (unsigned b = 0; b < buckets.size(); ++b) {
+      for (unsigned p = 0; p < kNUM_PHASES; ++p) {
+        const LatencyHistogram& h = histograms[b * kNUM_PHASES + p];
+        if (h.count == 0) continue;
+        out << "LATENCY " << std::setw(8) << bucket_name(b) << std::setw(12) << phase_name(p)
+            << std::setw(8) << h.count
+            << std::setw(10) << h.percentile(50) << std::setw(10) << h.percentile(90)
+            << std::setw(10) << h.percentile(99) << std::setw(10) << h.max_ms << std::endl;
+      }
+    }
+    out.precision(precision);
+  }
+
+  // the percentiles and the nonzero bins of every histogram. bin i holds the
+  // latencies below min_ms * growth^(i + 1) that are not in bin i - 1
+  void write_json(std::ostream& out) const {
+    out << "{\n  \"unit\": \"ms\",\n  \"min_ms\": " << LatencyHistogram::kMIN_MS
+        << ",\n  \"growth\": " << LatencyHistogram::kGROWTH << ",\n  \"histograms\": [";
+    bool first = true;
+    for (unsigned b = 0; b < buckets.size(); ++b) {
+      for (unsigned p = 0; p < kNUM_PHASES; ++p) {
+        const LatencyHistogram& h = histograms[b * kNUM_PHASES + p];
+        if (h.count == 0) continue;
+        out << (first ? "\n" : ",\n") << "    {\"length\": \"" << bucket_name(b)
+            << "\", \"phase\": \"" << phase_name(p) << "\", \"count\": " << h.count
+            << ", \"p50\": " << h.percentile(50) << ", \"p90\": " << h.percentile(90)
+            << ", \"p99\": " << h.percentile(99) << ", \"max\": " << h.max_ms << ", \"bins\": {";
+        bool first_bin = true;
+        for (unsigned i = 0; i < h.bins.size(); ++i) {
+          if (h.bins[i] == 0) continue;
+          out << (first_bin ? "" : ", ") << '"' << i << "\": " << h.bins[i];
+          first_bin = false;
+        }
+        out << "}}";
+        first = false;
+      }
+    }
+    out << "\n  ]\n}\n";
+  }
+
+  std::string bucket_name(unsigned b) const {
+    if (b + 1 == buckets.size()) return std::to_string(buckets[b]) + "+";
+    return std::to_string(buckets[b]) + "-" + std::to_string(buckets[b + 1] - 1);
+  }
+
+  static const char* phase_name(unsigned p) {
+    static const char* names[] = {"buffer", "transitions", "output", "total"};
+    return names[p];
+  }
+
+  std::vector<unsigned> buckets;  // the lowest length of each
+  std::vector<LatencyHistogram> histograms;  // by bucket, then phase
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <execinfo.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/resource.h>
 
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -22,39 +23,24 @@
 #include "cnn/training.h"
 #include "cnn/cnn.h"
 #include "cnn/expr.h"
-#include "cnn/nodes.h"
-#include "cnn/lstm.h"
-#include "cnn/rnn.h"
+#include "cnn/rnn-factory.h"
 #include "c2.h"
+#include "latency.h"
+#include "parse-cache.h"
+#include "parser.h"
 
-cpyp::Corpus corpus;
-volatile bool requested_stop = false;
-unsigned LAYERS = 2;
-unsigned INPUT_DIM = 40;
-unsigned HIDDEN_DIM = 60;
-unsigned ACTION_DIM = 36;
-unsigned PRETRAINED_DIM = 50;
-unsigned LSTM_INPUT_DIM = 60;
-unsigned POS_DIM = 10;
-unsigned REL_DIM = 8;
-
-
-bool USE_POS = false;
+// the parser itself is in the lstmparser library (parser.h); this is the
+// command line driver that trains and evaluates it
 
-constexpr const char* ROOT_SYMBOL = "ROOT";
-unsigned kROOT_SYMBOL = 0;
-unsigned ACTION_SIZE = 0;
-unsigned VOCAB_SIZE = 0;
-unsigned POS_SIZE = 0;
+volatile bool requested_stop = false;
+volatile bool requested_latency_dump = false;
 
 using namespace cnn::expr;
 using namespace cnn;
+using namespace lstm_parser;
 using namespace std;
 namespace po = boost::program_options;
 
-vector<unsigned> possible_actions;
-unordered_map<unsigned, vector<float>> pretrained;
-
 void InitCommandLine(int argc, char** argv, po::variables_map* conf) {
   po::options_description opts("Configuration options");
   opts.add_options()
@@ -73,7 +59,26 @@ void InitCommandLine(int argc, char** argv, po::variables_map* conf) {
         ("pos_dim", po::value<unsigned>()->default_value(12), "POS dimension")
         ("rel_dim", po::value<unsigned>()->default_value(10), "relation dimension")
         ("lstm_input_dim", po::value<unsigned>()->default_value(60), "LSTM input dimension")
+        ("cell", po::value<string>()->default_value("lstm"), "Recurrent cell for the stack, buffer and action sequence models: lstm, fast-lstm, gru or rnn")
+        ("stack_cell", po::value<string>(), "Recurrent cell for the stack (overrides --cell)")
+        ("buffer_cell", po::value<string>(), "Recurrent cell for the buffer (overrides --cell)")
+        ("action_cell", po::value<string>(), "Recurrent cell for the action history (overrides --cell)")
         ("train,t", "Should training be run?")
+        ("max_updates", po::value<unsigned>(), "Stop training after this many updates (of 100 sentences each)")
+        ("dropout", po::value<float>()->default_value(0.f), "Variational dropout rate of the stack, buffer and action sequence models when training (lstm and gru cells)")
+        ("unbatched_compose", "Project tokens for the composition function one at a time, when they are reduced (for benchmarking)")
+        ("transitions", po::value<string>()->default_value("swap"), "Transition system: swap (arc-standard with SWAP), hybrid (arc-hybrid) or eager (arc-eager); hybrid and eager read CoNLL treebanks for -T and -d")
+        ("factored_actions", "Predict the type of each transition, and then the label only for the labeled types, instead of scoring every labeled action")
+        ("lookahead", po::value<unsigned>()->default_value(0), "Summarize the buffer by its first k tokens instead of an LSTM over all of it, so that sentences can be parsed incrementally (0: the LSTM)")
+        ("incremental", "Parse the test data token by token, as IncrementalParser does (needs --lookahead)")
+        ("fold_model", po::value<string>(), "Write the model, with lookup tables folded into the linear maps that read them (for decoding only), to this file")
+        ("folded", "The model given with --model was written by --fold_model")
+        ("bundle", po::value<string>(), "Write the parser with its options, vocabulary and pretrained embeddings to this file, for --from_bundle (when training, whenever the dev score improves)")
+        ("from_bundle,b", po::value<string>(), "Load the parser from a file written by --bundle, instead of -T, -w, --model and the architecture options (for parsing only)")
+        ("latency", "Report percentiles of the per sentence parsing latency, by sentence length")
+        ("latency_dump", po::value<string>(), "Write the per sentence latency histograms as JSON to this file (also on SIGUSR1 while parsing)")
+        ("parse_cache", po::value<string>(), "Reuse the parses of test sentences seen before, kept in this file between runs of the same parser")
+        ("parse_cache_mb", po::value<unsigned>()->default_value(64), "Memory bound of the --parse_cache parses, in MB")
         ("words,w", po::value<string>(), "Pretrained word embeddings")
         ("help,h", "Help");
   po::options_description dcmdline_options;
@@ -83,343 +88,21 @@ void InitCommandLine(int argc, char** argv, po::variables_map* conf) {
     cerr << dcmdline_options << endl;
     exit(1);
   }
-  if (conf->count("training_data") == 0) {
-    cerr << "Please specify --traing_data (-T): this is required to determine the vocabulary mapping, even if the parser is used in prediction mode.\n";
-    exit(1);
-  }
-}
-
-struct ParserBuilder {
-
-  LSTMBuilder stack_lstm; // (layers, input, hidden, trainer)
-  LSTMBuilder buffer_lstm;
-  LSTMBuilder action_lstm;
-  LookupParameters* p_w; // word embeddings
-  LookupParameters* p_t; // pretrained word embeddings (not updated)
-  LookupParameters* p_a; // input action embeddings
-  LookupParameters* p_r; // relation embeddings
-  LookupParameters* p_p; // pos tag embeddings
-  Parameters* p_pbias; // parser state bias
-  Parameters* p_A; // action lstm to parser state
-  Parameters* p_B; // buffer lstm to parser state
-  Parameters* p_S; // stack lstm to parser state
-  Parameters* p_H; // head matrix for composition function
-  Parameters* p_D; // dependency matrix for composition function
-  Parameters* p_R; // relation matrix for composition function
-  Parameters* p_w2l; // word to LSTM input
-  Parameters* p_p2l; // POS to LSTM input
-  Parameters* p_t2l; // pretrained word embeddings to LSTM input
-  Parameters* p_ib; // LSTM input bias
-  Parameters* p_cbias; // composition function bias
-  Parameters* p_p2a;   // parser state to action
-  Parameters* p_action_start;  // action bias
-  Parameters* p_abias;  // action bias
-  Parameters* p_buffer_guard;  // end of buffer
-  Parameters* p_stack_guard;  // end of stack
-
-  explicit ParserBuilder(Model* model, const unordered_map<unsigned, vector<float>>& pretrained) :
-      stack_lstm(LAYERS, LSTM_INPUT_DIM, HIDDEN_DIM, model),
-      buffer_lstm(LAYERS, LSTM_INPUT_DIM, HIDDEN_DIM, model),
-      action_lstm(LAYERS, ACTION_DIM, HIDDEN_DIM, model),
-      p_w(model->add_lookup_parameters(VOCAB_SIZE, {INPUT_DIM})),
-      p_a(model->add_lookup_parameters(ACTION_SIZE, {ACTION_DIM})),
-      p_r(model->add_lookup_parameters(ACTION_SIZE, {REL_DIM})),
-      p_pbias(model->add_parameters({HIDDEN_DIM})),
-      p_A(model->add_parameters({HIDDEN_DIM, HIDDEN_DIM})),
-      p_B(model->add_parameters({HIDDEN_DIM, HIDDEN_DIM})),
-      p_S(model->add_parameters({HIDDEN_DIM, HIDDEN_DIM})),
-      p_H(model->add_parameters({LSTM_INPUT_DIM, LSTM_INPUT_DIM})),
-      p_D(model->add_parameters({LSTM_INPUT_DIM, LSTM_INPUT_DIM})),
-      p_R(model->add_parameters({LSTM_INPUT_DIM, REL_DIM})),
-      p_w2l(model->add_parameters({LSTM_INPUT_DIM, INPUT_DIM})),
-      p_ib(model->add_parameters({LSTM_INPUT_DIM})),
-      p_cbias(model->add_parameters({LSTM_INPUT_DIM})),
-      p_p2a(model->add_parameters({ACTION_SIZE, HIDDEN_DIM})),
-      p_action_start(model->add_parameters({ACTION_DIM})),
-      p_abias(model->add_parameters({ACTION_SIZE})),
-      p_buffer_guard(model->add_parameters({LSTM_INPUT_DIM})),
-      p_stack_guard(model->add_parameters({LSTM_INPUT_DIM})) {
-    if (USE_POS) {
-      p_p = model->add_lookup_parameters(POS_SIZE, {POS_DIM});
-      p_p2l = model->add_parameters({LSTM_INPUT_DIM, POS_DIM});
-    }
-    if (pretrained.size() > 0) {
-      p_t = model->add_lookup_parameters(VOCAB_SIZE, {PRETRAINED_DIM});
-      for (auto it : pretrained)
-        p_t->Initialize(it.first, it.second);
-      p_t2l = model->add_parameters({LSTM_INPUT_DIM, PRETRAINED_DIM});
-    } else {
-      p_t = nullptr;
-      p_t2l = nullptr;
+  if (conf->count("from_bundle")) {
+    if (conf->count("train") || conf->count("model") || conf->count("folded")) {
+      cerr << "--from_bundle holds the model, and bundles cannot be trained\n";
+      exit(1);
     }
+  } else if (conf->count("training_data") == 0) {
+    cerr << "Please specify --traing_data (-T): this is required to determine the vocabulary mapping, even if the parser is used in prediction mode (or load a parser with --from_bundle).\n";
+    exit(1);
   }
-
-static bool IsActionForbidden(const string& a, unsigned bsize, unsigned ssize, const vector<int>& stacki) {
-  if (a[1]=='W' && ssize<3) return true;
-  if (a[1]=='W') {
-        int top=stacki[stacki.size()-1];
-        int sec=stacki[stacki.size()-2];
-        if (sec>top) return true;
-  }
-
-  bool is_shift = (a[0] == 'S' && a[1]=='H');
-  bool is_reduce = !is_shift;
-  if (is_shift && bsize == 1) return true;
-  if (is_reduce && ssize < 3) return true;
-  if (bsize == 2 && // ROOT is the only thing remaining on buffer
-      ssize > 2 && // there is more than a single element on the stack
-      is_shift) return true;
-  // only attach left to ROOT
-  if (bsize == 1 && ssize == 3 && a[0] == 'R') return true;
-  return false;
-}
-
-// take a vector of actions and return a parse tree (labeling of every
-// word position with its head's position)
-static map<int,int> compute_heads(unsigned sent_len, const vector<unsigned>& actions, const vector<string>& setOfActions, map<int,string>* pr = nullptr) {
-  map<int,int> heads;
-  map<int,string> r;
-  map<int,string>& rels = (pr ? *pr : r);
-  for(unsigned i=0;i<sent_len;i++) { heads[i]=-1; rels[i]="ERROR"; }
-  vector<int> bufferi(sent_len + 1, 0), stacki(1, -999);
-  for (unsigned i = 0; i < sent_len; ++i)
-    bufferi[sent_len - i] = i;
-  bufferi[0] = -999;
-  for (auto action: actions) { // loop over transitions for sentence
-    const string& actionString=setOfActions[action];
-    const char ac = actionString[0];
-    const char ac2 = actionString[1];
-    if (ac =='S' && ac2=='H') {  // SHIFT
-      assert(bufferi.size() > 1); // dummy symbol means > 1 (not >= 1)
-      stacki.push_back(bufferi.back());
-      bufferi.pop_back();
-    } else if (ac=='S' && ac2=='W') { // SWAP
-      assert(stacki.size() > 2);
-      unsigned ii = 0, jj = 0;
-      jj = stacki.back();
-      stacki.pop_back();
-      ii = stacki.back();
-      stacki.pop_back();
-      bufferi.push_back(ii);
-      stacki.push_back(jj);
-    } else { // LEFT or RIGHT
-      assert(stacki.size() > 2); // dummy symbol means > 2 (not >= 2)
-      assert(ac == 'L' || ac == 'R');
-      unsigned depi = 0, headi = 0;
-      (ac == 'R' ? depi : headi) = stacki.back();
-      stacki.pop_back();
-      (ac == 'R' ? headi : depi) = stacki.back();
-      stacki.pop_back();
-      stacki.push_back(headi);
-      heads[depi] = headi;
-      rels[depi] = actionString;
-    }
+  if (conf->count("folded") && (conf->count("train") || conf->count("model") == 0)) {
+    cerr << "--folded needs --model, and folded models cannot be trained\n";
+    exit(1);
   }
-  assert(bufferi.size() == 1);
-  //assert(stacki.size() == 2);
-  return heads;
 }
 
-// *** if correct_actions is empty, this runs greedy decoding ***
-// returns parse actions for input sentence (in training just returns the reference)
-// OOV handling: raw_sent will have the actual words
-//               sent will have words replaced by appropriate UNK tokens
-// this lets us use pretrained embeddings, when available, for words that were OOV in the
-// parser training data
-vector<unsigned> log_prob_parser(ComputationGraph* hg,
-                     const vector<unsigned>& raw_sent,  // raw sentence
-                     const vector<unsigned>& sent,  // sent with oovs replaced
-                     const vector<unsigned>& sentPos,
-                     const vector<unsigned>& correct_actions,
-                     const vector<string>& setOfActions,
-                     const map<unsigned, std::string>& intToWords,
-                     double *right) {
-    vector<unsigned> results;
-    const bool build_training_graph = correct_actions.size() > 0;
-
-    stack_lstm.new_graph(*hg);
-    buffer_lstm.new_graph(*hg);
-    action_lstm.new_graph(*hg);
-    stack_lstm.start_new_sequence();
-    buffer_lstm.start_new_sequence();
-    action_lstm.start_new_sequence();
-    // variables in the computation graph representing the parameters
-    Expression pbias = parameter(*hg, p_pbias);
-    Expression H = parameter(*hg, p_H);
-    Expression D = parameter(*hg, p_D);
-    Expression R = parameter(*hg, p_R);
-    Expression cbias = parameter(*hg, p_cbias);
-    Expression S = parameter(*hg, p_S);
-    Expression B = parameter(*hg, p_B);
-    Expression A = parameter(*hg, p_A);
-    Expression ib = parameter(*hg, p_ib);
-    Expression w2l = parameter(*hg, p_w2l);
-    Expression p2l;
-    if (USE_POS)
-      p2l = parameter(*hg, p_p2l);
-    Expression t2l;
-    if (p_t2l)
-      t2l = parameter(*hg, p_t2l);
-    Expression p2a = parameter(*hg, p_p2a);
-    Expression abias = parameter(*hg, p_abias);
-    Expression action_start = parameter(*hg, p_action_start);
-
-    action_lstm.add_input(action_start);
-
-    vector<Expression> buffer(sent.size() + 1);  // variables representing word embeddings (possibly including POS info)
-    vector<int> bufferi(sent.size() + 1);  // position of the words in the sentence
-    // precompute buffer representation from left to right
-
-    for (unsigned i = 0; i < sent.size(); ++i) {
-      assert(sent[i] < VOCAB_SIZE);
-      Expression w =lookup(*hg, p_w, sent[i]);
-
-      vector<Expression> args = {ib, w2l, w}; // learn embeddings
-      if (USE_POS) { // learn POS tag?
-        Expression p = lookup(*hg, p_p, sentPos[i]);
-        args.push_back(p2l);
-        args.push_back(p);
-      }
-      if (p_t && pretrained.count(raw_sent[i])) {  // include fixed pretrained vectors?
-        Expression t = const_lookup(*hg, p_t, raw_sent[i]);
-        args.push_back(t2l);
-        args.push_back(t);
-      }
-      buffer[sent.size() - i] = rectify(affine_transform(args));
-      bufferi[sent.size() - i] = i;
-    }
-    // dummy symbol to represent the empty buffer
-    buffer[0] = parameter(*hg, p_buffer_guard);
-    bufferi[0] = -999;
-    for (auto& b : buffer)
-      buffer_lstm.add_input(b);
-
-    vector<Expression> stack;  // variables representing subtree embeddings
-    vector<int> stacki; // position of words in the sentence of head of subtree
-    stack.push_back(parameter(*hg, p_stack_guard));
-    stacki.push_back(-999); // not used for anything
-    // drive dummy symbol on stack through LSTM
-    stack_lstm.add_input(stack.back());
-    vector<Expression> log_probs;
-    string rootword;
-    unsigned action_count = 0;  // incremented at each prediction
-    while(stack.size() > 2 || buffer.size() > 1) {
-      // get list of possible actions for the current parser state
-      vector<unsigned> current_valid_actions;
-      for (auto a: possible_actions) {
-        if (IsActionForbidden(setOfActions[a], buffer.size(), stack.size(), stacki))
-          continue;
-        current_valid_actions.push_back(a);
-      }
-
-      // p_t = pbias + S * slstm + B * blstm + A * almst
-      Expression p_t = affine_transform({pbias, S, stack_lstm.back(), B, buffer_lstm.back(), A, action_lstm.back()});
-      Expression nlp_t = rectify(p_t);
-      // r_t = abias + p2a * nlp
-      Expression r_t = affine_transform({abias, p2a, nlp_t});
-
-      // adist = log_softmax(r_t, current_valid_actions)
-      Expression adiste = log_softmax(r_t, current_valid_actions);
-      vector<float> adist = as_vector(hg->incremental_forward());
-      double best_score = adist[current_valid_actions[0]];
-      unsigned best_a = current_valid_actions[0];
-      for (unsigned i = 1; i < current_valid_actions.size(); ++i) {
-        if (adist[current_valid_actions[i]] > best_score) {
-          best_score = adist[current_valid_actions[i]];
-          best_a = current_valid_actions[i];
-        }
-      }
-      unsigned action = best_a;
-      if (build_training_graph) {  // if we have reference actions (for training) use the reference action
-        action = correct_actions[action_count];
-        if (best_a == action) { (*right)++; }
-      }
-      ++action_count;
-      log_probs.push_back(pick(adiste, action));
-      results.push_back(action);
-
-      // add current action to action LSTM
-      Expression actione = lookup(*hg, p_a, action);
-      action_lstm.add_input(actione);
-
-      // get relation embedding from action (TODO: convert to relation from action?)
-      Expression relation = lookup(*hg, p_r, action);
-
-      // do action
-      const string& actionString=setOfActions[action];
-      const char ac = actionString[0];
-      const char ac2 = actionString[1];
-
-
-      if (ac =='S' && ac2=='H') {  // SHIFT
-        assert(buffer.size() > 1); // dummy symbol means > 1 (not >= 1)
-        stack.push_back(buffer.back());
-        stack_lstm.add_input(buffer.back());
-        buffer.pop_back();
-        buffer_lstm.rewind_one_step();
-        stacki.push_back(bufferi.back());
-        bufferi.pop_back();
-      } else if (ac=='S' && ac2=='W'){ //SWAP --- Miguel
-        assert(stack.size() > 2); // dummy symbol means > 2 (not >= 2)
-
-        Expression toki, tokj;
-        unsigned ii = 0, jj = 0;
-        tokj=stack.back();
-        jj=stacki.back();
-        stack.pop_back();
-        stacki.pop_back();
-
-        toki=stack.back();
-        ii=stacki.back();
-        stack.pop_back();
-        stacki.pop_back();
-
-        buffer.push_back(toki);
-        bufferi.push_back(ii);
-
-        stack_lstm.rewind_one_step();
-        stack_lstm.rewind_one_step();
-
-        buffer_lstm.add_input(buffer.back());
-
-        stack.push_back(tokj);
-        stacki.push_back(jj);
-
-        stack_lstm.add_input(stack.back());
-      } else { // LEFT or RIGHT
-        assert(stack.size() > 2); // dummy symbol means > 2 (not >= 2)
-        assert(ac == 'L' || ac == 'R');
-        Expression dep, head;
-        unsigned depi = 0, headi = 0;
-        (ac == 'R' ? dep : head) = stack.back();
-        (ac == 'R' ? depi : headi) = stacki.back();
-        stack.pop_back();
-        stacki.pop_back();
-        (ac == 'R' ? head : dep) = stack.back();
-        (ac == 'R' ? headi : depi) = stacki.back();
-        stack.pop_back();
-        stacki.pop_back();
-        if (headi == sent.size() - 1) rootword = intToWords.find(sent[depi])->second;
-        // composed = cbias + H * head + D * dep + R * relation
-        Expression composed = affine_transform({cbias, H, head, D, dep, R, relation});
-        Expression nlcomposed = tanh(composed);
-        stack_lstm.rewind_one_step();
-        stack_lstm.rewind_one_step();
-        stack_lstm.add_input(nlcomposed);
-        stack.push_back(nlcomposed);
-        stacki.push_back(headi);
-      }
-    }
-    assert(stack.size() == 2); // guard symbol, root
-    assert(stacki.size() == 2);
-    assert(buffer.size() == 1); // guard symbol
-    assert(bufferi.size() == 1);
-    Expression tot_neglogprob = -sum(log_probs);
-    assert(tot_neglogprob.pg != nullptr);
-    return results;
-  }
-};
-
 void signal_callback_handler(int /* signum */) {
   if (requested_stop) {
     cerr << "\nReceived SIGINT again, quitting.\n";
@@ -429,6 +112,16 @@ void signal_callback_handler(int /* signum */) {
   requested_stop = true;
 }
 
+void sigusr1_callback_handler(int /* signum */) {
+  requested_latency_dump = true;
+}
+
+void write_latency_dump(const LatencyStats& stats, const string& fname) {
+  ofstream out(fname);
+  stats.write_json(out);
+  cerr << "Wrote latency histograms to " << fname << endl;
+}
+
 unsigned compute_correct(const map<int,int>& ref, const map<int,int>& hyp, unsigned len) {
   unsigned res = 0;
   for (unsigned i = 0; i < len; ++i) {
@@ -441,39 +134,66 @@ unsigned compute_correct(const map<int,int>& ref, const map<int,int>& hyp, unsig
   return res;
 }
 
+unsigned compute_correct(const map<int,int>& ref, const Parse& hyp) {
+  unsigned res = 0;
+  const int root = hyp.heads.size();
+  for (unsigned i = 0; i < hyp.heads.size(); ++i) {
+    const int head = ref.find(i)->second;
+    if ((head == root ? 0 : head + 1) == hyp.heads[i]) ++res;
+  }
+  return res;
+}
+
+// the heads dev sentence sii is scored against, as compute_heads returns
+// them: those of the CoNLL file it was read from, before any arc was lifted
+// to make it projective, or else those of its oracle transitions
+map<int,int> reference_heads(cpyp::Corpus& corpus, unsigned sii, cpyp::TransitionSystem system) {
+  const vector<int>& heads = corpus.headsDev[sii];
+  if (heads.empty())
+    return ParserBuilder::compute_heads(corpus.sentencesDev[sii].size(), corpus.correct_act_sentDev[sii],
+                                        corpus.actions, system);
+  map<int,int> ref;
+  for (unsigned i = 0; i < heads.size(); ++i) ref[i] = heads[i];
+  return ref;
+}
+
+// the words of a sentence, without ROOT
+vector<Token> sentence_tokens(const vector<unsigned>& sentence, const vector<unsigned>& pos,
+                              const vector<string>& sentenceUnkStrings,
+                              const map<unsigned, string>& intToWords,
+                              const map<unsigned, string>& intToPos) {
+  vector<Token> tokens;
+  for (unsigned i = 0; i + 1 < sentence.size(); ++i)
+    tokens.push_back({sentenceUnkStrings[i].size() > 0 ? sentenceUnkStrings[i] : intToWords.find(sentence[i])->second,
+                      intToPos.find(pos[i])->second});
+  return tokens;
+}
+
 void output_conll(const vector<unsigned>& sentence, const vector<unsigned>& pos,
                   const vector<string>& sentenceUnkStrings, 
                   const map<unsigned, string>& intToWords, 
                   const map<unsigned, string>& intToPos, 
-                  const map<int,int>& hyp, const map<int,string>& rel_hyp) {
+                  const Parse& hyp, unsigned kUNK) {
   for (unsigned i = 0; i < (sentence.size()-1); ++i) {
     auto index = i + 1;
     assert(i < sentenceUnkStrings.size() && 
-           ((sentence[i] == corpus.get_or_add_word(cpyp::Corpus::UNK) &&
+           ((sentence[i] == kUNK &&
              sentenceUnkStrings[i].size() > 0) ||
-            (sentence[i] != corpus.get_or_add_word(cpyp::Corpus::UNK) &&
+            (sentence[i] != kUNK &&
              sentenceUnkStrings[i].size() == 0 &&
              intToWords.find(sentence[i]) != intToWords.end())));
     string wit = (sentenceUnkStrings[i].size() > 0)? 
       sentenceUnkStrings[i] : intToWords.find(sentence[i])->second;
     auto pit = intToPos.find(pos[i]);
-    assert(hyp.find(i) != hyp.end());
-    auto hyp_head = hyp.find(i)->second + 1;
-    if (hyp_head == (int)sentence.size()) hyp_head = 0;
-    auto hyp_rel_it = rel_hyp.find(i);
-    assert(hyp_rel_it != rel_hyp.end());
-    auto hyp_rel = hyp_rel_it->second;
-    size_t first_char_in_rel = hyp_rel.find('(') + 1;
-    size_t last_char_in_rel = hyp_rel.rfind(')') - 1;
-    hyp_rel = hyp_rel.substr(first_char_in_rel, last_char_in_rel - first_char_in_rel + 1);
+    assert(i < hyp.heads.size());
     cout << index << '\t'       // 1. ID 
          << wit << '\t'         // 2. FORM
          << "_" << '\t'         // 3. LEMMA 
          << "_" << '\t'         // 4. CPOSTAG 
          << pit->second << '\t' // 5. POSTAG
          << "_" << '\t'         // 6. FEATS
-         << hyp_head << '\t'    // 7. HEAD
-         << hyp_rel << '\t'     // 8. DEPREL
+         << hyp.heads[i] << '\t'    // 7. HEAD
+         << hyp.labels[i] << '\t'     // 8. DEPREL
          << "_" << '\t'         // 9. PHEAD
          << "_" << endl;        // 10. PDEPREL
   }
@@ -491,16 +211,36 @@ int main(int argc, char** argv) {
 
   po::variables_map conf;
   InitCommandLine(argc, argv, &conf);
-  USE_POS = conf.count("use_pos_tags");
-
-  LAYERS = conf["layers"].as<unsigned>();
-  INPUT_DIM = conf["input_dim"].as<unsigned>();
-  PRETRAINED_DIM = conf["pretrained_dim"].as<unsigned>();
-  HIDDEN_DIM = conf["hidden_dim"].as<unsigned>();
-  ACTION_DIM = conf["action_dim"].as<unsigned>();
-  LSTM_INPUT_DIM = conf["lstm_input_dim"].as<unsigned>();
-  POS_DIM = conf["pos_dim"].as<unsigned>();
-  REL_DIM = conf["rel_dim"].as<unsigned>();
+  ParserOptions options;
+  options.use_pos = conf.count("use_pos_tags");
+  options.batched_compose = !conf.count("unbatched_compose");
+  options.lookahead = conf["lookahead"].as<unsigned>();
+  options.transitions = conf["transitions"].as<string>();
+  options.factored_actions = conf.count("factored_actions");
+  if (conf.count("latency_dump")) signal(SIGUSR1, sigusr1_callback_handler);
+
+  options.layers = conf["layers"].as<unsigned>();
+  options.input_dim = conf["input_dim"].as<unsigned>();
+  options.pretrained_dim = conf["pretrained_dim"].as<unsigned>();
+  options.hidden_dim = conf["hidden_dim"].as<unsigned>();
+  options.action_dim = conf["action_dim"].as<unsigned>();
+  options.lstm_input_dim = conf["lstm_input_dim"].as<unsigned>();
+  options.pos_dim = conf["pos_dim"].as<unsigned>();
+  options.rel_dim = conf["rel_dim"].as<unsigned>();
+  options.stack_cell = options.buffer_cell = options.action_cell = conf["cell"].as<string>();
+  if (conf.count("stack_cell")) options.stack_cell = conf["stack_cell"].as<string>();
+  if (conf.count("buffer_cell")) options.buffer_cell = conf["buffer_cell"].as<string>();
+  if (conf.count("action_cell")) options.action_cell = conf["action_cell"].as<string>();
+  if (options.transitions != "swap" && options.transitions != "hybrid" && options.transitions != "eager") {
+    cerr << "Unknown transition system: " << options.transitions << endl;
+    exit(1);
+  }
+  for (const string& cell : {options.stack_cell, options.buffer_cell, options.action_cell}) {
+    if (!IsKnownRNNCell(cell)) {
+      cerr << "Unknown recurrent cell: " << cell << endl;
+      exit(1);
+    }
+  }
   const unsigned unk_strategy = conf["unk_strategy"].as<unsigned>();
   cerr << "Unknown word strategy: ";
   if (unk_strategy == 1) {
@@ -511,72 +251,66 @@ int main(int argc, char** argv) {
   const double unk_prob = conf["unk_prob"].as<double>();
   assert(unk_prob >= 0.); assert(unk_prob <= 1.);
   ostringstream os;
-  os << "parser_" << (USE_POS ? "pos" : "nopos")
-     << '_' << LAYERS
-     << '_' << INPUT_DIM
-     << '_' << HIDDEN_DIM
-     << '_' << ACTION_DIM
-     << '_' << LSTM_INPUT_DIM
-     << '_' << POS_DIM
-     << '_' << REL_DIM
-     << "-pid" << getpid() << ".params";
+  os << "parser_" << (options.use_pos ? "pos" : "nopos")
+     << '_' << options.layers
+     << '_' << options.input_dim
+     << '_' << options.hidden_dim
+     << '_' << options.action_dim
+     << '_' << options.lstm_input_dim
+     << '_' << options.pos_dim
+     << '_' << options.rel_dim;
+  if (options.lookahead) os << "_la" << options.lookahead;
+  if (options.transitions != "swap") os << '_' << options.transitions;
+  if (options.factored_actions) os << "_fa";
+  if (options.stack_cell != "lstm" || options.buffer_cell != "lstm" || options.action_cell != "lstm")
+    os << '_' << options.stack_cell << '-' << options.buffer_cell << '-' << options.action_cell;
+  os << "-pid" << getpid() << ".params";
   int best_correct_heads = 0;
   const string fname = os.str();
   cerr << "Writing parameters to file: " << fname << endl;
   bool softlinkCreated = false;
-  corpus.load_correct_actions(conf["training_data"].as<string>());	
-  const unsigned kUNK = corpus.get_or_add_word(cpyp::Corpus::UNK);
-  kROOT_SYMBOL = corpus.get_or_add_word(ROOT_SYMBOL);
-
-  if (conf.count("words")) {
-    pretrained[kUNK] = vector<float>(PRETRAINED_DIM, 0);
-    cerr << "Loading from " << conf["words"].as<string>() << " with" << PRETRAINED_DIM << " dimensions\n";
-    ifstream in(conf["words"].as<string>().c_str());
-    string line;
-    getline(in, line);
-    vector<float> v(PRETRAINED_DIM, 0);
-    string word;
-    while (getline(in, line)) {
-      istringstream lin(line);
-      lin >> word;
-      for (unsigned i = 0; i < PRETRAINED_DIM; ++i) lin >> v[i];
-      unsigned id = corpus.get_or_add_word(word);
-      pretrained[id] = v;
-    }
-  }
-
-  set<unsigned> training_vocab; // words available in the training corpus
-  set<unsigned> singletons;
-  {  // compute the singletons in the parser's training data
-    map<unsigned, unsigned> counts;
-    for (auto sent : corpus.sentences)
-      for (auto word : sent.second) { training_vocab.insert(word); counts[word]++; }
-    for (auto wc : counts)
-      if (wc.second == 1) singletons.insert(wc.first);
+  unique_ptr<Parser> loaded;
+  if (conf.count("from_bundle")) {
+    const string bundle = conf["from_bundle"].as<string>();
+    loaded = Parser::load(bundle);
+    cerr << "Loaded the parser from " << bundle << endl;
+  } else {
+    if (conf.count("words"))
+      cerr << "Loading from " << conf["words"].as<string>() << " with " << options.pretrained_dim << " dimensions\n";
+    loaded.reset(new Parser(options, conf["training_data"].as<string>(),
+                            conf.count("words") ? conf["words"].as<string>() : ""));
+    if (loaded->corpus.lifted)
+      cerr << conf["training_data"].as<string>() << ": lifted " << loaded->corpus.lifted << " non-projective arcs" << endl;
   }
-
+  Parser& parser = *loaded;
+  cpyp::Corpus& corpus = parser.corpus;
+  const unsigned kUNK = parser.kUNK;
+  for (auto& a : corpus.actions) cerr << a << "\n";
+  cerr << "nactions:" << corpus.nactions << "\n";
+  for (unsigned i = 0; i < corpus.npos; i++) cerr << i << ":" << corpus.intToPos[i] << "\n";
   cerr << "Number of words: " << corpus.nwords << endl;
-  VOCAB_SIZE = corpus.nwords + 1;
-  ACTION_SIZE = corpus.nactions + 1;
-  POS_SIZE = corpus.npos + 10;  // bad way of dealing with the fact that we may see new POS tags in the test set
-  possible_actions.resize(corpus.nactions);
-  for (unsigned i = 0; i < corpus.nactions; ++i)
-    possible_actions[i] = i;
-
-  Model model;
-  ParserBuilder parser(&model, pretrained);
-  if (conf.count("model")) {
-    ifstream in(conf["model"].as<string>().c_str());
-    boost::archive::text_iarchive ia(in);
-    ia >> model;
+  if (conf.count("incremental") && parser.options.lookahead == 0) {
+    cerr << "--incremental needs a model trained with --lookahead\n";
+    exit(1);
   }
+  if (conf.count("folded") || conf.count("fold_model"))
+    parser.add_folded_tables();
+  if (conf.count("model"))
+    parser.load_model(conf["model"].as<string>(), conf.count("folded"));
 
-  // OOV words will be replaced by UNK tokens
   corpus.load_correct_actionsDev(conf["dev_data"].as<string>());
+  if (corpus.liftedDev)
+    cerr << conf["dev_data"].as<string>() << ": lifted " << corpus.liftedDev << " non-projective arcs" << endl;
   //TRAINING
   if (conf.count("train")) {
     signal(SIGINT, signal_callback_handler);
-    SimpleSGDTrainer sgd(&model);
+    try {
+      parser.builder->set_dropout(conf["dropout"].as<float>());
+    } catch (const invalid_argument& e) {
+      cerr << "--dropout: " << e.what() << endl;
+      exit(1);
+    }
+    SimpleSGDTrainer sgd(&parser.model);
     //MomentumSGDTrainer sgd(&model);
     sgd.eta_decay = 0.08;
     //sgd.eta_decay = 0.05;
@@ -594,8 +328,10 @@ int main(int argc, char** argv) {
     int iter = -1;
     time_t time_start = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
     cerr << "TRAINING STARTED AT: " << put_time(localtime(&time_start), "%c %Z") << endl;
-    while(!requested_stop) {
+    const int max_updates = conf.count("max_updates") ? conf["max_updates"].as<unsigned>() : -1;
+    while(!requested_stop && iter + 1 != max_updates) {
       ++iter;
+      auto t_start = std::chrono::high_resolution_clock::now();
       for (unsigned sii = 0; sii < status_every_i_iterations; ++sii) {
            if (si == corpus.nsentences) {
              si = 0;
@@ -608,12 +344,12 @@ int main(int argc, char** argv) {
            vector<unsigned> tsentence=sentence;
            if (unk_strategy == 1) {
              for (auto& w : tsentence)
-               if (singletons.count(w) && cnn::rand01() < unk_prob) w = kUNK;
+               if (parser.singletons.count(w) && cnn::rand01() < unk_prob) w = kUNK;
            }
 	   const vector<unsigned>& sentencePos=corpus.sentencesPos[order[si]]; 
 	   const vector<unsigned>& actions=corpus.correct_act_sent[order[si]];
            ComputationGraph hg;
-           parser.log_prob_parser(&hg,sentence,tsentence,sentencePos,actions,corpus.actions,corpus.intToWords,&right);
+           parser.builder->log_prob_parser(&hg,sentence,tsentence,sentencePos,actions,corpus.actions,&right);
            double lp = as_scalar(hg.incremental_forward());
            if (lp < 0) {
              cerr << "Log prob < 0 on sentence " << order[si] << ": lp=" << lp << endl;
@@ -625,9 +361,10 @@ int main(int argc, char** argv) {
            ++si;
            trs += actions.size();
       }
+      auto t_end = std::chrono::high_resolution_clock::now();
       sgd.status();
       time_t time_now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-      cerr << "update #" << iter << " (epoch " << (tot_seen / corpus.nsentences) << " |time=" << put_time(localtime(&time_now), "%c %Z") << ")\tllh: "<< llh<<" ppl: " << exp(llh / trs) << " err: " << (trs - right) / trs << endl;
+      cerr << "update #" << iter << " (epoch " << (tot_seen / corpus.nsentences) << " |time=" << put_time(localtime(&time_now), "%c %Z") << ")\tllh: "<< llh<<" ppl: " << exp(llh / trs) << " err: " << (trs - right) / trs << "\t[" << status_every_i_iterations << " sents in " << std::chrono::duration<double, std::milli>(t_end-t_start).count() << " ms]" << endl;
       llh = trs = right = 0;
 
       static int logc = 0;
@@ -647,15 +384,15 @@ int main(int argc, char** argv) {
 	   const vector<unsigned>& actions=corpus.correct_act_sentDev[sii];
            vector<unsigned> tsentence=sentence;
            for (auto& w : tsentence)
-             if (training_vocab.count(w) == 0) w = kUNK;
+             if (parser.training_vocab.count(w) == 0) w = kUNK;
 
            ComputationGraph hg;
-	   vector<unsigned> pred = parser.log_prob_parser(&hg,sentence,tsentence,sentencePos,vector<unsigned>(),corpus.actions,corpus.intToWords,&right);
+	   vector<unsigned> pred = parser.builder->log_prob_parser(&hg,sentence,tsentence,sentencePos,vector<unsigned>(),corpus.actions,&right);
 	   double lp = 0;
            llh -= lp;
            trs += actions.size();
-           map<int,int> ref = parser.compute_heads(sentence.size(), actions, corpus.actions);
-           map<int,int> hyp = parser.compute_heads(sentence.size(), pred, corpus.actions);
+           map<int,int> ref = reference_heads(corpus, sii, parser.builder->system);
+           map<int,int> hyp = ParserBuilder::compute_heads(sentence.size(), pred, corpus.actions, parser.builder->system);
            //output_conll(sentence, corpus.intToWords, ref, hyp);
            correct_heads += compute_correct(ref, hyp, sentence.size() - 1);
            total_heads += sentence.size() - 1;
@@ -664,9 +401,8 @@ int main(int argc, char** argv) {
         cerr << "  **dev (iter=" << iter << " epoch=" << (tot_seen / corpus.nsentences) << ")\tllh=" << llh << " ppl: " << exp(llh / trs) << " err: " << (trs - right) / trs << " uas: " << (correct_heads / total_heads) << "\t[" << dev_size << " sents in " << std::chrono::duration<double, std::milli>(t_end-t_start).count() << " ms]" << endl;
         if (correct_heads > best_correct_heads) {
           best_correct_heads = correct_heads;
-          ofstream out(fname);
-          boost::archive::text_oarchive oa(out);
-          oa << model;
+          parser.save(fname);
+          if (conf.count("bundle")) parser.save_bundle(conf["bundle"].as<string>());
           // Create a soft link to the most recent model in order to make it
           // easier to refer to it in a shell script.
           if (!softlinkCreated) {
@@ -682,40 +418,134 @@ int main(int argc, char** argv) {
       }
     }
   } // should do training?
+  if (conf.count("fold_model")) {
+    const string folded_fname = conf["fold_model"].as<string>();
+    // fold the model that did best on the dev set, not the last one
+    if (conf.count("train") && best_correct_heads > 0) {
+      parser.load_model(fname);
+      cerr << "Reloaded the best model from " << fname << endl;
+    }
+    parser.save_folded(folded_fname);
+    cerr << "Wrote folded model to " << folded_fname << endl;
+  }
+  if (conf.count("bundle") && !conf.count("train")) {
+    const string bundle = conf["bundle"].as<string>();
+    parser.save_bundle(bundle);
+    cerr << "Wrote the parser to " << bundle << endl;
+  }
   if (true) { // do test evaluation
     double llh = 0;
     double trs = 0;
     double right = 0;
     double correct_heads = 0;
     double total_heads = 0;
+    const bool latency = conf.count("latency") || conf.count("latency_dump");
+    const bool incremental = conf.count("incremental");
+    // of the sentences parsed (not found in the cache)
+    double transitions = 0, transitions_at_end = 0;  // at the end: when incremental
+    unsigned parsed = 0, max_transitions = 0;
+    const string latency_dump = conf.count("latency_dump") ? conf["latency_dump"].as<string>() : "";
+    LatencyStats latency_stats;
+    unique_ptr<ParseCache> cache;
+    string cache_fname;
+    if (conf.count("parse_cache")) {
+      cache_fname = conf["parse_cache"].as<string>();
+      // the parser as it parses now, trained or read
+      cache.reset(new ParseCache(size_t(conf["parse_cache_mb"].as<unsigned>()) << 20,
+                                 ParseCache::hash_parser(parser)));
+      try {
+        const unsigned n = cache->load(cache_fname);
+        cerr << "Read " << n << " cached parses from " << cache_fname << endl;
+      } catch (const runtime_error& e) {
+        // rewritten when parsing ends
+        cerr << e.what() << ": starting with an empty cache" << endl;
+      }
+    }
     auto t_start = std::chrono::high_resolution_clock::now();
     unsigned corpus_size = corpus.nsentencesDev;
     for (unsigned sii = 0; sii < corpus_size; ++sii) {
+      auto t_sentence = std::chrono::high_resolution_clock::now();
       const vector<unsigned>& sentence=corpus.sentencesDev[sii];
       const vector<unsigned>& sentencePos=corpus.sentencesPosDev[sii]; 
       const vector<string>& sentenceUnkStr=corpus.sentencesStrDev[sii]; 
       const vector<unsigned>& actions=corpus.correct_act_sentDev[sii];
       vector<unsigned> tsentence=sentence;
       for (auto& w : tsentence)
-        if (training_vocab.count(w) == 0) w = kUNK;
-      ComputationGraph cg;
+        if (parser.training_vocab.count(w) == 0) w = kUNK;
       double lp = 0;
       vector<unsigned> pred;
-      pred = parser.log_prob_parser(&cg,sentence,tsentence,sentencePos,vector<unsigned>(),corpus.actions,corpus.intToWords,&right);
+      double phase_ms[kNUM_PHASES];
+      Parse hyp;
+      ParseCache::Key key{};
+      bool cached = false;
+      if (cache) {
+        key = ParseCache::hash(sentence_tokens(sentence, sentencePos, sentenceUnkStr, corpus.intToWords, corpus.intToPos));
+        cached = cache->find(key, &hyp);
+      }
+      if (cached) {
+        phase_ms[kBUFFER] = phase_ms[kTRANSITIONS] = 0;
+      } else if (incremental) {
+        // the buffer phase is reading the tokens (and the transitions they
+        // allow), the transition phase what is left after the last one
+        IncrementalParser inc(&parser);
+        for (unsigned i = 0; i + 1 < sentence.size(); ++i)
+          inc.add(sentence[i], tsentence[i], sentencePos[i]);
+        const unsigned before_end = inc.actions().size();
+        auto t_read = std::chrono::high_resolution_clock::now();
+        inc.finish();
+        pred = inc.actions();
+        transitions_at_end += pred.size() - before_end;
+        auto t_end = std::chrono::high_resolution_clock::now();
+        phase_ms[kBUFFER] = std::chrono::duration<double, std::milli>(t_read - t_sentence).count();
+        phase_ms[kTRANSITIONS] = std::chrono::duration<double, std::milli>(t_end - t_read).count();
+      } else {
+        ComputationGraph cg;
+        pred = parser.builder->log_prob_parser(&cg,sentence,tsentence,sentencePos,vector<unsigned>(),corpus.actions,&right,
+                                      latency ? phase_ms : nullptr);
+      }
+      auto t_parsed = std::chrono::high_resolution_clock::now();
+      if (!cached) {
+        transitions += pred.size();
+        max_transitions = max<unsigned>(max_transitions, pred.size());
+        ++parsed;
+        hyp = parser.to_parse(sentence.size(), pred);
+        if (cache) cache->insert(key, hyp);
+      }
+      output_conll(sentence, sentencePos, sentenceUnkStr, corpus.intToWords, corpus.intToPos, hyp, kUNK);
+      if (latency) {
+        auto t_output = std::chrono::high_resolution_clock::now();
+        phase_ms[kOUTPUT] = std::chrono::duration<double, std::milli>(t_output - t_parsed).count();
+        phase_ms[kTOTAL] = std::chrono::duration<double, std::milli>(t_output - t_sentence).count();
+        latency_stats.add(sentence.size() - 1, phase_ms);  // without ROOT
+        if (requested_latency_dump) {
+          requested_latency_dump = false;
+          write_latency_dump(latency_stats, latency_dump);
+        }
+      }
       llh -= lp;
       trs += actions.size();
-      map<int, string> rel_ref, rel_hyp;
-      map<int,int> ref = parser.compute_heads(sentence.size(), actions, corpus.actions, &rel_ref);
-      map<int,int> hyp = parser.compute_heads(sentence.size(), pred, corpus.actions, &rel_hyp);
-      output_conll(sentence, sentencePos, sentenceUnkStr, corpus.intToWords, corpus.intToPos, hyp, rel_hyp);
-      correct_heads += compute_correct(ref, hyp, sentence.size() - 1);
+      correct_heads += compute_correct(reference_heads(corpus, sii, parser.builder->system), hyp);
       total_heads += sentence.size() - 1;
     }
     auto t_end = std::chrono::high_resolution_clock::now();
     cerr << "TEST llh=" << llh << " ppl: " << exp(llh / trs) << " err: " << (trs - right) / trs << " uas: " << (correct_heads / total_heads) << "\t[" << corpus_size << " sents in " << std::chrono::duration<double, std::milli>(t_end-t_start).count() << " ms]" << endl;
+    if (parsed)
+      cerr << "TRANSITIONS per sentence: " << transitions / parsed << " (max " << max_transitions << ")" << endl;
+    if (incremental && parsed)
+      cerr << "INCREMENTAL transitions per sentence: " << transitions / parsed
+           << ", after the last token: " << transitions_at_end / parsed << endl;
+    if (conf.count("latency")) latency_stats.print(cerr);
+    if (!latency_dump.empty()) write_latency_dump(latency_stats, latency_dump);
+    if (cache) {
+      cache->print_stats(cerr);
+      cache->save(cache_fname);
+    }
   }
   for (unsigned i = 0; i < corpus.actions.size(); ++i) {
     //cerr << corpus.actions[i] << '\t' << parser.p_r->values[i].transpose() << endl;
     //cerr << corpus.actions[i] << '\t' << parser.p_p2a->values.col(i).transpose() << endl;
   }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  cerr << "PEAK MEMORY: " << usage.ru_maxrss / 1024.0 << " MB" << endl;  // ru_maxrss is in KB
 }
@@ -0,0 +1,294 @@
+#include "oracle.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace cpyp {
+
+// numbers the nodes of the subtree of h in order: its left dependents' subtrees,
+// h, and its right dependents' subtrees
+static void inorder(int h, const vector<vector<int>>& deps, vector<int>* ord, int* next) {
+  unsigned i = 0;
+  for (; i < deps[h].size() && deps[h][i] < h; ++i) inorder(deps[h][i], deps, ord, next);
+  (*ord)[h] = (*next)++;
+  for (; i < deps[h].size(); ++i) inorder(deps[h][i], deps, ord, next);
+}
+
+TransitionSystem transition_system(const string& name) {
+  if (name == "swap") return kSWAP;
+  if (name == "hybrid") return kHYBRID;
+  if (name == "eager") return kEAGER;
+  throw invalid_argument("Unknown transition system: " + name);
+}
+
+// the dependents of each word and of ROOT (the last), in order; throws if
+// heads is not a tree
+static vector<vector<int>> dependents(const vector<int>& heads) {
+  const int n = heads.size();
+  vector<vector<int>> deps(n + 1);
+  for (int d = 0; d < n; ++d) {
+    if (heads[d] < 0 || heads[d] > n || heads[d] == d) throw invalid_argument("Bad head in dependency tree");
+    deps[heads[d]].push_back(d);
+  }
+  // every word must be reachable from ROOT
+  vector<int> todo(1, n);
+  int reached = 0;
+  while (!todo.empty()) {
+    const int h = todo.back();
+    todo.pop_back();
+    ++reached;
+    todo.insert(todo.end(), deps[h].begin(), deps[h].end());
+  }
+  if (reached != n + 1) throw invalid_argument("Dependency tree with a cycle");
+  return deps;
+}
+
+vector<string> swap_oracle(const vector<int>& heads, const vector<string>& labels) {
+  const int n = heads.size();  // ROOT
+  const vector<vector<int>> deps = dependents(heads);
+  vector<int> ord(n + 1, -1);
+  int next = 0;
+  inorder(n, deps, &ord, &next);
+
+  vector<int> attached(n + 1);
+  vector<string> actions;
+  vector<int> stack;
+  deque<int> buffer(n + 1);
+  iota(buffer.begin(), buffer.end(), 0);
+  while (stack.size() != 1 || !buffer.empty()) {
+    if (stack.size() >= 2) {
+      const int s0 = stack.back(), s1 = stack[stack.size() - 2];
+      if (s1 != n && heads[s1] == s0 && attached[s1] == (int)deps[s1].size()) {
+        actions.push_back("LEFT-ARC(" + labels[s1] + ")");
+        ++attached[s0];
+        stack.erase(stack.end() - 2);
+        continue;
+      }
+      if (s0 != n && heads[s0] == s1 && attached[s0] == (int)deps[s0].size()) {
+        actions.push_back("RIGHT-ARC(" + labels[s0] + ")");
+        ++attached[s1];
+        stack.pop_back();
+        continue;
+      }
+      if (ord[s0] < ord[s1]) {
+        actions.push_back("SWAP");
+        buffer.push_front(s1);
+        stack.erase(stack.end() - 2);
+        continue;
+      }
+    }
+    if (buffer.empty()) throw invalid_argument("No transition for dependency tree");
+    actions.push_back("SHIFT");
+    stack.push_back(buffer.front());
+    buffer.pop_front();
+  }
+  return actions;
+}
+
+vector<string> hybrid_oracle(const vector<int>& heads, const vector<string>& labels) {
+  const int n = heads.size();  // ROOT
+  const vector<vector<int>> deps = dependents(heads);
+  vector<int> attached(n + 1);
+  vector<string> actions;
+  vector<int> stack;
+  for (int b = 0; b <= n;) {
+    if (!stack.empty()) {
+      const int s0 = stack.back();
+      const bool complete = attached[s0] == (int)deps[s0].size();
+      if (heads[s0] == b && complete) {
+        actions.push_back("LEFT-ARC(" + labels[s0] + ")");
+        ++attached[b];
+        stack.pop_back();
+        continue;
+      }
+      if (stack.size() >= 2 && heads[s0] == stack[stack.size() - 2] && complete) {
+        actions.push_back("RIGHT-ARC(" + labels[s0] + ")");
+        ++attached[heads[s0]];
+        stack.pop_back();
+        continue;
+      }
+      // ROOT is only shifted onto an empty stack
+      if (b == n) throw invalid_argument("Non-projective dependency tree");
+    }
+    actions.push_back("SHIFT");
+    stack.push_back(b++);
+  }
+  return actions;
+}
+
+vector<string> eager_oracle(const vector<int>& heads, const vector<string>& labels) {
+  const int n = heads.size();  // ROOT
+  const vector<vector<int>> deps = dependents(heads);
+  vector<int> attached(n + 1);
+  vector<bool> has_head(n + 1);
+  vector<string> actions;
+  vector<int> stack;
+  for (int b = 0; b <= n;) {
+    if (!stack.empty()) {
+      const int s0 = stack.back();
+      if (heads[s0] == b) {
+        actions.push_back("LEFT-ARC(" + labels[s0] + ")");
+        ++attached[b];
+        stack.pop_back();
+        continue;
+      }
+      if (b != n && heads[b] == s0) {
+        actions.push_back("RIGHT-ARC(" + labels[b] + ")");
+        ++attached[s0];
+        has_head[b] = true;
+        stack.push_back(b++);
+        continue;
+      }
+      if (has_head[s0] && attached[s0] == (int)deps[s0].size()) {
+        actions.push_back("REDUCE");
+        stack.pop_back();
+        continue;
+      }
+      if (b == n) throw invalid_argument("Non-projective dependency tree");
+    }
+    actions.push_back("SHIFT");
+    stack.push_back(b++);
+  }
+  return actions;
+}
+
+vector<string> oracle(TransitionSystem system, const vector<int>& heads, const vector<string>& labels) {
+  switch (system) {
+    case kHYBRID: return hybrid_oracle(heads, labels);
+    case kEAGER: return eager_oracle(heads, labels);
+    default: return swap_oracle(heads, labels);
+  }
+}
+
+// true if h dominates k (ROOT dominates every word)
+static bool dominates(const vector<int>& heads, int h, int k) {
+  const int n = heads.size();
+  while (k != h && k != n) k = heads[k];
+  return k == h;
+}
+
+unsigned projectivize(vector<int>* heads) {
+  vector<int>& hs = *heads;
+  dependents(hs);  // checks that it is a tree
+  unsigned lifts = 0;
+  while (true) {
+    // the shortest non-projective arc
+    int shortest = -1, shortest_len = 0;
+    for (int d = 0; d < (int)hs.size(); ++d) {
+      const int lo = min(d, hs[d]), hi = max(d, hs[d]);
+      if (shortest >= 0 && hi - lo >= shortest_len) continue;
+      for (int k = lo + 1; k < hi; ++k) {
+        if (!dominates(hs, hs[d], k)) {
+          shortest = d;
+          shortest_len = hi - lo;
+          break;
+        }
+      }
+    }
+    if (shortest < 0) return lifts;
+    hs[shortest] = hs[hs[shortest]];
+    ++lifts;
+  }
+}
+
+bool is_conll(const string& fname) {
+  ifstream in(fname);
+  string line;
+  while (getline(in, line))
+    if (!line.empty()) return line[0] != '[';
+  return false;
+}
+
+// a sentence as read, before the oracle
+struct Tree {
+  vector<string> words, tags, labels;
+  vector<int> heads;
+};
+
+vector<OracleSentence> read_conll_oracle(const string& fname, TransitionSystem system,
+                                         unsigned* lifted) {
+  ifstream in(fname);
+  if (!in) throw runtime_error("Unable to open " + fname);
+  vector<Tree> trees(1);
+  string line;
+  for (unsigned lineno = 1; getline(in, line); ++lineno) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) {
+      if (!trees.back().words.empty()) trees.emplace_back();
+      continue;
+    }
+    if (line[0] == '#') continue;
+    vector<string> fields;
+    if (line.find('\t') != string::npos) {
+      istringstream iss(line);
+      for (string f; getline(iss, f, '\t');) fields.push_back(f);
+    } else {
+      istringstream iss(line);
+      for (string f; iss >> f;) fields.push_back(f);
+    }
+    const string where = fname + ":" + to_string(lineno);
+    // ID to DEPREL: PHEAD and PDEPREL are not read
+    if (fields.size() < 8) throw runtime_error(where + ": expected at least 8 CoNLL columns");
+    if (fields[0].find_first_of("-.") != string::npos) continue;  // multiword token or empty node
+    Tree& t = trees.back();
+    if (fields[0] != to_string(t.words.size() + 1)) throw runtime_error(where + ": tokens out of order");
+    t.words.push_back(fields[1]);
+    t.tags.push_back(fields[4] != "_" ? fields[4] : fields[3]);
+    // the heads count from 1, with 0 for ROOT
+    const string& head = fields[6];
+    if (head.empty() || head.size() > 9 || head.find_first_not_of("0123456789") != string::npos)
+      throw runtime_error(where + ": bad HEAD '" + head + "'");
+    t.heads.push_back(atoi(head.c_str()) - 1);
+    t.labels.push_back(fields[7]);
+  }
+  if (trees.back().words.empty()) trees.pop_back();
+
+  vector<OracleSentence> sentences(trees.size());
+  const unsigned nthreads = max(1u, min<unsigned>(thread::hardware_concurrency(), trees.size()));
+  vector<exception_ptr> errors(nthreads);
+  vector<unsigned> lifts(nthreads);
+  vector<thread> threads;
+  for (unsigned t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&, t]() {
+      try {
+        for (unsigned s = t; s < trees.size(); s += nthreads) {
+          Tree& tree = trees[s];
+          const int n = tree.words.size();
+          try {
+            for (auto& h : tree.heads) {
+              if (h < -1 || h >= n) throw invalid_argument("Bad head in dependency tree");
+              if (h < 0) h = n;
+            }
+            sentences[s].heads = tree.heads;
+            if (system != kSWAP) lifts[t] += projectivize(&tree.heads);
+            sentences[s].actions = oracle(system, tree.heads, tree.labels);
+          } catch (const invalid_argument& e) {
+            throw runtime_error(fname + ": sentence " + to_string(s + 1) + ": " + e.what());
+          }
+          sentences[s].words.swap(tree.words);
+          sentences[s].tags.swap(tree.tags);
+          sentences[s].words.push_back("ROOT");
+          sentences[s].tags.push_back("ROOT");
+        }
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  for (auto& e : errors)
+    if (e) rethrow_exception(e);
+  if (lifted) *lifted = accumulate(lifts.begin(), lifts.end(), 0u);
+  return sentences;
+}
+
+} // namespace cpyp
@@ -0,0 +1,82 @@
+#ifndef ORACLE_H_
+#define ORACLE_H_
+
+#include <string>
+#include <vector>
+
+namespace cpyp {
+
+// the transition systems the parser can be trained with. in all three, ROOT
+// is the last token of the buffer, and parsing ends with ROOT alone on the
+// stack
+enum TransitionSystem {
+  kSWAP,  // arc-standard with SWAP, for any tree (up to O(n^2) transitions)
+  kHYBRID,  // arc-hybrid: 2n + 1 transitions for n words, projective trees
+  kEAGER  // arc-eager: 2n + 1 transitions for n words, projective trees
+};
+
+// the system of a name: "swap", "hybrid" or "eager"
+TransitionSystem transition_system(const std::string& name);
+
+// a sentence of a treebank, with ROOT as its last token, and the
+// transitions that build its tree
+struct OracleSentence {
+  std::vector<std::string> words;
+  std::vector<std::string> tags;
+  std::vector<std::string> actions;
+  // the heads of the words as read (see swap_oracle), before any arc is
+  // lifted to make the tree projective; empty for oracle files
+  std::vector<int> heads;
+};
+
+// the transitions of the arc-standard system with SWAP that build a tree,
+// as ParserOracleArcStdWithSwap.jar writes them: heads[i] is the head of
+// word i, or heads.size() (ROOT, at the end of the sentence) for the root.
+// arcs are added as soon as their dependent is complete, and otherwise the
+// words are swapped into the order of an in-order traversal of the tree as
+// soon as the top two of the stack are out of it (Nivre, 2009), so that
+// projective trees need no SWAP. the words attached to ROOT are left on the
+// stack, and ROOT, shifted last, takes them all by LEFT-ARC.
+std::vector<std::string> swap_oracle(const std::vector<int>& heads,
+                                     const std::vector<std::string>& labels);
+
+// the transitions of the arc-hybrid system (Kuhlmann, Gomez-Rodriguez and
+// Satta, 2011) that build a projective tree: SHIFT, LEFT-ARC (the top of
+// the stack is a dependent of the front of the buffer) and RIGHT-ARC (of
+// the word below it), and a last SHIFT of ROOT
+std::vector<std::string> hybrid_oracle(const std::vector<int>& heads,
+                                       const std::vector<std::string>& labels);
+
+// the transitions of the arc-eager system (Nivre, 2003) that build a
+// projective tree: SHIFT, LEFT-ARC (as in arc-hybrid), RIGHT-ARC (the front
+// of the buffer is a dependent of the top of the stack, and is pushed) and
+// REDUCE (of a word with its head and dependents), and a last SHIFT of ROOT.
+// words are reduced as soon as they are complete
+std::vector<std::string> eager_oracle(const std::vector<int>& heads,
+                                      const std::vector<std::string>& labels);
+
+// the oracle of a system
+std::vector<std::string> oracle(TransitionSystem system, const std::vector<int>& heads,
+                                const std::vector<std::string>& labels);
+
+// makes a tree projective by lifting each non-projective arc, shortest
+// first, to the head of its head (Nivre and Nilsson, 2005), and returns
+// the number of lifts
+unsigned projectivize(std::vector<int>* heads);
+
+// true if the file is a CoNLL treebank rather than an oracle, whose
+// sentences start with a [][...] line
+bool is_conll(const std::string& fname);
+
+// reads a CoNLL-X or CoNLL-U treebank (the POS tag is POSTAG, or CPOSTAG
+// where it is "_"; comments, multiword tokens and empty nodes are skipped)
+// and computes the oracle of each sentence, on as many threads as the
+// machine has. the trees are projectivized for the systems that need it,
+// counting the arcs lifted in *lifted if it is given
+std::vector<OracleSentence> read_conll_oracle(const std::string& fname,
+                                              TransitionSystem system = kSWAP,
+                                              unsigned* lifted = nullptr);
+
+} // namespace cpyp
+
+#endif
@@ -0,0 +1,274 @@
+#include "parse-cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace lstm_parser {
+
+// a file written by save() holds: magic, the model version, the number of
+// labels and the number of parses (as uint64_t), each label (its length as
+// uint32_t and its characters) and each parse (its key and check as
+// uint64_t, its length as uint32_t, the heads as int32_t and the labels as
+// uint16_t), in native byte order
+static const uint64_t kMAGIC = 0x3268636163706c;  // "lpcach2"
+// the fewest bytes a label and a parse take in a file
+static const size_t kMIN_LABEL_BYTES = sizeof(uint32_t);
+static const size_t kMIN_ENTRY_BYTES = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+static const uint64_t kFNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t kFNV_PRIME = 1099511628211ULL;
+
+static uint64_t fnv(uint64_t h, const char* s, size_t len) {
+  for (size_t i = 0; i < len; ++i) h = (h ^ static_cast<unsigned char>(s[i])) * kFNV_PRIME;
+  return h;
+}
+
+// the check of a key: a polynomial hash with another multiplier, which
+// avalanche (the finalizer of splitmix64) mixes, so that it does not
+// collide when fnv does
+static const uint64_t kPOLY_MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t poly(uint64_t h, const char* s, size_t len) {
+  for (size_t i = 0; i < len; ++i) h = (h + static_cast<unsigned char>(s[i]) + 1) * kPOLY_MULTIPLIER;
+  return h;
+}
+
+static uint64_t avalanche(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+ParseCache::ParseCache(size_t max_bytes, uint64_t version) :
+    lookups(), hits(), evictions(), max_bytes(max_bytes), version(version), used_bytes() {}
+
+ParseCache::Key ParseCache::hash(const vector<Token>& sentence) {
+  uint64_t h = kFNV_OFFSET, c = 0;
+  // the NULs keep ("ab", "c") and ("a", "bc") apart
+  for (auto& t : sentence) {
+    h = fnv(h, t.word.c_str(), t.word.size() + 1);
+    h = fnv(h, t.pos.c_str(), t.pos.size() + 1);
+    c = poly(c, t.word.c_str(), t.word.size() + 1);
+    c = poly(c, t.pos.c_str(), t.pos.size() + 1);
+  }
+  return Key{h, avalanche(c), static_cast<uint32_t>(sentence.size())};
+}
+
+// a stream buffer that hashes what is written to it, so that the bundle of
+// a parser is hashed without being held in memory
+class HashBuf : public streambuf {
+ public:
+  uint64_t h = kFNV_OFFSET;
+ protected:
+  streamsize xsputn(const char* s, streamsize n) override {
+    h = fnv(h, s, n);
+    return n;
+  }
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    const char ch = traits_type::to_char_type(c);
+    h = fnv(h, &ch, 1);
+    return c;
+  }
+};
+
+uint64_t ParseCache::hash_parser(const Parser& parser) {
+  HashBuf buf;
+  ostream out(&buf);
+  parser.write_bundle(out);
+  return buf.h;
+}
+
+size_t ParseCache::entry_bytes(unsigned len) {
+  // the list node (two pointers), the index node (a pointer, the key, the
+  // iterator and the cached hash) and a bucket
+  return sizeof(Entry) + 2 * sizeof(void*) + 5 * sizeof(void*) +
+         len * (sizeof(int32_t) + sizeof(uint16_t));
+}
+
+bool ParseCache::find(const Key& key, Parse* parse) {
+  ++lookups;
+  auto it = index.find(key.hash);
+  if (it == index.end()) return false;
+  const Entry& e = *it->second;
+  if (e.check != key.check || e.heads.size() != key.length) return false;
+  ++hits;
+  entries.splice(entries.begin(), entries, it->second);
+  parse->heads.assign(e.heads.begin(), e.heads.end());
+  parse->labels.clear();
+  for (auto l : e.labels) parse->labels.push_back(label_names[l]);
+  return true;
+}
+
+void ParseCache::insert(const Key& key, const Parse& parse) {
+  if (parse.heads.size() != key.length || parse.labels.size() != key.length)
+    throw invalid_argument("ParseCache: the parse is not of the sentence of the key");
+  Entry e{key.hash, key.check, vector<int32_t>(parse.heads.begin(), parse.heads.end()), {}};
+  for (auto& l : parse.labels) e.labels.push_back(label_id(l));
+  insert_labeled(std::move(e));
+}
+
+// replaces the parse with the same key, if there is one: its sentence is
+// the same one, or one whose first hash collides
+void ParseCache::insert_labeled(Entry entry) {
+  auto it = index.find(entry.key);
+  if (it != index.end()) {
+    used_bytes -= entry_bytes(it->second->heads.size());
+    entries.erase(it->second);
+    index.erase(it);
+  }
+  const size_t b = entry_bytes(entry.heads.size());
+  if (b > max_bytes) return;
+  while (used_bytes + b > max_bytes) {
+    const Entry& last = entries.back();
+    used_bytes -= entry_bytes(last.heads.size());
+    index.erase(last.key);
+    entries.pop_back();
+    ++evictions;
+  }
+  const uint64_t key = entry.key;
+  entries.push_front(std::move(entry));
+  index[key] = entries.begin();
+  used_bytes += b;
+}
+
+uint16_t ParseCache::label_id(const string& label) {
+  auto it = label_ids.find(label);
+  if (it != label_ids.end()) return it->second;
+  if (label_names.size() > UINT16_MAX) throw runtime_error("Too many labels for ParseCache");
+  label_ids[label] = label_names.size();
+  label_names.push_back(label);
+  return label_names.size() - 1;
+}
+
+template <class T> static void put(ostream& out, T x) {
+  out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+void ParseCache::save(const string& fname) const {
+  // written aside and renamed, so that a process reading the file never
+  // sees half of it
+  const string tmp = fname + ".tmp";
+  {
+    ofstream out(tmp, ios::binary);
+    put<uint64_t>(out, kMAGIC);
+    put<uint64_t>(out, version);
+    put<uint64_t>(out, label_names.size());
+    put<uint64_t>(out, entries.size());
+    for (auto& l : label_names) {
+      put<uint32_t>(out, l.size());
+      out.write(l.data(), l.size());
+    }
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+      put<uint64_t>(out, it->key);
+      put<uint64_t>(out, it->check);
+      put<uint32_t>(out, it->heads.size());
+      out.write(reinterpret_cast<const char*>(it->heads.data()), it->heads.size() * sizeof(int32_t));
+      out.write(reinterpret_cast<const char*>(it->labels.data()), it->labels.size() * sizeof(uint16_t));
+    }
+    if (!out) throw runtime_error("Unable to write " + tmp);
+  }
+  if (rename(tmp.c_str(), fname.c_str()) != 0) throw runtime_error("Unable to write " + fname);
+}
+
+// reads the fields of a mapped file, and throws past its end
+struct MappedReader {
+  const char* p;
+  const char* end;
+
+  size_t left() const { return end - p; }
+  const char* take(size_t n) {
+    if (n > left()) throw runtime_error("Bad ParseCache data");
+    const char* r = p;
+    p += n;
+    return r;
+  }
+  template <class T> T get() {
+    T x;
+    memcpy(&x, take(sizeof(T)), sizeof(T));
+    return x;
+  }
+};
+
+unsigned ParseCache::load(const string& fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) return 0;
+  struct stat st;
+  void* ptr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) return 0;
+  const char* data = static_cast<const char*>(ptr);
+  MappedReader in{data, data + st.st_size};
+  // the parses are all read before any is added, so that a bad file adds
+  // nothing. the counts are checked against the size of the file before
+  // anything is allocated for them
+  vector<Entry> read;
+  vector<string> names;
+  try {
+    if (in.get<uint64_t>() != kMAGIC) throw runtime_error("Bad ParseCache data");
+    if (in.get<uint64_t>() == version) {
+      const uint64_t nlabels = in.get<uint64_t>();
+      const uint64_t nentries = in.get<uint64_t>();
+      if (nlabels > uint64_t(UINT16_MAX) + 1 || nlabels > in.left() / kMIN_LABEL_BYTES)
+        throw runtime_error("Bad ParseCache data");
+      for (names.reserve(nlabels); names.size() < nlabels;) {
+        const uint32_t len = in.get<uint32_t>();
+        names.emplace_back(in.take(len), len);
+      }
+      if (nentries > in.left() / kMIN_ENTRY_BYTES) throw runtime_error("Bad ParseCache data");
+      for (read.reserve(nentries); read.size() < nentries;) {
+        Entry e;
+        e.key = in.get<uint64_t>();
+        e.check = in.get<uint64_t>();
+        const uint32_t len = in.get<uint32_t>();
+        const char* h = in.take(size_t(len) * sizeof(int32_t));
+        const char* l = in.take(size_t(len) * sizeof(uint16_t));
+        e.heads.resize(len);
+        e.labels.resize(len);
+        memcpy(e.heads.data(), h, len * sizeof(int32_t));
+        memcpy(e.labels.data(), l, len * sizeof(uint16_t));
+        for (auto x : e.heads)
+          if (x < 0 || x > int64_t(len)) throw runtime_error("Bad ParseCache data");
+        for (auto x : e.labels)
+          if (x >= nlabels) throw runtime_error("Bad ParseCache data");
+        read.push_back(std::move(e));
+      }
+    }
+  } catch (const runtime_error&) {
+    munmap(ptr, st.st_size);
+    throw runtime_error("Bad ParseCache data in " + fname);
+  }
+  munmap(ptr, st.st_size);
+  // the file's label ids, in ours
+  vector<uint16_t> labels;
+  for (auto& name : names) labels.push_back(label_id(name));
+  for (auto& e : read) {
+    for (auto& x : e.labels) x = labels[x];
+    insert_labeled(std::move(e));
+  }
+  evictions = 0;
+  return read.size();
+}
+
+void ParseCache::print_stats(ostream& out) const {
+  const streamsize precision = out.precision(4);
+  out << "PARSE CACHE lookups: " << lookups << " hits: " << hits
+      << " (" << (lookups ? 100.0 * hits / lookups : 0.0) << "%) parses: " << entries.size()
+      << " (" << used_bytes / 1048576.0 << " of " << max_bytes / 1048576.0 << " MB)"
+      << " evictions: " << evictions << endl;
+  out.precision(precision);
+}
+
+} // namespace lstm_parser
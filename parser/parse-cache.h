@@ -0,0 +1,86 @@
+#ifndef PARSE_CACHE_H_
+#define PARSE_CACHE_H_
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "parser.h"
+
+namespace lstm_parser {
+
+// the parses of sentences seen before, by a 64 bit hash of their words and
+// tags. a second, independent hash and the length of the sentence are
+// checked too, so that sentences whose first hashes collide miss rather
+// than get each other's parse. it holds up to max_bytes of parses, and
+// evicts the least recently used ones beyond that. the parses are those of
+// one model, identified by version: a file written by save() for another
+// model is not read
+class ParseCache {
+ public:
+  // what identifies a sentence
+  struct Key {
+    uint64_t hash;  // the index of the cache
+    uint64_t check;
+    uint32_t length;
+  };
+
+  ParseCache(size_t max_bytes, uint64_t version);
+
+  // the key of a sentence (without ROOT)
+  static Key hash(const std::vector<Token>& sentence);
+  // a version for a parser: a hash of everything its parses depend on (its
+  // options, vocabulary, embeddings and parameters, as save_bundle writes
+  // them)
+  static uint64_t hash_parser(const Parser& parser);
+
+  // sets *parse to the parse of the sentence with the key and returns true,
+  // if there is one
+  bool find(const Key& key, Parse* parse);
+  // the parse must have key.length tokens
+  void insert(const Key& key, const Parse& parse);
+
+  // writes the cache, least recently used parse first, to a file that
+  // load() maps and reads back
+  void save(const std::string& fname) const;
+  // adds the parses in a file written by save() and returns how many were
+  // read: none if the file does not exist or is of another version. throws
+  // runtime_error, adding nothing, if the file is not a valid cache
+  unsigned load(const std::string& fname);
+
+  unsigned size() const { return entries.size(); }
+  size_t bytes() const { return used_bytes; }
+  void print_stats(std::ostream& out) const;
+
+  unsigned long lookups;
+  unsigned long hits;
+  unsigned long evictions;
+
+ private:
+  // the length of the sentence is that of heads and labels
+  struct Entry {
+    uint64_t key;
+    uint64_t check;
+    std::vector<int32_t> heads;
+    std::vector<uint16_t> labels;  // indices in label_names
+  };
+  // an estimate of the memory an entry takes, bookkeeping included
+  static size_t entry_bytes(unsigned len);
+  void insert_labeled(Entry entry);
+  uint16_t label_id(const std::string& label);
+
+  const size_t max_bytes;
+  const uint64_t version;
+  size_t used_bytes;
+  std::list<Entry> entries;  // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  std::vector<std::string> label_names;
+  std::unordered_map<std::string, uint16_t> label_ids;
+};
+
+} // namespace lstm_parser
+
+#endif
@@ -0,0 +1,850 @@
+#include "parser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <sstream>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/set.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/unordered_map.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "cnn/expr.h"
+#include "cnn/nodes.h"
+#include "latency.h"
+#include "parse-cache.h"
+
+using namespace cnn::expr;
+using namespace cnn;
+using namespace std;
+
+namespace lstm_parser {
+
+constexpr const char* ROOT_SYMBOL = "ROOT";
+// ROOT is the last token of every sentence
+static const Token kROOT = {ROOT_SYMBOL, ROOT_SYMBOL};
+
+ParserBuilder::ParserBuilder(Model* model, const ParserOptions& options, unsigned vocab_size,
+                             unsigned action_size, unsigned pos_size,
+                             const unordered_map<unsigned, vector<float>>& pretrained,
+                             const vector<string>& actions) :
+    stack_lstm(options.stack_cell, options.layers, options.lstm_input_dim, options.hidden_dim, model),
+    buffer_lstm(options.lookahead ? StackLSTMBuilder() :
+                StackLSTMBuilder(options.buffer_cell, options.layers, options.lstm_input_dim, options.hidden_dim, model)),
+    action_lstm(options.action_cell, options.layers, options.action_dim, options.hidden_dim, model),
+    p_w(model->add_lookup_parameters(vocab_size, {options.input_dim})),
+    p_a(model->add_lookup_parameters(action_size, {options.action_dim})),
+    p_r(model->add_lookup_parameters(action_size, {options.rel_dim})),
+    p_pbias(model->add_parameters({options.hidden_dim})),
+    p_A(model->add_parameters({options.hidden_dim, options.hidden_dim})),
+    p_B(model->add_parameters({options.hidden_dim, options.lookahead ? options.lookahead * options.lstm_input_dim : options.hidden_dim})),
+    p_S(model->add_parameters({options.hidden_dim, options.hidden_dim})),
+    p_H(model->add_parameters({options.lstm_input_dim, options.lstm_input_dim})),
+    p_D(model->add_parameters({options.lstm_input_dim, options.lstm_input_dim})),
+    p_R(model->add_parameters({options.lstm_input_dim, options.rel_dim})),
+    p_w2l(model->add_parameters({options.lstm_input_dim, options.input_dim})),
+    p_ib(model->add_parameters({options.lstm_input_dim})),
+    p_cbias(model->add_parameters({options.lstm_input_dim})),
+    p_p2a(options.factored_actions ? nullptr : model->add_parameters({action_size, options.hidden_dim})),
+    p_action_start(model->add_parameters({options.action_dim})),
+    p_abias(options.factored_actions ? nullptr : model->add_parameters({action_size})),
+    p_buffer_guard(model->add_parameters({options.lstm_input_dim})),
+    p_stack_guard(model->add_parameters({options.lstm_input_dim})),
+    options(options), system(cpyp::transition_system(options.transitions)), vocab_size(vocab_size), action_size(action_size), pos_size(pos_size),
+    pretrained(pretrained), possible_actions(action_size - 1) {
+  if (options.use_pos) {
+    p_p = model->add_lookup_parameters(pos_size, {options.pos_dim});
+    p_p2l = model->add_parameters({options.lstm_input_dim, options.pos_dim});
+  }
+  if (pretrained.size() > 0) {
+    p_t = model->add_lookup_parameters(vocab_size, {options.pretrained_dim});
+    for (auto it : pretrained)
+      p_t->Initialize(it.first, it.second);
+    p_t2l = model->add_parameters({options.lstm_input_dim, options.pretrained_dim});
+  } else {
+    p_t = nullptr;
+    p_t2l = nullptr;
+  }
+  p_wfold = p_tfold = p_pfold = p_rfold = p_afold = nullptr;
+  use_folded = false;
+  dropout = 0;
+  for (unsigned i = 0; i < possible_actions.size(); ++i)
+    possible_actions[i] = i;
+  p_p2t = p_tbias = nullptr;
+  if (options.factored_actions) {
+    // LEFT-ARC(nsubj) is of type LEFT-ARC; SHIFT is the only action of its type
+    vector<string> types;
+    for (unsigned a = 0; a < possible_actions.size(); ++a) {
+      const string type = actions[a].substr(0, actions[a].find('('));
+      const unsigned t = find(types.begin(), types.end(), type) - types.begin();
+      if (t == types.size()) {
+        types.push_back(type);
+        type_actions.emplace_back();
+      }
+      action_type.push_back(t);
+      action_label.push_back(type_actions[t].size());
+      type_actions[t].push_back(a);
+    }
+    p_p2t = model->add_parameters({(unsigned)types.size(), options.hidden_dim});
+    p_tbias = model->add_parameters({(unsigned)types.size()});
+    for (auto& ta : type_actions) {
+      const bool labeled = ta.size() > 1;
+      p_p2labels.push_back(labeled ? model->add_parameters({(unsigned)ta.size(), options.hidden_dim}) : nullptr);
+      p_lbiases.push_back(labeled ? model->add_parameters({(unsigned)ta.size()}) : nullptr);
+    }
+  }
+}
+
+void ParserBuilder::add_folded_tables(Model* folded) {
+  p_wfold = folded->add_lookup_parameters(vocab_size, {options.lstm_input_dim});
+  if (p_t)
+    p_tfold = folded->add_lookup_parameters(vocab_size, {options.lstm_input_dim});
+  if (options.use_pos)
+    p_pfold = folded->add_lookup_parameters(pos_size, {options.lstm_input_dim});
+  p_rfold = folded->add_lookup_parameters(action_size, {options.lstm_input_dim});
+  if (action_lstm.can_fold_inputs())
+    p_afold = folded->add_lookup_parameters(action_size, {3 * options.hidden_dim});
+}
+
+void ParserBuilder::fold_tables() {
+  assert(p_wfold);
+  for (unsigned i = 0; i < vocab_size; ++i) {
+    auto y = p_wfold->values[i].vec();
+    y = p_ib->values.vec() + *p_w2l->values * p_w->values[i].vec();
+    if (p_tfold) {
+      auto t = p_tfold->values[i].vec();
+      t = *p_t2l->values * p_t->values[i].vec();
+    }
+  }
+  for (unsigned i = 0; p_pfold && i < pos_size; ++i) {
+    auto y = p_pfold->values[i].vec();
+    y = *p_p2l->values * p_p->values[i].vec();
+  }
+  for (unsigned i = 0; i < action_size; ++i) {
+    auto y = p_rfold->values[i].vec();
+    y = p_cbias->values.vec() + *p_R->values * p_r->values[i].vec();
+  }
+  if (p_afold) action_lstm.fold_inputs(*p_a, p_afold);
+  use_folded = true;
+}
+
+void ParserBuilder::set_dropout(float d) {
+  stack_lstm.set_variational_dropout(d);
+  if (!options.lookahead) buffer_lstm.set_variational_dropout(d);
+  action_lstm.set_variational_dropout(d);
+  dropout = d;
+}
+
+bool ParserBuilder::IsActionForbidden(cpyp::TransitionSystem system, const string& a,
+                                      unsigned bsize, unsigned ssize, const vector<int>& stacki,
+                                      const vector<bool>& has_head, bool multiple_roots) {
+if (system != cpyp::kSWAP) {
+  // the front of the buffer is ROOT when bsize == 2. it is shifted last,
+  // onto an empty stack, and takes any word left on the stack as a root
+  if (a[0] == 'S') return bsize == 1 || (bsize == 2 && ssize > 1);
+  if (ssize < 2) return true;
+  if (a[0] == 'R' && a[1] == 'E') return !has_head[stacki.back()];  // REDUCE
+  if (a[0] == 'L') return bsize < 2 || (system == cpyp::kEAGER && has_head[stacki.back()]);
+  // RIGHT-ARC: to the word below in arc-hybrid, and from ROOT in neither
+  return system == cpyp::kHYBRID ? ssize < 3 : bsize <= 2;
+}
+if (a[1]=='W' && ssize<3) return true;
+if (a[1]=='W') {
+      int top=stacki[stacki.size()-1];
+      int sec=stacki[stacki.size()-2];
+      if (sec>top) return true;
+}
+
+bool is_shift = (a[0] == 'S' && a[1]=='H');
+bool is_reduce = !is_shift;
+if (is_shift && bsize == 1) return true;
+if (is_reduce && ssize < 3) return true;
+if (multiple_roots) {
+  // once ROOT is shifted (last), the words left on the stack are attached
+  // to it by LEFT-ARC: there can be several, as in treebanks that attach
+  // punctuation to ROOT, and swap_oracle shifts ROOT onto all of them
+  if (bsize == 1 && a[0] != 'L') return true;
+  return false;
+}
+if (bsize == 2 && // ROOT is the only thing remaining on buffer
+    ssize > 2 && // there is more than a single element on the stack
+    is_shift) return true;
+// only attach left to ROOT
+if (bsize == 1 && ssize == 3 && a[0] == 'R') return true;
+return false;
+}
+
+map<int,int> ParserBuilder::compute_heads(unsigned sent_len, const vector<unsigned>& actions,
+                                          const vector<string>& setOfActions,
+                                          cpyp::TransitionSystem system, map<int,string>* pr) {
+map<int,int> heads;
+map<int,string> r;
+map<int,string>& rels = (pr ? *pr : r);
+for(unsigned i=0;i<sent_len;i++) { heads[i]=-1; rels[i]="ERROR"; }
+vector<int> bufferi(sent_len + 1, 0), stacki(1, -999);
+for (unsigned i = 0; i < sent_len; ++i)
+  bufferi[sent_len - i] = i;
+bufferi[0] = -999;
+for (auto action: actions) { // loop over transitions for sentence
+  const string& actionString=setOfActions[action];
+  const char ac = actionString[0];
+  const char ac2 = actionString[1];
+  if (ac =='S' && ac2=='H') {  // SHIFT
+    assert(bufferi.size() > 1); // dummy symbol means > 1 (not >= 1)
+    stacki.push_back(bufferi.back());
+    bufferi.pop_back();
+  } else if (ac=='S' && ac2=='W') { // SWAP
+    assert(stacki.size() > 2);
+    unsigned ii = 0, jj = 0;
+    jj = stacki.back();
+    stacki.pop_back();
+    ii = stacki.back();
+    stacki.pop_back();
+    bufferi.push_back(ii);
+    stacki.push_back(jj);
+  } else if (ac=='R' && ac2=='E') { // REDUCE
+    assert(stacki.size() > 1);
+    stacki.pop_back();
+  } else if (system == cpyp::kSWAP || (system == cpyp::kHYBRID && ac == 'R')) {
+    // LEFT or RIGHT between the top two words of the stack
+    assert(stacki.size() > 2); // dummy symbol means > 2 (not >= 2)
+    assert(ac == 'L' || ac == 'R');
+    unsigned depi = 0, headi = 0;
+    (ac == 'R' ? depi : headi) = stacki.back();
+    stacki.pop_back();
+    (ac == 'R' ? headi : depi) = stacki.back();
+    stacki.pop_back();
+    stacki.push_back(headi);
+    heads[depi] = headi;
+    rels[depi] = actionString;
+  } else if (ac == 'L') { // the top of the stack to the front of the buffer
+    assert(stacki.size() > 1 && bufferi.size() > 1);
+    heads[stacki.back()] = bufferi.back();
+    rels[stacki.back()] = actionString;
+    stacki.pop_back();
+  } else { // arc-eager RIGHT: the front of the buffer to the top of the stack
+    assert(ac == 'R' && stacki.size() > 1 && bufferi.size() > 1);
+    heads[bufferi.back()] = stacki.back();
+    rels[bufferi.back()] = actionString;
+    stacki.push_back(bufferi.back());
+    bufferi.pop_back();
+  }
+}
+assert(bufferi.size() == 1);
+//assert(stacki.size() == 2);
+return heads;
+}
+
+void ParserBuilder::begin(ComputationGraph* g, const vector<string>& actions, bool train,
+                          bool incremental) {
+  hg = g;
+  setOfActions = &actions;
+  training = train;
+  input_ended = false;
+  // one dropout mask per sentence, sampled by new_graph
+  for (StackLSTMBuilder* lstm : {&stack_lstm, &buffer_lstm, &action_lstm}) {
+    if (lstm == &buffer_lstm && options.lookahead) continue;
+    if (training && dropout > 0)
+      lstm->set_variational_dropout(dropout);
+    else
+      lstm->disable_dropout();
+  }
+  // when decoding, the stack and buffer LSTMs don't need to keep popped
+  // states around for backprop
+  stack_lstm.new_graph(*hg, !training);
+  if (!options.lookahead) buffer_lstm.new_graph(*hg, !training);
+  action_lstm.new_graph(*hg, !training);
+  // the folded tables are only up to date when decoding
+  folded = use_folded && !training;
+  // the projections of a whole sentence need all of it, and are left out of
+  // window models so that a sentence parses the same read incrementally
+  batched = options.batched_compose && !incremental && !options.lookahead;
+  // variables in the computation graph representing the parameters
+  pbias = parameter(*hg, p_pbias);
+  H = parameter(*hg, p_H);
+  D = parameter(*hg, p_D);
+  R = parameter(*hg, p_R);
+  cbias = parameter(*hg, p_cbias);
+  S = parameter(*hg, p_S);
+  B = parameter(*hg, p_B);
+  A = parameter(*hg, p_A);
+  ib = parameter(*hg, p_ib);
+  w2l = parameter(*hg, p_w2l);
+  if (options.use_pos)
+    p2l = parameter(*hg, p_p2l);
+  if (p_t2l)
+    t2l = parameter(*hg, p_t2l);
+  if (options.factored_actions) {
+    p2t = parameter(*hg, p_p2t);
+    tbias = parameter(*hg, p_tbias);
+    // the label layers are added to the graph when they are first used
+    p2labels.assign(type_actions.size(), Expression());
+    lbiases.assign(type_actions.size(), Expression());
+  } else {
+    p2a = parameter(*hg, p_p2a);
+    abias = parameter(*hg, p_abias);
+  }
+  Expression action_start = parameter(*hg, p_action_start);
+
+  action_lstm.push(action_start);
+
+  // dummy symbol to represent the empty buffer
+  bufferx.assign(1, parameter(*hg, p_buffer_guard));
+  bufferi.assign(1, -999);
+  tokens.clear();
+  token_col.clear();
+  // stack_lstm holds the variables representing subtree embeddings
+  // drive dummy symbol on stack through LSTM
+  stack_lstm.push(parameter(*hg, p_stack_guard));
+  stacki.assign(1, -999); // not used for anything
+  has_head.clear();
+  log_probs.clear();
+}
+
+void ParserBuilder::add_token(unsigned raw, unsigned word, unsigned pos) {
+  assert(!input_ended);
+  assert(word < vocab_size);
+  Expression x;
+  if (folded) {
+    vector<Expression> args = {const_lookup(*hg, p_wfold, word)};
+    if (options.use_pos)
+      args.push_back(const_lookup(*hg, p_pfold, pos));
+    if (p_t && pretrained.count(raw))
+      args.push_back(const_lookup(*hg, p_tfold, raw));
+    x = rectify(sum(args));
+  } else {
+    Expression w = lookup(*hg, p_w, word);
+
+    vector<Expression> args = {ib, w2l, w}; // learn embeddings
+    if (options.use_pos) { // learn POS tag?
+      Expression p = lookup(*hg, p_p, pos);
+      args.push_back(p2l);
+      args.push_back(p);
+    }
+    if (p_t && pretrained.count(raw)) {  // include fixed pretrained vectors?
+      Expression t = const_lookup(*hg, p_t, raw);
+      args.push_back(t2l);
+      args.push_back(t);
+    }
+    x = rectify(affine_transform(args));
+  }
+  // the token goes to the bottom of the buffer (just above the guard)
+  bufferx.insert(bufferx.begin() + 1, x);
+  bufferi.insert(bufferi.begin() + 1, tokens.size());
+  tokens.push_back(x);
+  has_head.push_back(false);
+}
+
+void ParserBuilder::end_input() {
+  input_ended = true;
+  if (!options.lookahead) {
+    for (auto& b : bufferx)
+      buffer_lstm.push(b);
+  }
+
+  // H * x and D * x of every token, as the columns of one product each.
+  // reductions use them when the head or dependent is still a token, and
+  // only compose subtrees on the fly (concatenate_cols takes < 512 inputs)
+  if (batched && tokens.size() < 512) {
+    for (unsigned i = 0; i < tokens.size(); ++i)
+      token_col[tokens[i].i] = i;
+    Expression x = concatenate_cols(tokens);
+    token_hx = H * x;
+    token_dx = D * x;
+  }
+}
+
+bool ParserBuilder::can_act() const {
+  // a window model knows its buffer summary once the window is full, and
+  // until ROOT comes the buffer holds more than the rules of
+  // IsActionForbidden look at
+  if (input_ended) return stacki.size() > 2 || bufferi.size() > 1;
+  return options.lookahead && bufferi.size() > options.lookahead;
+}
+
+Expression ParserBuilder::buffer_summary() {
+  if (!options.lookahead) return buffer_lstm.top();
+  // the first lookahead tokens of the buffer, padded with the guard
+  vector<Expression> window(options.lookahead, bufferx[0]);
+  for (unsigned j = 0; j < options.lookahead && j + 1 < bufferx.size(); ++j)
+    window[j] = bufferx[bufferx.size() - 1 - j];
+  return options.lookahead == 1 ? window[0] : concatenate(window);
+}
+
+Expression ParserBuilder::compose(Expression head, Expression dep, unsigned action) {
+  // composed = cbias + H * head + D * dep + R * relation
+  vector<Expression> args;
+  if (folded) {
+    args = {const_lookup(*hg, p_rfold, action)};
+  } else {
+    // get relation embedding from action (TODO: convert to relation from action?)
+    Expression relation = lookup(*hg, p_r, action);
+    args = {cbias, R, relation};
+  }
+  vector<Expression> token_terms;  // precomputed H * head and D * dep
+  auto hc = token_col.find(head.i);
+  if (hc != token_col.end()) {
+    token_terms.push_back(select_cols(token_hx, {hc->second}));
+  } else {
+    args.push_back(H);
+    args.push_back(head);
+  }
+  auto dc = token_col.find(dep.i);
+  if (dc != token_col.end()) {
+    token_terms.push_back(select_cols(token_dx, {dc->second}));
+  } else {
+    args.push_back(D);
+    args.push_back(dep);
+  }
+  Expression composed = affine_transform(args);
+  if (token_terms.size() > 0) {
+    token_terms.push_back(composed);
+    composed = sum(token_terms);
+  }
+  return tanh(composed);
+}
+
+Expression ParserBuilder::factored_log_prob(Expression state, const vector<unsigned>& valid_actions,
+                                            int correct, unsigned* best) {
+  // whether an action is allowed only depends on its type
+  vector<unsigned> valid_types;
+  for (auto a : valid_actions)
+    if (find(valid_types.begin(), valid_types.end(), action_type[a]) == valid_types.end())
+      valid_types.push_back(action_type[a]);
+  Expression tdist = log_softmax(affine_transform({tbias, p2t, state}), valid_types);
+  vector<float> tscores = as_vector(hg->incremental_forward());
+  unsigned best_t = valid_types[0];
+  for (auto t : valid_types)
+    if (tscores[t] > tscores[best_t]) best_t = t;
+  const unsigned t = correct >= 0 ? action_type[correct] : best_t;
+  Expression log_prob = pick(tdist, t);
+  const vector<unsigned>& actions = type_actions[t];
+  *best = type_actions[best_t][0];
+  if (actions.size() == 1) return log_prob;
+
+  if (!p2labels[t].pg) {
+    p2labels[t] = parameter(*hg, p_p2labels[t]);
+    lbiases[t] = parameter(*hg, p_lbiases[t]);
+  }
+  Expression ldist = log_softmax(affine_transform({lbiases[t], p2labels[t], state}));
+  if (t == best_t) {  // otherwise the label makes no difference to *best
+    vector<float> lscores = as_vector(hg->incremental_forward());
+    *best = actions[max_element(lscores.begin(), lscores.end()) - lscores.begin()];
+  }
+  return log_prob + pick(ldist, correct >= 0 ? action_label[correct] : action_label[*best]);
+}
+
+unsigned ParserBuilder::act(int correct, double* right) {
+  assert(can_act());
+  // get list of possible actions for the current parser state
+  // (before the end of the input, ROOT is still to come)
+  const unsigned bsize = bufferi.size() + (input_ended ? 0 : 1);
+  vector<unsigned> current_valid_actions;
+  for (auto a: possible_actions) {
+    if (IsActionForbidden(system, (*setOfActions)[a], bsize, stacki.size(), stacki, has_head,
+                          options.multiple_roots))
+      continue;
+    current_valid_actions.push_back(a);
+  }
+
+  // p_t = pbias + S * slstm + B * blstm + A * almst
+  Expression p_t = affine_transform({pbias, S, stack_lstm.top(), B, buffer_summary(), A, action_lstm.top()});
+  Expression nlp_t = rectify(p_t);
+  unsigned best_a;
+  Expression adiste;
+  if (options.factored_actions) {
+    adiste = factored_log_prob(nlp_t, current_valid_actions, correct, &best_a);
+  } else {
+    // r_t = abias + p2a * nlp
+    Expression r_t = affine_transform({abias, p2a, nlp_t});
+
+    // adist = log_softmax(r_t, current_valid_actions)
+    adiste = log_softmax(r_t, current_valid_actions);
+    vector<float> adist = as_vector(hg->incremental_forward());
+    double best_score = adist[current_valid_actions[0]];
+    best_a = current_valid_actions[0];
+    for (unsigned i = 1; i < current_valid_actions.size(); ++i) {
+      if (adist[current_valid_actions[i]] > best_score) {
+        best_score = adist[current_valid_actions[i]];
+        best_a = current_valid_actions[i];
+      }
+    }
+  }
+  unsigned action = best_a;
+  if (correct >= 0) {  // if we have reference actions (for training) use the reference action
+    action = correct;
+    if (best_a == action) { (*right)++; }
+  }
+  log_probs.push_back(options.factored_actions ? adiste : pick(adiste, action));
+
+  // add current action to action LSTM
+  Expression actione = lookup(*hg, p_a, action);
+  if (folded && p_afold)
+    action_lstm.push(actione, p_afold->values[action]);
+  else
+    action_lstm.push(actione);
+
+  // do action
+  const string& actionString=(*setOfActions)[action];
+  const char ac = actionString[0];
+  const char ac2 = actionString[1];
+
+
+  if (ac =='S' && ac2=='H') {  // SHIFT
+    assert(bufferi.size() > 1); // dummy symbol means > 1 (not >= 1)
+    stack_lstm.push(bufferx.back());
+    if (!options.lookahead) buffer_lstm.pop();
+    bufferx.pop_back();
+    stacki.push_back(bufferi.back());
+    bufferi.pop_back();
+  } else if (ac=='S' && ac2=='W'){ //SWAP --- Miguel
+    assert(stacki.size() > 2); // dummy symbol means > 2 (not >= 2)
+
+    Expression toki, tokj;
+    unsigned ii = 0, jj = 0;
+    tokj=stack_lstm.top_input();
+    jj=stacki.back();
+    stack_lstm.pop();
+    stacki.pop_back();
+
+    toki=stack_lstm.top_input();
+    ii=stacki.back();
+    stack_lstm.pop();
+    stacki.pop_back();
+
+    if (!options.lookahead) buffer_lstm.push(toki);
+    bufferx.push_back(toki);
+    bufferi.push_back(ii);
+
+    stack_lstm.push(tokj);
+    stacki.push_back(jj);
+  } else if (ac=='R' && ac2=='E') { // REDUCE (arc-eager)
+    assert(stacki.size() > 1);
+    stack_lstm.pop();
+    stacki.pop_back();
+  } else if (system == cpyp::kSWAP || (system == cpyp::kHYBRID && ac == 'R')) {
+    // LEFT or RIGHT between the top two words of the stack
+    assert(stacki.size() > 2); // dummy symbol means > 2 (not >= 2)
+    assert(ac == 'L' || ac == 'R');
+    Expression dep, head;
+    unsigned depi = 0, headi = 0;
+    (ac == 'R' ? dep : head) = stack_lstm.top_input();
+    (ac == 'R' ? depi : headi) = stacki.back();
+    stack_lstm.pop();
+    stacki.pop_back();
+    (ac == 'R' ? head : dep) = stack_lstm.top_input();
+    (ac == 'R' ? headi : depi) = stacki.back();
+    stack_lstm.pop();
+    stacki.pop_back();
+    stack_lstm.push(compose(head, dep, action));
+    stacki.push_back(headi);
+  } else if (ac == 'L') { // the top of the stack to the front of the buffer
+    assert(stacki.size() > 1 && bufferi.size() > 1);
+    Expression dep = stack_lstm.top_input();
+    has_head[stacki.back()] = true;
+    stack_lstm.pop();
+    stacki.pop_back();
+    bufferx.back() = compose(bufferx.back(), dep, action);
+    if (!options.lookahead) {
+      buffer_lstm.pop();
+      buffer_lstm.push(bufferx.back());
+    }
+  } else { // arc-eager RIGHT: the front of the buffer to the top of the stack, which it goes on
+    assert(ac == 'R' && stacki.size() > 1 && bufferi.size() > 2);
+    Expression dep = bufferx.back();
+    const int depi = bufferi.back();
+    if (!options.lookahead) buffer_lstm.pop();
+    bufferx.pop_back();
+    bufferi.pop_back();
+    Expression head = stack_lstm.top_input();
+    stack_lstm.pop();
+    stack_lstm.push(compose(head, dep, action));
+    stack_lstm.push(dep);
+    stacki.push_back(depi);
+    has_head[depi] = true;
+  }
+  return action;
+}
+
+vector<unsigned> ParserBuilder::log_prob_parser(ComputationGraph* hg,
+                   const vector<unsigned>& raw_sent,
+                   const vector<unsigned>& sent,
+                   const vector<unsigned>& sentPos,
+                   const vector<unsigned>& correct_actions,
+                   const vector<string>& setOfActions,
+                   double *right,
+                   double* phase_ms) {
+    auto t_start = std::chrono::high_resolution_clock::now();
+    vector<unsigned> results;
+    const bool build_training_graph = correct_actions.size() > 0;
+    begin(hg, setOfActions, build_training_graph);
+    for (unsigned i = 0; i < sent.size(); ++i)
+      add_token(raw_sent[i], sent[i], sentPos[i]);
+    end_input();
+
+    auto t_buffer = t_start;
+    if (phase_ms) {
+      // evaluate the buffer now rather than with the first action, so that
+      // it is timed on its own
+      hg->incremental_forward();
+      t_buffer = std::chrono::high_resolution_clock::now();
+      phase_ms[kBUFFER] = std::chrono::duration<double, std::milli>(t_buffer - t_start).count();
+    }
+
+    while (can_act())
+      results.push_back(act(build_training_graph ? correct_actions[results.size()] : -1, right));
+    assert(stacki.size() == 2); // guard symbol, root
+    assert(bufferi.size() == 1); // guard symbol
+    Expression tot_neglogprob = -sum(log_probs);
+    assert(tot_neglogprob.pg != nullptr);
+    if (phase_ms) {
+      auto t_end = std::chrono::high_resolution_clock::now();
+      phase_ms[kTRANSITIONS] = std::chrono::duration<double, std::milli>(t_end - t_buffer).count();
+    }
+    return results;
+  }
+
+Parser::Parser(const ParserOptions& options, const string& training_data, const string& words) :
+    options(options), cache(nullptr) {
+  corpus.transitions = cpyp::transition_system(options.transitions);
+  corpus.load_correct_actions(training_data);
+  kUNK = corpus.get_or_add_word(cpyp::Corpus::UNK);
+  kROOT_SYMBOL = corpus.get_or_add_word(ROOT_SYMBOL);
+
+  if (!words.empty()) {
+    pretrained[kUNK] = vector<float>(options.pretrained_dim, 0);
+    ifstream in(words.c_str());
+    if (!in) throw runtime_error("Unable to read " + words);
+    string line;
+    getline(in, line);
+    vector<float> v(options.pretrained_dim, 0);
+    string word;
+    while (getline(in, line)) {
+      istringstream lin(line);
+      lin >> word;
+      for (unsigned i = 0; i < options.pretrained_dim; ++i) lin >> v[i];
+      unsigned id = corpus.get_or_add_word(word);
+      pretrained[id] = v;
+    }
+  }
+
+  {  // compute the singletons in the parser's training data
+    map<unsigned, unsigned> counts;
+    for (auto sent : corpus.sentences)
+      for (auto word : sent.second) { training_vocab.insert(word); counts[word]++; }
+    for (auto wc : counts)
+      if (wc.second == 1) singletons.insert(wc.first);
+  }
+  for (auto& s : corpus.correct_act_sent) {
+    const unsigned sent_len = corpus.sentences[s.first].size();
+    const map<int,int> heads = ParserBuilder::compute_heads(sent_len, s.second, corpus.actions,
+                                                            corpus.transitions);
+    unsigned roots = 0;
+    for (auto& h : heads)
+      if (h.second == (int)sent_len - 1) ++roots;
+    if (roots > 1) this->options.multiple_roots = true;
+  }
+  init_builder();
+}
+
+Parser::Parser(const ParserOptions& options) : options(options), cache(nullptr) {
+  corpus.transitions = cpyp::transition_system(options.transitions);
+}
+
+void Parser::init_builder() {
+  const unsigned vocab_size = corpus.nwords + 1;
+  const unsigned action_size = corpus.nactions + 1;
+  const unsigned pos_size = corpus.npos + 10;  // bad way of dealing with the fact that we may see new POS tags in the test set
+  builder.reset(new ParserBuilder(&model, options, vocab_size, action_size, pos_size, pretrained,
+                                  corpus.actions));
+  // OOV words will be replaced by UNK tokens
+  corpus.freeze();
+}
+
+// the header of a bundle, and the version of its format
+static const char* const kBUNDLE_MAGIC = "lstm-parser-bundle";
+static const unsigned kBUNDLE_VERSION = 1;
+
+// the vocabulary and pretrained embeddings of a parser (const when saved)
+template<class Archive, class P> static void serialize_vocabulary(Archive& ar, P& parser) {
+  ar & parser.corpus.wordsToInt & parser.corpus.intToWords;
+  ar & parser.corpus.posToInt & parser.corpus.intToPos & parser.corpus.actions;
+  ar & parser.corpus.nwords & parser.corpus.npos & parser.corpus.nactions;
+  ar & parser.corpus.max & parser.corpus.maxPos;
+  ar & parser.pretrained & parser.training_vocab & parser.singletons;
+  ar & parser.kUNK & parser.kROOT_SYMBOL;
+}
+
+unique_ptr<Parser> Parser::load(const string& fname) {
+  ifstream in(fname.c_str());
+  if (!in) throw runtime_error("Unable to read " + fname);
+  boost::archive::text_iarchive ia(in);
+  string magic;
+  unsigned version;
+  ia >> magic >> version;
+  if (magic != kBUNDLE_MAGIC || version != kBUNDLE_VERSION)
+    throw runtime_error(fname + " is not a parser bundle of version " + to_string(kBUNDLE_VERSION));
+  ParserOptions options;
+  ia >> options;
+  unique_ptr<Parser> parser(new Parser(options));
+  serialize_vocabulary(ia, *parser);
+  parser->init_builder();
+  bool with_folded;
+  ia >> with_folded >> parser->model;
+  if (with_folded) {
+    parser->add_folded_tables();
+    ia >> parser->folded;
+    parser->builder->use_folded = true;
+  }
+  return parser;
+}
+
+void Parser::save_bundle(const string& fname) const {
+  ofstream out(fname);
+  write_bundle(out);
+}
+
+void Parser::write_bundle(ostream& out) const {
+  boost::archive::text_oarchive oa(out);
+  const string magic = kBUNDLE_MAGIC;
+  oa << magic << kBUNDLE_VERSION << options;
+  serialize_vocabulary(oa, *this);
+  const bool with_folded = builder->use_folded;
+  oa << with_folded << model;
+  if (with_folded) oa << folded;
+}
+
+void Parser::add_folded_tables() {
+  if (!builder->p_wfold) builder->add_folded_tables(&folded);
+}
+
+void Parser::load_model(const string& fname, bool with_folded) {
+  ifstream in(fname.c_str());
+  if (!in) throw runtime_error("Unable to read " + fname);
+  boost::archive::text_iarchive ia(in);
+  ia >> model;
+  if (with_folded) {
+    add_folded_tables();
+    ia >> folded;
+    builder->use_folded = true;
+  }
+}
+
+void Parser::save(const string& fname) const {
+  ofstream out(fname);
+  boost::archive::text_oarchive oa(out);
+  oa << model;
+}
+
+void Parser::save_folded(const string& fname) {
+  add_folded_tables();
+  builder->fold_tables();
+  ofstream out(fname);
+  boost::archive::text_oarchive oa(out);
+  oa << model << folded;
+}
+
+void Parser::convert(const Token& token, unsigned* raw, unsigned* word, unsigned* pos) const {
+  int w = corpus.frozenWords.find(token.word);
+  if (w <= 0) {  // not found, or BAD0
+    auto wit = corpus.wordsToInt.find(token.word);
+    w = (wit != corpus.wordsToInt.end() && wit->second != 0) ? wit->second : kUNK;
+  }
+  // tags never seen get id 0, which no tag has, like the tags that
+  // load_correct_actionsDev adds
+  int p = corpus.frozenPos.find(token.pos);
+  if (p < 0) {
+    auto pit = corpus.posToInt.find(token.pos);
+    p = (pit != corpus.posToInt.end()) ? pit->second : 0;
+  }
+  *raw = w;
+  *word = training_vocab.count(w) ? w : kUNK;
+  *pos = p;
+}
+
+void Parser::convert(const vector<Token>& sentence, vector<unsigned>* raw,
+                     vector<unsigned>* sent, vector<unsigned>* pos) const {
+  raw->resize(sentence.size() + 1);
+  sent->resize(sentence.size() + 1);
+  pos->resize(sentence.size() + 1);
+  for (unsigned i = 0; i <= sentence.size(); ++i)
+    convert(i < sentence.size() ? sentence[i] : kROOT, &(*raw)[i], &(*sent)[i], &(*pos)[i]);
+}
+
+Parse Parser::parse(const vector<Token>& sentence) {
+  Parse result;
+  const ParseCache::Key key = cache ? ParseCache::hash(sentence) : ParseCache::Key();
+  if (cache && cache->find(key, &result)) return result;
+  vector<unsigned> raw, sent, pos;
+  convert(sentence, &raw, &sent, &pos);
+  ComputationGraph cg;
+  double right = 0;
+  const vector<unsigned> pred = builder->log_prob_parser(&cg, raw, sent, pos, vector<unsigned>(),
+                                                         corpus.actions, &right);
+  result = to_parse(sent.size(), pred);
+  if (cache) cache->insert(key, result);
+  return result;
+}
+
+Parse Parser::to_parse(unsigned sent_len, const vector<unsigned>& actions) const {
+  map<int, string> rels;
+  const map<int, int> heads = ParserBuilder::compute_heads(sent_len, actions, corpus.actions,
+                                                           builder->system, &rels);
+  Parse result;
+  for (unsigned i = 0; i + 1 < sent_len; ++i) {
+    const int head = heads.find(i)->second + 1;
+    result.heads.push_back(head == (int)sent_len ? 0 : head);
+    // the label is in the parentheses of the action, as in LEFT-ARC(det)
+    const string& rel = rels.find(i)->second;
+    const size_t begin = rel.find('(') + 1;
+    result.labels.push_back(rel.substr(begin, rel.rfind(')') - begin));
+  }
+  return result;
+}
+
+vector<Parse> Parser::parse(const vector<vector<Token>>& sentences) {
+  vector<Parse> results;
+  results.reserve(sentences.size());
+  for (auto& sentence : sentences)
+    results.push_back(parse(sentence));
+  return results;
+}
+
+IncrementalParser::IncrementalParser(Parser* parser) : parser(parser), ntokens(0) {
+  if (!parser->options.lookahead)
+    throw invalid_argument("IncrementalParser needs a parser with a lookahead window");
+  parser->builder->begin(&cg, parser->corpus.actions, false, true);
+}
+
+void IncrementalParser::add(const Token& token) {
+  unsigned raw, word, pos;
+  parser->convert(token, &raw, &word, &pos);
+  add(raw, word, pos);
+}
+
+void IncrementalParser::add(unsigned raw, unsigned word, unsigned pos) {
+  parser->builder->add_token(raw, word, pos);
+  ++ntokens;
+  advance();
+}
+
+Parse IncrementalParser::finish() {
+  add(kROOT);
+  parser->builder->end_input();
+  advance();
+  return parser->to_parse(ntokens, actions_);
+}
+
+void IncrementalParser::advance() {
+  ParserBuilder& b = *parser->builder;
+  while (b.can_act())
+    actions_.push_back(b.act(-1, nullptr));
+}
+
+} // namespace lstm_parser
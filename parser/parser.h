@@ -0,0 +1,331 @@
+#ifndef PARSER_H_
+#define PARSER_H_
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/serialization/version.hpp>
+
+#include "cnn/cnn.h"
+#include "cnn/model.h"
+#include "cnn/stack-lstm.h"
+#include "c2.h"
+#include "oracle.h"
+
+namespace lstm_parser {
+
+// the architecture of a parser. a model can only be read by a parser with
+// the options it was trained with
+struct ParserOptions {
+  unsigned layers = 2;
+  unsigned input_dim = 32;
+  unsigned hidden_dim = 64;
+  unsigned action_dim = 16;
+  unsigned pretrained_dim = 50;
+  unsigned lstm_input_dim = 60;
+  unsigned pos_dim = 12;
+  unsigned rel_dim = 10;
+  std::string stack_cell = "lstm";
+  std::string buffer_cell = "lstm";
+  std::string action_cell = "lstm";
+  bool use_pos = false;
+  // project all the tokens for the composition function at once, rather
+  // than each when it is reduced
+  bool batched_compose = true;
+  // 0: the buffer is summarized by an LSTM over all of it, read right to
+  // left. k > 0: by the inputs of its first k tokens, so that the parser
+  // can run while the sentence is read (see IncrementalParser)
+  unsigned lookahead = 0;
+  // the transition system: "swap", "hybrid" or "eager" (see oracle.h)
+  std::string transitions = "swap";
+  // predict the type of each transition first and then, only for the types
+  // with labels, the label, instead of scoring all the labeled actions
+  bool factored_actions = false;
+  // whether some sentence of the training data attaches several words to
+  // ROOT, which the swap system then allows; set by Parser from its
+  // training data
+  bool multiple_roots = false;
+
+  template<class Archive> void serialize(Archive& ar, const unsigned int version) {
+    ar & layers & input_dim & hidden_dim & action_dim & pretrained_dim & lstm_input_dim;
+    ar & pos_dim & rel_dim & stack_cell & buffer_cell & action_cell & use_pos;
+    ar & batched_compose & lookahead & transitions & factored_actions;
+    // older bundles have a single root
+    if (version > 0) ar & multiple_roots;
+  }
+};
+
+struct ParserBuilder {
+
+  cnn::StackLSTMBuilder stack_lstm; // (layers, input, hidden, trainer)
+  cnn::StackLSTMBuilder buffer_lstm;
+  cnn::StackLSTMBuilder action_lstm; // only ever pushed to
+  cnn::LookupParameters* p_w; // word embeddings
+  cnn::LookupParameters* p_t; // pretrained word embeddings (not updated)
+  cnn::LookupParameters* p_a; // input action embeddings
+  cnn::LookupParameters* p_r; // relation embeddings
+  cnn::LookupParameters* p_p; // pos tag embeddings
+  cnn::Parameters* p_pbias; // parser state bias
+  cnn::Parameters* p_A; // action lstm to parser state
+  cnn::Parameters* p_B; // buffer lstm to parser state
+  cnn::Parameters* p_S; // stack lstm to parser state
+  cnn::Parameters* p_H; // head matrix for composition function
+  cnn::Parameters* p_D; // dependency matrix for composition function
+  cnn::Parameters* p_R; // relation matrix for composition function
+  cnn::Parameters* p_w2l; // word to LSTM input
+  cnn::Parameters* p_p2l; // POS to LSTM input
+  cnn::Parameters* p_t2l; // pretrained word embeddings to LSTM input
+  cnn::Parameters* p_ib; // LSTM input bias
+  cnn::Parameters* p_cbias; // composition function bias
+  cnn::Parameters* p_p2a;   // parser state to action (not factored)
+  cnn::Parameters* p_action_start;  // action bias
+  cnn::Parameters* p_abias;  // action bias (not factored)
+  cnn::Parameters* p_p2t;  // parser state to transition type (factored)
+  cnn::Parameters* p_tbias;  // transition type bias (factored)
+  std::vector<cnn::Parameters*> p_p2labels;  // parser state to label, by type (nullptr if unlabeled)
+  std::vector<cnn::Parameters*> p_lbiases;  // label bias, by type
+  cnn::Parameters* p_buffer_guard;  // end of buffer
+  cnn::Parameters* p_stack_guard;  // end of stack
+
+  // tables that fold a lookup and the linear map applied to it into a single
+  // row, for decoding (see fold_tables)
+  cnn::LookupParameters* p_wfold; // ib + w2l * p_w[w]
+  cnn::LookupParameters* p_tfold; // t2l * p_t[w]
+  cnn::LookupParameters* p_pfold; // p2l * p_p[p]
+  cnn::LookupParameters* p_rfold; // cbias + R * p_r[a]
+  cnn::LookupParameters* p_afold; // input projections of p_a[a] in the action LSTM
+  bool use_folded;
+  // variational dropout rate of the stack, buffer and action LSTMs when
+  // training (see set_dropout)
+  float dropout;
+
+  const ParserOptions options;
+  const cpyp::TransitionSystem system;
+  const unsigned vocab_size;
+  const unsigned action_size;
+  const unsigned pos_size;
+  // pretrained embeddings by word id (the words without one use only p_w)
+  const std::unordered_map<unsigned, std::vector<float>>& pretrained;
+  std::vector<unsigned> possible_actions;
+  // with options.factored_actions, the type of each action (its name up to
+  // the label), its index among the actions of its type, and the actions of
+  // each type
+  std::vector<unsigned> action_type;
+  std::vector<unsigned> action_label;
+  std::vector<std::vector<unsigned>> type_actions;
+
+  // the sentence being parsed (see begin)
+  cnn::ComputationGraph* hg;
+  const std::vector<std::string>* setOfActions;
+  bool training;
+  bool folded;  // decoding with the folded tables
+  bool batched;  // projecting the tokens for the composition function at once
+  bool input_ended;
+  // variables in the computation graph representing the parameters
+  cnn::expr::Expression pbias, H, D, R, cbias, S, B, A, ib, w2l, p2l, t2l, p2a, abias, p2t, tbias;
+  std::vector<cnn::expr::Expression> p2labels, lbiases;  // of the types used so far
+  std::vector<cnn::expr::Expression> tokens;  // the input of each token read
+  std::vector<cnn::expr::Expression> bufferx;  // the buffer (front last), after the guard
+  std::vector<int> bufferi;  // position of the words in the sentence
+  std::vector<int> stacki; // position of words in the sentence of head of subtree
+  std::vector<bool> has_head;  // by position, for arc-eager
+  std::vector<cnn::expr::Expression> log_probs;
+  // H * x and D * x of the tokens, and their columns by token input
+  cnn::expr::Expression token_hx, token_dx;
+  std::unordered_map<unsigned, unsigned> token_col;
+
+  // actions are the names of the actions (the first action_size - 1), which
+  // the factored output layer is made of
+  ParserBuilder(cnn::Model* model, const ParserOptions& options, unsigned vocab_size,
+                unsigned action_size, unsigned pos_size,
+                const std::unordered_map<unsigned, std::vector<float>>& pretrained,
+                const std::vector<std::string>& actions);
+
+  // the folded tables live in their own model, so that models written
+  // without them can still be read
+  void add_folded_tables(cnn::Model* folded);
+
+  // computes the folded tables from the current parameters and decodes with
+  // them from now on. they are not updated by training.
+  void fold_tables();
+  // sets dropout; throws if a sequence model's cell does not support it
+  void set_dropout(float d);
+
+  // starts a sentence in hg, with nothing read yet. incremental leaves out
+  // what needs the whole sentence
+  void begin(cnn::ComputationGraph* hg, const std::vector<std::string>& setOfActions,
+             bool training, bool incremental = false);
+  // reads the next token of the sentence
+  void add_token(unsigned raw, unsigned word, unsigned pos);
+  // after the last token (ROOT)
+  void end_input();
+  // true if the next transition does not depend on tokens not read yet
+  bool can_act() const;
+  // takes the best transition, or correct if it is not -1, and returns it
+  unsigned act(int correct, double* right);
+  cnn::expr::Expression buffer_summary();
+  // with options.factored_actions: the log probability of the type of the
+  // action taken (correct, or the best one if it is -1) and of its label
+  // given the type, which is only computed for types with labels. sets
+  // *best to the best of valid_actions
+  cnn::expr::Expression factored_log_prob(cnn::expr::Expression state,
+                                          const std::vector<unsigned>& valid_actions,
+                                          int correct, unsigned* best);
+  // the subtree of head with dep attached by action
+  cnn::expr::Expression compose(cnn::expr::Expression head, cnn::expr::Expression dep, unsigned action);
+
+  // bsize and ssize count the guards. multiple_roots lets the swap system
+  // attach several words to ROOT (see ParserOptions)
+  static bool IsActionForbidden(cpyp::TransitionSystem system, const std::string& a,
+                                unsigned bsize, unsigned ssize, const std::vector<int>& stacki,
+                                const std::vector<bool>& has_head, bool multiple_roots);
+
+  // take a vector of actions and return a parse tree (labeling of every
+  // word position with its head's position)
+  static std::map<int,int> compute_heads(unsigned sent_len, const std::vector<unsigned>& actions,
+                                         const std::vector<std::string>& setOfActions,
+                                         cpyp::TransitionSystem system,
+                                         std::map<int,std::string>* pr = nullptr);
+
+  // *** if correct_actions is empty, this runs greedy decoding ***
+  // returns parse actions for input sentence (in training just returns the reference)
+  // OOV handling: raw_sent will have the actual words
+  //               sent will have words replaced by appropriate UNK tokens
+  // this lets us use pretrained embeddings, when available, for words that were OOV in the
+  // parser training data
+  std::vector<unsigned> log_prob_parser(cnn::ComputationGraph* hg,
+                                        const std::vector<unsigned>& raw_sent,  // raw sentence
+                                        const std::vector<unsigned>& sent,  // sent with oovs replaced
+                                        const std::vector<unsigned>& sentPos,
+                                        const std::vector<unsigned>& correct_actions,
+                                        const std::vector<std::string>& setOfActions,
+                                        double *right,
+                                        double* phase_ms = nullptr);  // if given, sets [kBUFFER] and [kTRANSITIONS]
+};
+
+class ParseCache;
+
+// a token of a sentence to parse, and its POS tag (which is only read by
+// parsers with use_pos)
+struct Token {
+  std::string word;
+  std::string pos;
+};
+
+// for each token of a sentence, the position of its head (counting from 1,
+// with 0 for the root) and the label of the arc to it
+struct Parse {
+  std::vector<int> heads;
+  std::vector<std::string> labels;
+};
+
+// a parser with everything it uses: the vocabulary of its training data,
+// its pretrained embeddings and its model, which save_bundle writes to a
+// single file that load reads back. nothing is shared between
+// parsers, so several can be loaded in one process. a parser parses one
+// sentence at a time, in the execution context of the calling thread (see
+// cnn::set_thread_context): threads parsing at once need parsers and
+// contexts of their own.
+class Parser {
+ public:
+  // reads the vocabulary and the actions from training_data (an oracle, as
+  // for lstm-parse -T) and, unless words is empty, pretrained embeddings of
+  // options.pretrained_dim dimensions. the model is initialized randomly
+  Parser(const ParserOptions& options, const std::string& training_data,
+         const std::string& words = "");
+  Parser(const Parser&) = delete;
+  Parser& operator=(const Parser&) = delete;
+
+  // reads a parser written by save_bundle, which needs neither the training
+  // data nor the pretrained embeddings. it can parse, but not be trained,
+  // as the training sentences are not kept
+  static std::unique_ptr<Parser> load(const std::string& fname);
+  // writes the options, the vocabulary, the pretrained embeddings and the
+  // model (with the folded tables, if it decodes with them)
+  void save_bundle(const std::string& fname) const;
+  // writes what save_bundle writes to a stream
+  void write_bundle(std::ostream& out) const;
+
+  // adds the folded tables, which load_model(fname, true) and save_folded
+  // need
+  void add_folded_tables();
+  // reads a model written by save, or by save_folded if folded, into a
+  // parser with the options it was trained with
+  void load_model(const std::string& fname, bool folded = false);
+  void save(const std::string& fname) const;
+  // folds the tables (see ParserBuilder::fold_tables) and writes the model
+  // with them
+  void save_folded(const std::string& fname);
+
+  // the ids of the words of a sentence, as they are (raw) and with the words
+  // unknown to the model replaced by UNK (sent), and of their tags, with
+  // ROOT at the end
+  void convert(const std::vector<Token>& sentence, std::vector<unsigned>* raw,
+               std::vector<unsigned>* sent, std::vector<unsigned>* pos) const;
+
+  void convert(const Token& token, unsigned* raw, unsigned* word, unsigned* pos) const;
+
+  // looks the sentence up in the cache first, if there is one, and adds
+  // the parses it does not find
+  Parse parse(const std::vector<Token>& sentence);
+  std::vector<Parse> parse(const std::vector<std::vector<Token>>& sentences);
+  // the parse of a sentence of sent_len tokens (ROOT included) made by actions
+  Parse to_parse(unsigned sent_len, const std::vector<unsigned>& actions) const;
+
+  ParserOptions options;
+  cpyp::Corpus corpus;
+  std::unordered_map<unsigned, std::vector<float>> pretrained;
+  std::set<unsigned> training_vocab; // words available in the training corpus
+  std::set<unsigned> singletons;
+  unsigned kUNK;
+  unsigned kROOT_SYMBOL;
+  cnn::Model model;
+  cnn::Model folded;  // see ParserBuilder::fold_tables
+  std::unique_ptr<ParserBuilder> builder;
+  ParseCache* cache;  // not owned; nullptr for none
+
+ private:
+  // an empty parser, for load
+  explicit Parser(const ParserOptions& options);
+  // creates the model for the vocabulary and actions of the corpus
+  void init_builder();
+};
+
+// parses a sentence while its tokens arrive, with a parser whose buffer is
+// a window (options.lookahead > 0). each token takes the transitions that
+// no later token can change, so that at the end of the sentence only the
+// last few are left. the result is the one Parser::parse gives. the parser
+// must not parse anything else until finish() returns
+class IncrementalParser {
+ public:
+  explicit IncrementalParser(Parser* parser);
+
+  // reads the next token and takes the transitions it makes safe
+  void add(const Token& token);
+  // the same, with the ids Parser::convert gives
+  void add(unsigned raw, unsigned word, unsigned pos);
+  // reads ROOT, takes the remaining transitions and returns the parse
+  Parse finish();
+
+  // the transitions taken so far
+  const std::vector<unsigned>& actions() const { return actions_; }
+
+ private:
+  void advance();
+
+  Parser* parser;
+  cnn::ComputationGraph cg;
+  std::vector<unsigned> actions_;
+  unsigned ntokens;
+};
+
+} // namespace lstm_parser
+
+BOOST_CLASS_VERSION(lstm_parser::ParserOptions, 1)
+
+#endif
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+
+#include "oracle.h"
+#include "parser.h"
+
+using namespace cpyp;
+using namespace std;
+
+struct OracleTest {
+  OracleTest() {
+    // a non-projective sentence (Nivre, 2009): "on" depends on "hearing",
+    // across "is" and "scheduled", and "today" on "scheduled", across
+    // "on the issue". then a projective one with a multiword token and a
+    // word tagged only in CPOSTAG
+    treebank =
+        "# sent_id = 1\n"
+        "1\tA\ta\tDT\tDT\t_\t2\tdet\t_\t_\n"
+        "2\thearing\thearing\tNN\tNN\t_\t3\tnsubj\t_\t_\n"
+        "3\tis\tbe\tVB\tVBZ\t_\t0\troot\t_\t_\n"
+        "4\tscheduled\tschedule\tVB\tVBN\t_\t3\tvg\t_\t_\n"
+        "5\ton\ton\tIN\tIN\t_\t2\tnmod\t_\t_\n"
+        "6\tthe\tthe\tDT\tDT\t_\t7\tdet\t_\t_\n"
+        "7\tissue\tissue\tNN\tNN\t_\t5\tpc\t_\t_\n"
+        "8\ttoday\ttoday\tNN\tNN\t_\t4\tadv\t_\t_\n"
+        "9\t.\t.\t.\t.\t_\t3\tp\t_\t_\n"
+        "\n"
+        "1\tCats\tcat\tNNS\tNNS\t_\t2\tnsubj\t_\t_\n"
+        "2-3\tdon't\t_\t_\t_\t_\t_\t_\t_\t_\n"
+        "2\tdo\tdo\tVB\tVBP\t_\t0\troot\t_\t_\n"
+        "3\tnot\tnot\tRB\t_\t_\t2\tneg\t_\t_\n";
+    // the heads of the words of the first sentence, with 9 for ROOT
+    heads = {1, 2, 9, 2, 1, 6, 4, 3, 2};
+  }
+  ~OracleTest() {
+    for (auto& f : files) remove(f.c_str());
+  }
+
+  // writes a treebank to a new file
+  string write(const string& conll) {
+    char fname[] = "/tmp/test-oracle-XXXXXX";
+    const int fd = mkstemp(fname);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+    ofstream(fname) << conll;
+    files.push_back(fname);
+    return fname;
+  }
+
+  // the heads of the tree the actions build, as in heads
+  vector<int> build(TransitionSystem system, const OracleSentence& s) {
+    vector<string> names;
+    vector<unsigned> ids;
+    for (auto& a : s.actions) {
+      auto it = find(names.begin(), names.end(), a);
+      ids.push_back(it - names.begin());
+      if (it == names.end()) names.push_back(a);
+    }
+    const map<int, int> h = lstm_parser::ParserBuilder::compute_heads(s.words.size(), ids, names, system);
+    vector<int> res;
+    for (unsigned i = 0; i + 1 < s.words.size(); ++i) res.push_back(h.find(i)->second);
+    return res;
+  }
+
+  // true if the parser allows each of the actions (of the swap system) in
+  // turn, and they leave ROOT alone on the stack
+  bool allowed(const OracleSentence& s, bool multiple_roots) {
+    const int n = s.words.size();
+    vector<int> stacki(1, -999), bufferi(1, -999);
+    for (int i = n - 1; i >= 0; --i) bufferi.push_back(i);
+    const vector<bool> has_head(n);
+    for (auto& a : s.actions) {
+      if (lstm_parser::ParserBuilder::IsActionForbidden(kSWAP, a, bufferi.size(), stacki.size(),
+                                                         stacki, has_head, multiple_roots))
+        return false;
+      if (a == "SHIFT") {
+        stacki.push_back(bufferi.back());
+        bufferi.pop_back();
+      } else if (a == "SWAP") {
+        const int top = stacki.back();
+        stacki.pop_back();
+        bufferi.push_back(stacki.back());
+        stacki.back() = top;
+      } else if (a[0] == 'L') {
+        stacki.erase(stacki.end() - 2);
+      } else {
+        stacki.pop_back();
+      }
+    }
+    return bufferi.size() == 1 && stacki.size() == 2;
+  }
+
+  // true if reading the treebank fails, with an error at the line
+  bool fails_at(const string& conll, unsigned line) {
+    const string fname = write(conll);
+    try {
+      read_conll_oracle(fname);
+    } catch (const runtime_error& e) {
+      return string(e.what()).find(fname + ":" + to_string(line) + ":") == 0;
+    }
+    return false;
+  }
+
+  string treebank;
+  vector<int> heads;
+  vector<string> files;
+};
+
+BOOST_FIXTURE_TEST_SUITE(oracle_test, OracleTest);
+
+BOOST_AUTO_TEST_CASE( swap_non_projective ) {
+  const vector<OracleSentence> sents = read_conll_oracle(write(treebank));
+  BOOST_REQUIRE_EQUAL(sents.size(), 2u);
+  const vector<string> words = {"A", "hearing", "is", "scheduled", "on", "the", "issue",
+                                "today", ".", "ROOT"};
+  const vector<string> tags = {"DT", "NN", "VBZ", "VBN", "IN", "DT", "NN", "NN", ".", "ROOT"};
+  BOOST_CHECK(sents[0].words == words);
+  BOOST_CHECK(sents[0].tags == tags);
+  // "is scheduled" is swapped behind "on the issue", and then shifted again
+  const vector<string> expected = {
+      "SHIFT", "SHIFT", "LEFT-ARC(det)", "SHIFT", "SHIFT", "SHIFT", "SWAP", "SWAP",
+      "SHIFT", "SHIFT", "SHIFT", "SWAP", "SWAP", "SHIFT", "SHIFT", "SHIFT", "SWAP", "SWAP",
+      "LEFT-ARC(det)", "RIGHT-ARC(pc)", "RIGHT-ARC(nmod)", "SHIFT", "LEFT-ARC(nsubj)",
+      "SHIFT", "SHIFT", "RIGHT-ARC(adv)", "RIGHT-ARC(vg)", "SHIFT", "RIGHT-ARC(p)",
+      "SHIFT", "LEFT-ARC(root)"};
+  BOOST_CHECK_EQUAL_COLLECTIONS(sents[0].actions.begin(), sents[0].actions.end(),
+                                expected.begin(), expected.end());
+  const vector<int> built = build(kSWAP, sents[0]);
+  BOOST_CHECK_EQUAL_COLLECTIONS(built.begin(), built.end(), heads.begin(), heads.end());
+  BOOST_CHECK(allowed(sents[0], false));
+  BOOST_CHECK(allowed(sents[0], true));
+}
+
+BOOST_AUTO_TEST_CASE( swap_jar ) {
+  // sentences of the Czech PDT test set that comes with the jar, most of
+  // them with several words attached to ROOT, and the output of
+  // java -jar ParserOracleArcStdWithSwap.jar -t -1 -l 1 -c czech-pdt.conll
+  const string dir = TEST_DATA_DIR;
+  const vector<OracleSentence> sents = read_conll_oracle(dir + "/czech-pdt.conll");
+  vector<vector<string>> expected;
+  ifstream in(dir + "/czech-pdt.oracle");
+  for (string line; getline(in, line);) {
+    if (line.empty()) expected.emplace_back();
+    else if (line[0] != '[') expected.back().push_back(line);
+  }
+  // and the trees, to check that the actions build them
+  vector<vector<int>> trees(1);
+  ifstream conll(dir + "/czech-pdt.conll");
+  for (string line; getline(conll, line);) {
+    if (line.empty()) {
+      trees.emplace_back();
+      continue;
+    }
+    vector<string> fields;
+    istringstream iss(line);
+    for (string f; getline(iss, f, '\t');) fields.push_back(f);
+    trees.back().push_back(atoi(fields[6].c_str()) - 1);
+  }
+  trees.pop_back();
+  BOOST_REQUIRE_EQUAL(sents.size(), 4u);
+  BOOST_REQUIRE_EQUAL(expected.size(), sents.size());
+  BOOST_REQUIRE_EQUAL(trees.size(), sents.size());
+  for (unsigned i = 0; i < sents.size(); ++i) {
+    BOOST_CHECK_EQUAL_COLLECTIONS(sents[i].actions.begin(), sents[i].actions.end(),
+                                  expected[i].begin(), expected[i].end());
+    vector<int>& h = trees[i];
+    for (auto& head : h)
+      if (head < 0) head = h.size();
+    // a parser trained on a single root does not shift ROOT onto several
+    const bool single_root = count(h.begin(), h.end(), (int)h.size()) == 1;
+    BOOST_CHECK(allowed(sents[i], true));
+    BOOST_CHECK_EQUAL(allowed(sents[i], false), single_root);
+    const vector<int> built = build(kSWAP, sents[i]);
+    BOOST_CHECK_EQUAL_COLLECTIONS(built.begin(), built.end(), h.begin(), h.end());
+  }
+}
+
+BOOST_AUTO_TEST_CASE( multiple_roots ) {
+  lstm_parser::ParserOptions options;
+  options.hidden_dim = 16;
+  BOOST_CHECK(!lstm_parser::Parser(options, write(treebank)).options.multiple_roots);
+  const string czech = string(TEST_DATA_DIR) + "/czech-pdt.conll";
+  BOOST_CHECK(lstm_parser::Parser(options, czech).options.multiple_roots);
+}
+
+BOOST_AUTO_TEST_CASE( swap_projective ) {
+  const vector<OracleSentence> sents = read_conll_oracle(write(treebank));
+  BOOST_REQUIRE_EQUAL(sents.size(), 2u);
+  // the multiword token is skipped, and "not" is tagged by its CPOSTAG
+  BOOST_CHECK((sents[1].words == vector<string>{"Cats", "do", "not", "ROOT"}));
+  BOOST_CHECK((sents[1].tags == vector<string>{"NNS", "VBP", "RB", "ROOT"}));
+  const vector<string> expected = {"SHIFT", "SHIFT", "LEFT-ARC(nsubj)", "SHIFT",
+                                   "RIGHT-ARC(neg)", "SHIFT", "LEFT-ARC(root)"};
+  BOOST_CHECK_EQUAL_COLLECTIONS(sents[1].actions.begin(), sents[1].actions.end(),
+                                expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( projectivized ) {
+  // "on" is lifted to "is", and then "today", across it, to "is" too
+  vector<int> lifted_heads = heads;
+  lifted_heads[4] = lifted_heads[7] = 2;
+  vector<int> h = heads;
+  BOOST_CHECK_EQUAL(projectivize(&h), 2u);
+  BOOST_CHECK_EQUAL_COLLECTIONS(h.begin(), h.end(), lifted_heads.begin(), lifted_heads.end());
+  for (TransitionSystem system : {kHYBRID, kEAGER}) {
+    unsigned lifted = 0;
+    const vector<OracleSentence> sents = read_conll_oracle(write(treebank), system, &lifted);
+    BOOST_CHECK_EQUAL(lifted, 2u);
+    BOOST_REQUIRE_EQUAL(sents.size(), 2u);
+    // 2n + 1 transitions
+    BOOST_CHECK_EQUAL(sents[0].actions.size(), 19u);
+    BOOST_CHECK_EQUAL(count(sents[0].actions.begin(), sents[0].actions.end(), "SWAP"), 0);
+    const vector<int> built = build(system, sents[0]);
+    BOOST_CHECK_EQUAL_COLLECTIONS(built.begin(), built.end(),
+                                  lifted_heads.begin(), lifted_heads.end());
+    // the heads as read, which the dev UAS is measured against
+    BOOST_CHECK_EQUAL_COLLECTIONS(sents[0].heads.begin(), sents[0].heads.end(),
+                                  heads.begin(), heads.end());
+  }
+}
+
+BOOST_AUTO_TEST_CASE( bad_heads ) {
+  const string line1 = "1\tA\ta\tDT\tDT\t_\t2\tdet\t_\t_\n";
+  const string line2 = "2\tcat\tcat\tNN\tNN\t_\t0\troot\t_\t_\n";
+  BOOST_CHECK(fails_at("# c\n" + line1 + "2\tcat\tcat\tNN\tNN\t_\tx\troot\t_\t_\n", 3));
+  BOOST_CHECK(fails_at(line1 + "2\tcat\tcat\tNN\tNN\t_\t-1\troot\t_\t_\n", 2));
+  BOOST_CHECK(fails_at(line1 + "2\tcat\tcat\tNN\tNN\t_\t\troot\t_\t_\n", 2));
+  BOOST_CHECK(fails_at(line1 + "2\tcat\tcat\tNN\tNN\t_\t99999999999\troot\t_\t_\n", 2));
+  // a head past the sentence is found when its tree is complete
+  BOOST_CHECK_THROW(read_conll_oracle(write(line1 + "2\tcat\tcat\tNN\tNN\t_\t3\troot\t_\t_\n")),
+                    runtime_error);
+  BOOST_CHECK_EQUAL(read_conll_oracle(write(line1 + line2)).size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( bad_lines ) {
+  // ID to DEPREL are needed
+  BOOST_CHECK(fails_at("1\tA\ta\tDT\tDT\t_\t0\n", 1));
+  BOOST_CHECK_EQUAL(read_conll_oracle(write("1\tA\ta\tDT\tDT\t_\t0\troot\n")).size(), 1u);
+  BOOST_CHECK(fails_at("1\tA\ta\tDT\tDT\t_\t0\troot\t_\t_\n3\tB\tb\tDT\tDT\t_\t1\tdep\t_\t_\n", 2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+#define BOOST_TEST_MODULE ParserTest
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cnn/cnn.h"
+#include "cnn/expr.h"
+#include "cnn/init.h"
+#include "oracle.h"
+#include "parser.h"
+
+using namespace cnn;
+using namespace cnn::expr;
+using namespace lstm_parser;
+using namespace std;
+
+// cnn is initialized once for all the tests, with small memory pools
+struct CnnInit {
+  CnnInit() {
+    char arg0[] = "test-parser", arg1[] = "--cnn-mem", arg2[] = "64";
+    char* args[] = {arg0, arg1, arg2, nullptr};
+    int argc = 3;
+    char** argv = args;
+    cnn::Initialize(argc, argv, 1);
+  }
+};
+
+BOOST_GLOBAL_FIXTURE(CnnInit);
+
+struct FactoredTest {
+  FactoredTest() : treebank(string(TEST_DATA_DIR) + "/czech-pdt.conll") {
+    options.factored_actions = true;
+    options.hidden_dim = 16;
+  }
+
+  // the log probability that factored_log_prob gives action a, among valid
+  float log_prob(ParserBuilder* b, const vector<unsigned>& valid, unsigned a) {
+    ComputationGraph cg;
+    b->begin(&cg, parser().corpus.actions, false);
+    Expression state = input(cg, {options.hidden_dim}, &state_values);
+    unsigned best;
+    return as_scalar(cg.get_value(b->factored_log_prob(state, valid, a, &best)));
+  }
+
+  Parser& parser() {
+    if (!p) p.reset(new Parser(options, treebank));
+    return *p;
+  }
+
+  ParserOptions options;
+  string treebank;
+  unique_ptr<Parser> p;
+  vector<float> state_values;
+};
+
+BOOST_FIXTURE_TEST_SUITE(factored_test, FactoredTest);
+
+BOOST_AUTO_TEST_CASE( factored_normalized ) {
+  ParserBuilder* b = parser().builder.get();
+  for (unsigned i = 0; i < options.hidden_dim; ++i) state_values.push_back(sin(i + 1.f));
+  const vector<string>& names = parser().corpus.actions;
+  vector<unsigned> all, no_left;
+  for (unsigned a = 0; a < b->possible_actions.size(); ++a) {
+    all.push_back(a);
+    if (names[a].compare(0, 8, "LEFT-ARC") != 0) no_left.push_back(a);
+  }
+  // the valid actions are the actions of some of the types
+  for (const vector<unsigned>& valid : {all, no_left}) {
+    double total = 0;
+    for (auto a : valid) total += exp(log_prob(b, valid, a));
+    BOOST_CHECK_CLOSE(total, 1.0, 1e-3);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( factored_unlabeled_types ) {
+  ParserBuilder* b = parser().builder.get();
+  for (unsigned i = 0; i < options.hidden_dim; ++i) state_values.push_back(cos(i + 1.f));
+  const vector<string>& names = parser().corpus.actions;
+  const unsigned shift = find(names.begin(), names.end(), "SHIFT") - names.begin();
+  BOOST_REQUIRE(shift < b->possible_actions.size());
+  const unsigned t = b->action_type[shift];
+  BOOST_CHECK_EQUAL(b->type_actions[t].size(), 1u);
+  BOOST_CHECK(!b->p_p2labels[t] && !b->p_lbiases[t]);
+  for (unsigned a = 0; a < b->possible_actions.size(); ++a)
+    BOOST_CHECK_EQUAL(b->type_actions[b->action_type[a]].size() > 1, (bool)b->p_p2labels[b->action_type[a]]);
+
+  // log p(SHIFT) is the log probability of its type alone
+  const vector<unsigned>& valid = b->possible_actions;
+  ComputationGraph cg;
+  b->begin(&cg, names, false);
+  Expression state = input(cg, {options.hidden_dim}, &state_values);
+  unsigned best;
+  const float lp = as_scalar(cg.get_value(b->factored_log_prob(state, valid, shift, &best)));
+  for (auto& l : b->p2labels) BOOST_CHECK(!l.pg);
+  vector<float> tscores = as_vector(cg.get_value(affine_transform({b->tbias, b->p2t, state})));
+  double z = 0;
+  for (auto s : tscores) z += exp(s);
+  BOOST_CHECK_CLOSE(lp, tscores[t] - log(z), 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE( factored_bundle ) {
+  char fname[] = "/tmp/test-parser-XXXXXX";
+  const int fd = mkstemp(fname);
+  BOOST_REQUIRE(fd >= 0);
+  close(fd);
+  parser().save_bundle(fname);
+  unique_ptr<Parser> loaded = Parser::load(fname);
+  remove(fname);
+  BOOST_CHECK(loaded->builder->options.factored_actions);
+
+  for (auto& s : cpyp::read_conll_oracle(treebank)) {
+    vector<Token> sentence;
+    for (unsigned i = 0; i + 1 < s.words.size(); ++i)  // without ROOT
+      sentence.push_back({s.words[i], s.tags[i]});
+    const Parse expected = parser().parse(sentence), parse = loaded->parse(sentence);
+    BOOST_CHECK_EQUAL_COLLECTIONS(parse.heads.begin(), parse.heads.end(),
+                                  expected.heads.begin(), expected.heads.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(parse.labels.begin(), parse.labels.end(),
+                                  expected.labels.begin(), expected.labels.end());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()